@@ -1,244 +1,607 @@
 #include "handmade.h"
 #include "handmade_intrinsics.h"
 
+#if HANDMADE_INTERNAL
+GameMemory *debug_global_memory;
+#endif
 
-// The sound_buffer is interleaved LRLRLR...
-static void output_sound(ThreadContext *thread_ctx, GameState *game_state, GameSoundOutputBuffer *sound_buffer, int toneHz) {
-    i16 tone_volume = 2500;
-    int wave_period = sound_buffer->samples_per_second / toneHz;
+// Anything only the HANDMADE_INTERNAL debug load calls so far is inline rather
+// than static, so a release build doesn't warn about it going unused
+#include "handmade_render.cpp"
+#include "handmade_asset.cpp"
+#include "handmade_world.cpp"
+#include "handmade_entity.cpp"
+#include "handmade_spatial.cpp"
+#include "handmade_path.cpp"
+#include "handmade_sim_region.cpp"
+#include "handmade_synth.cpp"
+#include "handmade_audio.cpp"
+
+
+/*
+  World
+*/
+#define TILE_MAP_COUNT_X 17
+#define TILE_MAP_COUNT_Y 9
 
-		i16 *sample_out = sound_buffer->samples;
+global_variable const u32 tiles_00[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
+  { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 1, 1,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 1, 1, 0,  1,  0, 0, 1, 1,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  1,  0, 0, 0, 0,  0, 0, 0, 0 },
+  { 1, 1, 0, 0,  0, 0, 0, 0,  1,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 1, 1, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 1, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  1, 1, 1, 1 },
+  { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 }
+};
 
-		for(int sample_index = 0; sample_index < sound_buffer->sample_count; ++sample_index) {
-#if 0
-			f32 sine_value = sinf(game_state->sine);
-			i16 sample_value = (i16)(sine_value * tone_volume);
-#else
-			i16 sample_value = 0;
-#endif
-			*sample_out++ = sample_value;
-			*sample_out++ = sample_value;
+global_variable const u32 tiles_01[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
+  { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 0 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 }
+};
 
-#if 0
-      game_state->sine += 2.0f * Pi32 * (1.0f / (f32)wave_period);
-      if (game_state->sine > 2.0f * Pi32) {
-        game_state->sine -= 2.0f * Pi32;
-      }
-#endif
-		}
+global_variable const u32 tiles_10[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
+  { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 0, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 }
+};
+
+global_variable const u32 tiles_11[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
+  { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 0, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
+  { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 }
+};
+
+// Builds the world into arena, which has to be permanent storage. Only runs
+// once, everything after that (including after a reload of the game code)
+// reads what it left there.
+static World *initialize_world(MemoryArena *arena) {
+  World *world = PushStruct(arena, World);
+  *world = {};
+  world->tile_size_meters = 1.4f;
+  world->tile_size_pixels = 60;
+  set_world_tile_map_size(world, TILE_MAP_COUNT_X, TILE_MAP_COUNT_Y);
+  world->upper_left_x = -(f32)world->tile_size_pixels / 2.0f;
+  world->upper_left_y = 0;
+
+  // Tile maps that aren't in the world are solid
+  const u32 *room_tiles[2][2] = {
+    { (const u32 *)tiles_00, (const u32 *)tiles_10 },
+    { (const u32 *)tiles_01, (const u32 *)tiles_11 },
+  };
+
+  for (u32 tile_map_y = 0; tile_map_y < ArrayCount(room_tiles); ++tile_map_y) {
+    for (u32 tile_map_x = 0; tile_map_x < ArrayCount(room_tiles[0]); ++tile_map_x) {
+      TileMap *tile_map = world_get_or_create_tile_map(arena, world, (i32)tile_map_x, (i32)tile_map_y);
+      tile_map_set_tiles(world, tile_map, room_tiles[tile_map_y][tile_map_x]);
+    }
+  }
+
+  return world;
 }
 
+#if defined(HANDMADE_DEBUG_ENTITY_COUNT)
+// Where the debug entities' rooms start, well away from the real ones
+#define DEBUG_ENTITY_FIRST_TILE_MAP 1000
+
+// Scatters entity_count small bouncing entities over a square of walled rooms
+// of their own, about 64 to a room. Nothing draws them, they're there to load
+// update_entities and the broadphase: build the dll with
+// -DHANDMADE_DEBUG_ENTITY_COUNT=100000 and watch the UpdateEntities counter.
+static void add_debug_entities(MemoryArena *arena, World *world, EntityStore *entities, u32 entity_count) {
+  Assert(entities->count + entity_count <= entities->capacity);
+  u32 target_count = entities->count + entity_count;
+
+  i32 rooms_per_side = 1;
+  while ((u32)(rooms_per_side * rooms_per_side * 64) < entity_count) {
+    ++rooms_per_side;
+  }
 
-inline TileMap * world_get_tile_map(World *world, i32 tile_map_x, i32 tile_map_y) {
-  TileMap *tile_map = 0;
+  u32 *room_tiles = PushArray(arena, world->count_x * world->count_y, u32);
+  for (i32 y = 0; y < world->count_y; ++y) {
+    for (i32 x = 0; x < world->count_x; ++x) {
+      bool is_wall = (x == 0) || (y == 0) || (x == world->count_x - 1) || (y == world->count_y - 1);
+      room_tiles[y * world->count_x + x] = is_wall ? 1 : 0;
+    }
+  }
+  for (i32 room_y = 0; room_y < rooms_per_side; ++room_y) {
+    for (i32 room_x = 0; room_x < rooms_per_side; ++room_x) {
+      TileMap *tile_map = world_get_or_create_tile_map(arena, world,
+        DEBUG_ENTITY_FIRST_TILE_MAP + room_x, DEBUG_ENTITY_FIRST_TILE_MAP + room_y);
+      tile_map_set_tiles(world, tile_map, room_tiles);
+    }
+  }
+
+  // xorshift32, the same entities every run
+  u32 random_state = 0x2545F491;
+  i32 first_tile_x = DEBUG_ENTITY_FIRST_TILE_MAP * world->count_x;
+  i32 first_tile_y = DEBUG_ENTITY_FIRST_TILE_MAP * world->count_y;
+  u32 tiles_x = (u32)(rooms_per_side * world->count_x);
+  u32 tiles_y = (u32)(rooms_per_side * world->count_y);
+  CollisionBox box = {-TILE_OFFSET_ONE / 8, -TILE_OFFSET_ONE / 8, TILE_OFFSET_ONE / 8, TILE_OFFSET_ONE / 8};
+
+  while (entities->count < target_count) {
+    random_state ^= random_state << 13; random_state ^= random_state >> 17; random_state ^= random_state << 5;
+    u32 tile_bits = random_state;
+    random_state ^= random_state << 13; random_state ^= random_state >> 17; random_state ^= random_state << 5;
+    u32 offset_bits = random_state;
+
+    WorldPosition pos = {
+      first_tile_x + (i32)((tile_bits & 0xFFFF) % tiles_x),
+      first_tile_y + (i32)((tile_bits >> 16) % tiles_y),
+      (i32)(offset_bits & TILE_OFFSET_MASK),
+      (i32)((offset_bits >> 16) & TILE_OFFSET_MASK)};
+    WorldPosition min_pos = offset_position(pos, box.min_x, box.min_y);
+    WorldPosition max_pos = offset_position(pos, box.max_x - 1, box.max_y - 1);
+    if (!world_is_area_empty(world, min_pos, max_pos)) {
+      continue;
+    }
+
+    EntityHandle handle = add_entity(entities, pos, box, EntityFlag_Collides | EntityFlag_Bounces);
+    u32 slot = get_entity_slot(entities, handle);
+    random_state ^= random_state << 13; random_state ^= random_state >> 17; random_state ^= random_state << 5;
+    entities->velocity_x[slot] = (f32)((i32)(random_state & 0xFFFF) - 0x8000) * (240.0f / 32768.0f);
+    entities->velocity_y[slot] = (f32)((i32)(random_state >> 16) - 0x8000) * (240.0f / 32768.0f);
+  }
+}
+#endif
 
-  if ((tile_map_x >= 0) && (tile_map_x < world->tile_map_count_x) &&
-      (tile_map_y >= 0) && (tile_map_y < world->tile_map_count_y)) {
-    tile_map = &world->tile_maps[tile_map_y * world->tile_map_count_x + tile_map_x];
+#if HANDMADE_INTERNAL
+/*
+  Debug load, see GameDebugLoad
+*/
+// xorshift32
+inline u32 next_debug_load_random(GameState *game_state) {
+  u32 random_state = game_state->debug_load_random_state;
+  random_state ^= random_state << 13; random_state ^= random_state >> 17; random_state ^= random_state << 5;
+  game_state->debug_load_random_state = random_state;
+  return random_state;
+}
+
+// Rebuilds the broadphase over the whole entity store, finds its pairs and
+// runs query_count box and query_count radius queries in it. With
+// -DHANDMADE_DEBUG_ENTITY_COUNT=<n> that's its cost at n entities.
+static void run_debug_spatial_queries(GameState *game_state, MemoryArena *arena, u32 query_count) {
+  EntityStore *entities = &game_state->entities;
+  TemporaryMemory query_memory = begin_temporary_memory(arena);
+
+  SpatialHash *hash = build_spatial_hash(arena, entities);
+  // Nowhere to put them, this only counts them
+  spatial_hash_find_pairs(hash, 0, 0);
+
+  u32 max_slot_count = 1024;
+  u32 *slots = PushArray(arena, max_slot_count, u32);
+  i32 reach = 2 * TILE_OFFSET_ONE;
+
+  BEGIN_TIMED_BLOCK(QuerySpatialHash);
+  for (u32 query_idx = 0; query_idx < query_count; ++query_idx) {
+    u32 slot = next_debug_load_random(game_state) % entities->count;
+    WorldPosition center = get_entity_position(entities, slot);
+    spatial_hash_query_box(hash, offset_position(center, -reach, -reach), offset_position(center, reach, reach),
+      slots, max_slot_count);
+    spatial_hash_query_radius(hash, center, reach, slots, max_slot_count);
   }
+  END_TIMED_BLOCK_COUNTED(QuerySpatialHash, 2 * query_count);
 
-  return tile_map;
+  end_temporary_memory(query_memory);
 }
 
-inline u32 tile_map_get_unchecked_tile_value(World *world, TileMap *tile_map, i32 x, i32 y) {
-  Assert(tile_map);
-  Assert((x >= 0) && (x < world->count_x) && (y >= 0) && (y < world->count_y));
-  
-  u32 val = tile_map->tiles[y * world->count_x + x];
-  return val;
+// Somewhere in the starting rooms that can be walked on
+static PathTile get_debug_open_tile(GameState *game_state) {
+  World *world = game_state->world;
+  PathTile tile;
+  WorldPosition pos;
+  do {
+    u32 random = next_debug_load_random(game_state);
+    tile.abs_tile_x = (i32)((random & 0xFFFF) % (u32)(2 * world->count_x));
+    tile.abs_tile_y = (i32)((random >> 16) % (u32)(2 * world->count_y));
+    pos = {tile.abs_tile_x, tile.abs_tile_y, 0, 0};
+  } while (!world_is_point_empty(world, pos));
+
+  return tile;
 }
 
-inline bool tile_map_is_point_empty(World *world, TileMap *tile_map, i32 x, i32 y) {
-  bool empty = false;
+// Removes random entities other than the player and adds each one back,
+// moving at the same speed, at the centre of a random open tile its box fits
+// in. One that doesn't find room goes back where it was.
+static void run_debug_entity_churn(GameState *game_state, u32 churn_count) {
+  World *world = game_state->world;
+  EntityStore *entities = &game_state->entities;
+
+  for (u32 churn_idx = 0; (churn_idx < churn_count) && (entities->count > 1); ++churn_idx) {
+    u32 slot = next_debug_load_random(game_state) % entities->count;
+    u32 index = entities->handle_indices[slot];
+    if (index == game_state->player.index) {
+      continue;
+    }
 
-  if (tile_map) {
-    if ((x >= 0) && (x < world->count_x) &&
-        (y >= 0) && (y < world->count_y))
-    {
-      u32 tile_map_val = tile_map_get_unchecked_tile_value(world, tile_map, x, y);
-      empty = tile_map_val == 0;
+    CollisionBox box = {entities->box_min_x[slot], entities->box_min_y[slot],
+      entities->box_max_x[slot], entities->box_max_y[slot]};
+    u32 flags = entities->flags[slot];
+    f32 velocity_x = entities->velocity_x[slot];
+    f32 velocity_y = entities->velocity_y[slot];
+    WorldPosition pos = get_entity_position(entities, slot);
+
+    for (u32 attempt_idx = 0; attempt_idx < 16; ++attempt_idx) {
+      PathTile tile = get_debug_open_tile(game_state);
+      WorldPosition tile_center = {tile.abs_tile_x, tile.abs_tile_y, TILE_OFFSET_ONE / 2, TILE_OFFSET_ONE / 2};
+      WorldPosition min_pos = offset_position(tile_center, box.min_x, box.min_y);
+      WorldPosition max_pos = offset_position(tile_center, box.max_x - 1, box.max_y - 1);
+      if (world_is_area_empty(world, min_pos, max_pos)) {
+        pos = tile_center;
+        break;
+      }
     }
+
+    EntityHandle handle = {index, entities->generations[index]};
+    remove_entity(entities, handle);
+
+    handle = add_entity(entities, pos, box, flags);
+    slot = get_entity_slot(entities, handle);
+    entities->velocity_x[slot] = velocity_x;
+    entities->velocity_y[slot] = velocity_y;
+  }
+}
+
+static void run_debug_path_queries(GameState *game_state, u32 query_count) {
+  if (!game_state->debug_pathfinder) {
+    game_state->debug_pathfinder = allocate_pathfinder(&game_state->permanent_arena, game_state->world, 16384);
   }
 
-  return empty;
+  PathTile waypoints[64];
+  for (u32 query_idx = 0; query_idx < query_count; ++query_idx) {
+    PathTile from = get_debug_open_tile(game_state);
+    PathTile to = get_debug_open_tile(game_state);
+    find_path(game_state->debug_pathfinder, from, to, waypoints, ArrayCount(waypoints));
+  }
 }
 
-static WorldPosition get_canonical_position(World *world, RawPosition raw_pos) {
-  WorldPosition world_pos;
-  world_pos.tile_map_x = raw_pos.tile_map_x;
-  world_pos.tile_map_y = raw_pos.tile_map_y;
+// The cache is made the first time, and handed to the world so it hears about
+// every tile that changes from then on
+static void run_debug_flow_field_changes(GameState *game_state, MemoryArena *arena, u32 change_count, bool check) {
+  World *world = game_state->world;
+  if (!world->flow_fields) {
+    world->flow_fields = allocate_flow_field_cache(&game_state->permanent_arena, world, 1, 1);
+  }
+  FlowFieldCache *cache = world->flow_fields;
 
-  f32 x = raw_pos.x - world->upper_left_x;
-  f32 y = raw_pos.y - world->upper_left_y;
-  world_pos.tile_x = f32_floor_to_i32(x / world->tile_size_pixels);
-  world_pos.tile_y = f32_floor_to_i32(y / world->tile_size_pixels);
-  world_pos.x = x - world_pos.tile_x * world->tile_size_pixels;
-  world_pos.y = y - world_pos.tile_y * world->tile_size_pixels;
+  EntityStore *entities = &game_state->entities;
+  WorldPosition player_p = get_entity_position(entities, get_entity_slot(entities, game_state->player));
+  PathTile goal = {player_p.abs_tile_x, player_p.abs_tile_y};
+  FlowField *field = get_flow_field(cache, goal);
 
-  Assert(world_pos.x >= 0);
-  Assert(world_pos.y >= 0);
-  Assert(world_pos.x < world->tile_size_pixels);
-  Assert(world_pos.y < world->tile_size_pixels);
+  for (u32 change_idx = 0; change_idx < change_count; ++change_idx) {
+    PathTile tile = get_debug_open_tile(game_state);
+    if ((tile.abs_tile_x == goal.abs_tile_x) && (tile.abs_tile_y == goal.abs_tile_y)) {
+      continue;
+    }
 
-  if (world_pos.tile_x < 0) {
-    world_pos.tile_x = world->count_x + world_pos.tile_x;
-    --world_pos.tile_map_x;
-  }
+    WorldPosition pos = {tile.abs_tile_x, tile.abs_tile_y, 0, 0};
+    TileMapPosition tile_map_pos = get_tile_map_position(world, pos);
+    TileMap *tile_map = world_get_tile_map(world, tile_map_pos.tile_map_x, tile_map_pos.tile_map_y);
 
-  if (world_pos.tile_y < 0) {
-    world_pos.tile_y = world->count_y + world_pos.tile_y;
-    --world_pos.tile_map_y;
+    tile_map_set_tile_value(world, tile_map, tile_map_pos.tile_x, tile_map_pos.tile_y, 1);
+    Assert(!check || flow_field_matches_rebuild(cache, field, arena));
+    tile_map_set_tile_value(world, tile_map, tile_map_pos.tile_x, tile_map_pos.tile_y, 0);
+    Assert(!check || flow_field_matches_rebuild(cache, field, arena));
   }
+}
 
-  if (world_pos.tile_x >= world->count_x) {
-    world_pos.tile_x = world_pos.tile_x - world->count_x;
-    ++world_pos.tile_map_x;
+// The voices play voice.wav when there is one, and a sine otherwise
+static void update_debug_voices(ThreadContext *thread_ctx, GameMemory *memory, GameState *game_state, u32 voice_count) {
+  if (!game_state->debug_sound) {
+    game_state->debug_sound = debug_load_wav(thread_ctx, memory, &game_state->permanent_arena, "voice.wav");
+  }
+  if (!game_state->debug_sound) {
+    game_state->debug_sound = make_sine_sound(&game_state->permanent_arena, 48000, 480.0f, 1.0f);
   }
 
-  if (world_pos.tile_y >= world->count_y) {
-    world_pos.tile_y = world_pos.tile_y - world->count_y;
-    ++world_pos.tile_map_y;
+  voice_count = (voice_count < MAX_VOICE_COUNT) ? voice_count : MAX_VOICE_COUNT;
+  while (game_state->debug_voice_count < voice_count) {
+    // Quiet enough that a few hundred of them only clip now and then
+    f32 pan = (f32)((i32)(game_state->debug_voice_count % 9) - 4) / 4.0f;
+    Voice *voice = play_sound(game_state->mixer, game_state->debug_sound, 1.0f / 64.0f, pan, true);
+    if (!voice) {
+      break;
+    }
+    game_state->debug_voices[game_state->debug_voice_count++] = voice;
   }
 
-  return world_pos;
+  while (game_state->debug_voice_count > voice_count) {
+    stop_voice(game_state->mixer, game_state->debug_voices[--game_state->debug_voice_count]);
+  }
 }
 
-inline bool world_is_point_empty(World *world, RawPosition test_pos) {
-  bool empty = false;
+// Tone n is a semitone above tone n - 1, from 110Hz and round again every four
+// octaves. The vibrato is 5Hz and a quarter of a semitone each way.
+static void update_debug_tones(GameState *game_state, u32 tone_count, f32 dt) {
+  tone_count = (tone_count < MAX_VOICE_COUNT) ? tone_count : MAX_VOICE_COUNT;
+  while (game_state->debug_tone_count < tone_count) {
+    u32 tone_idx = game_state->debug_tone_count;
+    Waveform waveform = (Waveform)(tone_idx % Waveform_Count);
+    f32 pan = (f32)((i32)(tone_idx % 9) - 4) / 4.0f;
+    Voice *voice = play_tone(game_state->mixer, waveform, 110.0f, 0.0f, 1.0f / 64.0f, pan);
+    if (!voice) {
+      break;
+    }
+    game_state->debug_tones[game_state->debug_tone_count++] = voice;
+  }
 
-  WorldPosition canonical_pos = get_canonical_position(world, test_pos);
-  TileMap *tile_map = world_get_tile_map(world, canonical_pos.tile_map_x, canonical_pos.tile_map_y);
-  empty = tile_map_is_point_empty(world, tile_map, canonical_pos.tile_x, canonical_pos.tile_y);
+  while (game_state->debug_tone_count > tone_count) {
+    stop_voice(game_state->mixer, game_state->debug_tones[--game_state->debug_tone_count]);
+  }
 
-  return empty;
+  game_state->debug_tone_seconds += dt;
+  f32 vibrato = 1.0f + 0.0145f * f32_sin(2.0f * Pi32 * 5.0f * game_state->debug_tone_seconds);
+  f32 frequency = 110.0f;
+  for (u32 tone_idx = 0; tone_idx < game_state->debug_tone_count; ++tone_idx) {
+    set_tone_frequency(game_state->mixer, game_state->debug_tones[tone_idx], frequency * vibrato);
+    frequency = ((tone_idx % 48) == 47) ? 110.0f : frequency * 1.0594631f;
+  }
 }
 
+static void update_debug_test_tone(GameState *game_state, f32 rate) {
+  if ((rate > 0.0f) && !game_state->debug_test_tone_voice) {
+    if (!game_state->debug_test_tone) {
+      game_state->debug_test_tone = make_sine_sound(&game_state->permanent_arena, 44100, 8000.0f, 1.0f);
+    }
+    game_state->debug_test_tone_voice = play_sound(game_state->mixer, game_state->debug_test_tone, 0.5f, 0.0f, true);
+  } else if ((rate <= 0.0f) && game_state->debug_test_tone_voice) {
+    stop_voice(game_state->mixer, game_state->debug_test_tone_voice);
+    game_state->debug_test_tone_voice = 0;
+  }
 
-// Renders a small square as the player
-static void draw_rectangle(
-  GameOffScreenBuffer *buffer,
-  f32 min_x, f32 min_y,
-  f32 max_x, f32 max_y,
-  f32 r, f32 g, f32 b
+  if (game_state->debug_test_tone_voice) {
+    set_voice_playback_rate(game_state->debug_test_tone_voice, rate);
+  }
+}
+#endif
+
+// Pushes the magenta background and the tiles in tiles (absolute, max
+// exclusive), whose values are row by row in values. (x, y) is where the top
+// left corner of tile (min_x, min_y) goes.
+static void push_tiles(RenderGroup *render_group, World *world, Rectangle2i tiles, u32 *values, f32 x, f32 y) {
+  // Clear screen to magenta
+  push_clear(render_group, 1.0f, 0.0f, 1.0f);
+
+  i32 row_width = tiles.max_x - tiles.min_x;
+  for (int row = 0; row < tiles.max_y - tiles.min_y; ++row) {
+    for (int col = 0; col < row_width; ++col) {
+      u32 tile_id = values[row * row_width + col];
+      if (tile_id == TILE_VALUE_NO_TILE_MAP) {
+        continue;
+      }
+
+      f32 gray = 0.3f;
+      if (tile_id == 1) {
+        gray = 1.0f;
+      }
+
+      f32 min_x = x + (f32)col * world->tile_size_pixels;
+      f32 min_y = y + (f32)row * world->tile_size_pixels;
+      f32 max_x = min_x + world->tile_size_pixels;
+      f32 max_y = min_y + world->tile_size_pixels;
+      push_rectangle(render_group, RenderLayer_TileMap, min_x, min_y, max_x, max_y, gray, gray, gray);
+    }
+  }
+}
+
+// Makes sure the background cache holds every tile in visible_tiles,
+// re-rendering it (a margin bigger, on whole tiles) only when the view has
+// moved out of it or a tile it was built from has changed. Returns true when
+// it was re-rendered.
+static bool update_background_cache(
+  ThreadContext *thread_ctx,
+  GameMemory *memory,
+  TransientState *tran_state,
+  World *world,
+  Rectangle2i visible_tiles
 ) {
-  i32 x_min = f32_round_to_i32(min_x);
-  i32 y_min = f32_round_to_i32(min_y);
-  i32 x_max = f32_round_to_i32(max_x);
-  i32 y_max = f32_round_to_i32(max_y);
-
-  if (x_min < 0) { x_min = 0; }
-  if (y_min < 0) { y_min = 0; }
-  if (x_max > buffer->width) { x_max = buffer->width; }
-  if (y_max > buffer->height) { y_max = buffer->height; }
-  
-  u8 *end_of_buffer = (u8 *)buffer->memory + buffer->pitch * buffer->height;
-  u32 color = ((f32_round_to_u32(r * 255.0f) << 16) |
-               (f32_round_to_u32(g * 255.0f) << 8) |
-               (f32_round_to_u32(b * 255.0f) << 0));
-
-  // Advance the pointer to the top left of the rectangle we're about to draw
-  u8 *row=  (u8 *)buffer->memory + 
-      (x_min * buffer->bytes_per_pixel) + 
-      (y_min * buffer->pitch);
-
-  for(int y = y_min; y < y_max; ++y) {
-    u32 *pixel = (u32 *)row;
-
-    for(int x = x_min; x < x_max; ++x) {
-      *pixel++ = color; 
+  BackgroundCache *cache = &tran_state->background;
+  MemoryArena *arena = &tran_state->arena;
+
+  // The cache's memory has to outlive the frame, so it can't come from inside
+  // a temporary block
+  Assert(arena->temp_count == 0);
+
+  if (!cache->is_valid ||
+      (visible_tiles.min_x < cache->tiles.min_x) || (visible_tiles.max_x > cache->tiles.max_x) ||
+      (visible_tiles.min_y < cache->tiles.min_y) || (visible_tiles.max_y > cache->tiles.max_y))
+  {
+    cache->tiles.min_x = visible_tiles.min_x - BACKGROUND_CACHE_MARGIN_TILES;
+    cache->tiles.min_y = visible_tiles.min_y - BACKGROUND_CACHE_MARGIN_TILES;
+    cache->tiles.max_x = visible_tiles.max_x + BACKGROUND_CACHE_MARGIN_TILES;
+    cache->tiles.max_y = visible_tiles.max_y + BACKGROUND_CACHE_MARGIN_TILES;
+    cache->is_valid = false;
+  }
+
+  i32 width = (cache->tiles.max_x - cache->tiles.min_x) * world->tile_size_pixels;
+  i32 height = (cache->tiles.max_y - cache->tiles.min_y) * world->tile_size_pixels;
+
+  // Only ever grow. Resizes are rare and the transient arena is big, so the
+  // old blocks are simply abandoned.
+  if ((cache->bitmap.width != width) || (cache->bitmap.height != height)) {
+    cache->bitmap.width = width;
+    cache->bitmap.height = height;
+    cache->bitmap.bytes_per_pixel = 4;
+    cache->bitmap.pitch = Align(width * cache->bitmap.bytes_per_pixel, 64);
+
+    memory_index bitmap_size = (memory_index)cache->bitmap.pitch * height;
+    if (bitmap_size > cache->bitmap_capacity) {
+      cache->bitmap.memory = push_size_(arena, bitmap_size, 64);
+      cache->bitmap_capacity = bitmap_size;
     }
 
-    row += buffer->pitch;
+    cache->is_valid = false;
   }
+
+  i32 tile_count = (cache->tiles.max_x - cache->tiles.min_x) * (cache->tiles.max_y - cache->tiles.min_y);
+  memory_index tiles_size = tile_count * sizeof(u32);
+
+  if (tile_count > cache->tile_capacity) {
+    cache->tile_values = PushArray(arena, tile_count, u32);
+    cache->tile_capacity = tile_count;
+    cache->is_valid = false;
+  }
+
+  if (cache->is_valid) {
+    TemporaryMemory compare_memory = begin_temporary_memory(arena);
+    u32 *tile_values = PushArray(arena, tile_count, u32);
+    world_get_tile_values(world, cache->tiles, tile_values);
+    if (memcmp(cache->tile_values, tile_values, tiles_size) != 0) {
+      cache->is_valid = false;
+    }
+    end_temporary_memory(compare_memory);
+  }
+
+  bool rebuilt = false;
+
+  if (!cache->is_valid) {
+    world_get_tile_values(world, cache->tiles, cache->tile_values);
+
+    TemporaryMemory render_memory = begin_temporary_memory(arena);
+    RenderGroup *render_group = allocate_render_group(arena, Megabytes(1), 16384, width, height);
+    push_tiles(render_group, world, cache->tiles, cache->tile_values, 0.0f, 0.0f);
+    tiled_render_group_to_output(thread_ctx, memory, render_group, &cache->bitmap);
+    end_temporary_memory(render_memory);
+
+    cache->is_valid = true;
+    rebuilt = true;
+  }
+
+  return rebuilt;
 }
 
-// the declspec ensures this function is exported in the DLL
-extern "C" __declspec(dllexport) GAME_UPDATE_AND_RENDER(game_update_and_render) {
+// GAME_EXPORT ensures this function is exported in the DLL
+GAME_EXPORT GAME_UPDATE_AND_RENDER(game_update_and_render) {
+#if HANDMADE_INTERNAL
+  debug_global_memory = memory;
+#endif
+  BEGIN_TIMED_BLOCK(GameUpdateAndRender);
+
   GameState *game_state = (GameState *)memory->permanent_storage;
 
 
-#define TILE_MAP_COUNT_X 17
-#define TILE_MAP_COUNT_Y 9
+  if (!memory->is_initialized) {
+    initialize_arena(
+      &game_state->permanent_arena,
+      (memory_index)(memory->permanent_storage_size - sizeof(GameState)),
+      (u8 *)memory->permanent_storage + sizeof(GameState)
+    );
 
-  u32 tiles_00[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
-    { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 1, 1,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 1, 1, 0,  1,  0, 0, 1, 1,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  1,  0, 0, 0, 0,  0, 0, 0, 0 },
-    { 1, 1, 0, 0,  0, 0, 0, 0,  1,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 1, 1, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 1, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  1, 1, 1, 1 },
-    { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 }
-  };
+    game_state->player_bitmap = debug_load_bmp(thread_ctx, memory, &game_state->permanent_arena, "player.bmp");
 
-  u32 tiles_01[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
-    { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 0 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 }
-  };
+    game_state->world = initialize_world(&game_state->permanent_arena);
 
-  u32 tiles_10[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
-    { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 0, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 }
-  };
+    allocate_entity_store(&game_state->permanent_arena, &game_state->entities, MAX_ENTITY_COUNT);
+    game_state->mixer = allocate_audio_mixer(&game_state->permanent_arena);
 
-  u32 tiles_11[TILE_MAP_COUNT_Y][TILE_MAP_COUNT_X] = {
-    { 1, 1, 1, 1,  1, 1, 1, 1,  0,  1, 1, 1, 1,  1, 1, 1, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 0, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 0, 0, 0,  0, 0, 0, 0,  0,  0, 0, 0, 0,  0, 0, 0, 1 },
-    { 1, 1, 1, 1,  1, 1, 1, 1,  1,  1, 1, 1, 1,  1, 1, 1, 1 }
-  };
+    game_state->music = open_streaming_wav(thread_ctx, memory, &game_state->permanent_arena, "music.wav", true);
+    if (game_state->music) {
+      play_streaming_sound(game_state->mixer, game_state->music, 0.5f, 0.0f);
+    }
 
-  TileMap tile_maps[2][2];
-  tile_maps[0][0].tiles = (u32 *)tiles_00;
-  tile_maps[0][1].tiles = (u32 *)tiles_10;
-  tile_maps[1][0].tiles = (u32 *)tiles_01;
-  tile_maps[1][1].tiles = (u32 *)tiles_11;
-
-  World world;
-  world.tile_size_meters = 1.4f;
-  world.tile_size_pixels = 60;
-  world.count_x = TILE_MAP_COUNT_X;
-  world.count_y = TILE_MAP_COUNT_Y;
-  world.upper_left_x = -(f32)world.tile_size_pixels / 2.0f;
-  world.upper_left_y = 0;
-  world.tile_map_count_x = 2;
-  world.tile_map_count_y = 2;
-  world.tile_maps = (TileMap *)tile_maps;
-
-  f32 player_width  = (f32)world.tile_size_pixels * 0.75;
-  f32 player_height = (f32)world.tile_size_pixels;
-
-  TileMap *tile_map = world_get_tile_map(&world, game_state->player_tile_map_x, game_state->player_tile_map_y);
-  Assert(tile_map);
-  
-  if (!memory->is_initialized) {
-    game_state->player_x = 130.0f;
-    game_state->player_y = 130.0f;
+    // The player collides with a strip along its feet, as wide as it is drawn
+    // and a quarter tile deep
+    World *world = game_state->world;
+    i32 half_player_width = pixels_to_tile_offset(world, 0.5f * 0.75f * (f32)world->tile_size_pixels);
+    CollisionBox player_box = {-half_player_width, -TILE_OFFSET_ONE / 4, half_player_width, 0};
+    RawPosition player_start = {0, 0, 130.0f, 130.0f};
+    game_state->player = add_entity(&game_state->entities,
+      get_canonical_position(world, player_start), player_box, EntityFlag_Collides);
+    game_state->camera_p = get_canonical_position(world, player_start);
+#if HANDMADE_INTERNAL
+    game_state->debug_load_random_state = 0x2545F491;
+#endif
+
+#if defined(HANDMADE_DEBUG_ENTITY_COUNT)
+    add_debug_entities(&game_state->permanent_arena, world, &game_state->entities, HANDMADE_DEBUG_ENTITY_COUNT);
+#endif
 
     memory->is_initialized = true;
   }
 
-  for (int controller_idx = 0;
+  World *world = game_state->world;
+
+  if (game_state->music) {
+    if (memory->was_restored) {
+      restart_streaming_sound(memory, game_state->music);
+    } else {
+      update_streaming_sound(memory, game_state->music);
+    }
+  }
+#if HANDMADE_INTERNAL
+  if (memory->debug_load.voice_count || game_state->debug_voice_count) {
+    update_debug_voices(thread_ctx, memory, game_state, memory->debug_load.voice_count);
+  }
+  if (memory->debug_load.tone_count || game_state->debug_tone_count) {
+    update_debug_tones(game_state, memory->debug_load.tone_count, input->target_seconds_per_frame);
+  }
+  if ((memory->debug_load.test_tone_rate > 0.0f) || game_state->debug_test_tone_voice) {
+    update_debug_test_tone(game_state, memory->debug_load.test_tone_rate);
+  }
+#endif
+
+  f32 player_width  = (f32)world->tile_size_pixels * 0.75;
+  f32 player_height = (f32)world->tile_size_pixels;
+
+  TransientState *tran_state = (TransientState *)memory->transient_storage;
+  if (!tran_state->is_initialized) {
+    initialize_arena(
+      &tran_state->arena,
+      (memory_index)(memory->transient_storage_size - sizeof(TransientState)),
+      (u8 *)memory->transient_storage + sizeof(TransientState)
+    );
+
+    tran_state->is_initialized = true;
+  }
+
+  // The screen still shows the last frame drawn before the restore, not the
+  // one the restored dirty tracker and background cache remember, so this
+  // frame is drawn and presented whole
+  if (memory->was_restored) {
+    tran_state->dirty_tracker.has_last_frame = false;
+    tran_state->background.is_valid = false;
+    memory->was_restored = false;
+  }
+
+#if HANDMADE_INTERNAL
+  // Before the player's slot is looked up, removing entities moves others
+  // into the slots they leave
+  if (memory->debug_load.entity_churn_count) {
+    run_debug_entity_churn(game_state, memory->debug_load.entity_churn_count);
+  }
+#endif
+
+  EntityStore *entities = &game_state->entities;
+  u32 player_slot = get_entity_slot(entities, game_state->player);
+  Assert(player_slot != ENTITY_INVALID_SLOT);
+
+  // Every controller adds to how fast the player is going this frame
+  entities->velocity_x[player_slot] = 0.0f;
+  entities->velocity_y[player_slot] = 0.0f;
+
+  for (u32 controller_idx = 0;
       controller_idx < ArrayCount(input->controllers);
       ++controller_idx) 
   {
@@ -268,80 +631,142 @@ extern "C" __declspec(dllexport) GAME_UPDATE_AND_RENDER(game_update_and_render)
       player_x_delta *= 128.0f;
       player_y_delta *= 128.0f;
 
-      f32 new_player_x = game_state->player_x + input->target_seconds_per_frame * player_x_delta;
-      f32 new_player_y = game_state->player_y + input->target_seconds_per_frame * player_y_delta;
-
-      RawPosition player_pos = {
-        .tile_map_x = game_state->player_tile_map_x,
-        .tile_map_y = game_state->player_tile_map_y,
-        .x = new_player_x,
-        .y = new_player_y,
-      };
-
-      RawPosition player_left_pos = player_pos;
-      player_left_pos.x -= 0.5f * player_width;
-
-      RawPosition player_right_pos = player_pos;
-      player_right_pos.x += 0.5f * player_width;
-      
-      if (world_is_point_empty(&world, player_pos) &&
-          world_is_point_empty(&world, player_left_pos) &&
-          world_is_point_empty(&world, player_right_pos)
-      ) {
-        WorldPosition canonical_pos = get_canonical_position(&world, player_pos);
-        game_state->player_tile_map_x = canonical_pos.tile_map_x;
-        game_state->player_tile_map_y = canonical_pos.tile_map_y;
-
-        game_state->player_x = world.upper_left_x + world.tile_size_pixels * canonical_pos.tile_x + canonical_pos.x;
-        game_state->player_y = world.upper_left_y + world.tile_size_pixels * canonical_pos.tile_y + canonical_pos.y;
-      }
+      entities->velocity_x[player_slot] += player_x_delta;
+      entities->velocity_y[player_slot] += player_y_delta;
     }
   }
 
+  // Everything near the camera is simulated this frame. The camera hasn't
+  // moved yet, so it's where it was last frame.
+  MemoryArena *sim_arena = &tran_state->arena;
+  TemporaryMemory sim_memory = begin_temporary_memory(sim_arena);
+  f32 dt = input->target_seconds_per_frame;
+
+  Rectangle2i sim_bounds = get_visible_tiles(world, game_state->camera_p, buffer->width, buffer->height);
+  sim_bounds.min_x -= SIM_REGION_MARGIN_TILES;
+  sim_bounds.min_y -= SIM_REGION_MARGIN_TILES;
+  sim_bounds.max_x += SIM_REGION_MARGIN_TILES;
+  sim_bounds.max_y += SIM_REGION_MARGIN_TILES;
+#if HANDMADE_INTERNAL
+  if (memory->debug_load.simulate_everything) {
+    sim_bounds = {INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX};
+  }
+#endif
 
-  // Clear screen to magenta
-  draw_rectangle(buffer, 0.0f, 0.0f, (f32)buffer->width, (f32)buffer->height, 1.0f, 0.0f, 1.0f);
+  SimRegion *sim_region = begin_sim_region(sim_arena, entities, sim_bounds);
+  update_entities(world, &sim_region->entities, dt, sim_arena);
+
+  // Entity vs entity, through the broadphase so it isn't every pair
+  SpatialHash *spatial_hash = build_spatial_hash(sim_arena, &sim_region->entities);
+  u32 max_pair_count = 2 * sim_region->entities.count;
+  EntityPair *pairs = PushArray(sim_arena, max_pair_count, EntityPair);
+  u32 pair_count = spatial_hash_find_pairs(spatial_hash, pairs, max_pair_count);
+  if (pair_count > max_pair_count) {
+    // Crowded enough that some didn't fit, now it's known how many there are
+    max_pair_count = pair_count;
+    pairs = PushArray(sim_arena, max_pair_count, EntityPair);
+    pair_count = spatial_hash_find_pairs(spatial_hash, pairs, max_pair_count);
+  }
+  Assert(pair_count <= max_pair_count);
+  bounce_entity_pairs(&sim_region->entities, pairs, pair_count);
+  end_sim_region(sim_region, entities);
 
-  /* Draw tile map */
-  for (int row = 0; row < TILE_MAP_COUNT_Y; ++row) {
-    for (int col = 0; col < TILE_MAP_COUNT_X; ++col) {
-      u32 tile_id = tile_map_get_unchecked_tile_value(&world, tile_map, col, row);
-      f32 gray = 0.3f;
+#if HANDMADE_INTERNAL
+  if (memory->debug_load.spatial_query_count) {
+    run_debug_spatial_queries(game_state, sim_arena, memory->debug_load.spatial_query_count);
+  }
+  if (memory->debug_load.path_query_count) {
+    run_debug_path_queries(game_state, memory->debug_load.path_query_count);
+  }
+  if (memory->debug_load.flow_field_change_count) {
+    run_debug_flow_field_changes(game_state, sim_arena,
+      memory->debug_load.flow_field_change_count, memory->debug_load.check_flow_field_changes);
+  }
+#endif
 
-      if (tile_id == 1) {
-        gray = 1.0f;
-      }
+  end_temporary_memory(sim_memory);
 
-      f32 min_x = world.upper_left_x + (f32)col * world.tile_size_pixels;
-      f32 min_y = world.upper_left_y + (f32)row * world.tile_size_pixels;
-      f32 max_x = min_x + world.tile_size_pixels;
-      f32 max_y = min_y + world.tile_size_pixels;
-      draw_rectangle(buffer, min_x, min_y, max_x, max_y, gray, gray, gray);
-    }
+  WorldPosition player_p = get_entity_position(entities, player_slot);
+
+
+  /* Render */
+  // The camera sits on the player, anywhere in the world
+  game_state->camera_p = player_p;
+  WorldPosition camera_p = game_state->camera_p;
+
+  Rectangle2i visible_tiles = get_visible_tiles(world, camera_p, buffer->width, buffer->height);
+  bool background_changed = update_background_cache(thread_ctx, memory, tran_state, world, visible_tiles);
+
+  BackgroundCache *background = &tran_state->background;
+  WorldPosition background_p = {background->tiles.min_x, background->tiles.min_y, 0, 0};
+  f32 background_x, background_y;
+  get_screen_position(world, camera_p, buffer->width, buffer->height, background_p, &background_x, &background_y);
+
+  // Scrolling moves everything on screen, not just what's tracked
+  i32 background_blit_x = f32_round_to_i32(background_x);
+  i32 background_blit_y = f32_round_to_i32(background_y);
+  if ((background_blit_x != background->last_x) || (background_blit_y != background->last_y)) {
+    background_changed = true;
   }
+  background->last_x = background_blit_x;
+  background->last_y = background_blit_y;
+
+  TemporaryMemory render_memory = begin_temporary_memory(&tran_state->arena);
+  RenderGroup *render_group = allocate_render_group(
+    &tran_state->arena, Megabytes(4), 65536, buffer->width, buffer->height);
+
+  /* Draw tile map */
+  push_blit(render_group, RenderLayer_TileMap, &background->bitmap, background_blit_x, background_blit_y);
 
   /* Draw Player */
   f32 player_red = 1.0f;
   f32 player_green = 1.0f;
   f32 player_blue = 0.0f;
 
-  f32 player_left = game_state->player_x - 0.5f * player_width;
-  f32 player_top = game_state->player_y - player_height;
+  f32 player_x;
+  f32 player_y;
+  get_screen_position(world, camera_p, buffer->width, buffer->height, player_p, &player_x, &player_y);
+
+  f32 player_left = player_x - 0.5f * player_width;
+  f32 player_top = player_y - player_height;
+
+  if (game_state->player_bitmap) {
+    // Bottom center of the bitmap sits on the player's position
+    LoadedBitmap *bitmap = game_state->player_bitmap;
+    push_bitmap(render_group, RenderLayer_Entities, bitmap,
+      player_x - 0.5f * (f32)bitmap->width,
+      player_y - (f32)bitmap->height);
+  } else {
+    push_rectangle(render_group, RenderLayer_Entities,
+      player_left, player_top,
+      player_left + player_width, player_top + player_height,
+      player_red, player_green, player_blue
+    );
+  }
 
-  draw_rectangle(buffer,
-    player_left, player_top,
-    player_left + player_width, player_top + player_height,
-    player_red, player_green, player_blue
-  );
+  if (buffer->dirty_rects) {
+    render_group->background_changed = background_changed;
+    compute_dirty_rects(render_group, &tran_state->dirty_tracker, buffer->dirty_rects);
+  }
+
+  tiled_render_group_to_output(thread_ctx, memory, render_group, buffer);
+  end_temporary_memory(render_memory);
+
+  END_TIMED_BLOCK(GameUpdateAndRender);
 };
 
 
 // Gets sound samples from the game state which is initialized / allocatred in 
 // the Windows specific code.
-extern "C" __declspec(dllexport) GAME_GET_SOUND_SAMPLES(game_get_sound_samples)
+GAME_EXPORT GAME_GET_SOUND_SAMPLES(game_get_sound_samples)
 {
   GameState *game_state = (GameState *)game_memory->permanent_storage;
-  output_sound(thread_ctx, game_state, sound_buffer, 400);
+
+  if (game_memory->is_initialized) {
+    mix_voices(game_state->mixer, sound_buffer);
+  } else {
+    memset(sound_buffer->samples, 0, sound_buffer->sample_count * 2 * sizeof(i16));
+  }
 }
 
 // DEBUG
@@ -2,6 +2,7 @@
 #define HANDMADE_H
 
 // #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -47,6 +48,9 @@ typedef double f64;
 // Gets number of items in array
 #define ArrayCount(array) (sizeof(array) / sizeof((array)[0]))
 
+// Rounds value up to the next multiple of alignment. alignment must be a power of two.
+#define Align(value, alignment) (((value) + ((alignment) - 1)) & ~((alignment) - 1))
+
 // Assert macro for when compiling in "slow"
 // if HANDMADE_SLOW
 // #define Assert(Expression) if(!(Expression)) {*(int *)0 = 0;}
@@ -64,12 +68,56 @@ typedef double f64;
   Data Structures
 */
 
+typedef size_t memory_index;
+
+// Linear allocator over a block of game memory. Nothing is ever freed on its
+// own, instead the whole arena (or a temporary section of it) is popped at once.
+struct MemoryArena {
+  memory_index size;
+  u8 *base;
+  memory_index used;
+
+  u32 temp_count;
+};
+
+// Remembers how much of an arena was used so everything pushed afterwards can be
+// thrown away with end_temporary_memory.
+struct TemporaryMemory {
+  MemoryArena *arena;
+  memory_index used;
+};
+
+// Integer pixel rectangle covering [min_x, max_x) x [min_y, max_y)
+struct Rectangle2i {
+  i32 min_x;
+  i32 min_y;
+  i32 max_x;
+  i32 max_y;
+};
+
+#define MAX_DIRTY_RECT_COUNT 32
+
+// Filled in by the game every frame: which parts of the back buffer changed.
+// When is_full_frame is set everything did and rects should be ignored.
+struct DirtyRectList {
+  bool is_full_frame;
+  u32 count;
+  Rectangle2i rects[MAX_DIRTY_RECT_COUNT];
+};
+
+// memory is expected to start on a 64 byte boundary and pitch is padded up to a
+// multiple of 64 bytes, so every row begins on its own cache line.
 struct GameOffScreenBuffer {
 	void *memory;
 	int width;
 	int height;
 	int pitch;
   int bytes_per_pixel;
+
+  // Optional, supplied by the platform. When it's there the game only redraws
+  // what changed since the last frame and reports it here, so the contents of
+  // memory have to be left alone between frames.
+  DirtyRectList *dirty_rects;
 };
 
 struct GameSoundOutputBuffer {
@@ -122,69 +170,154 @@ struct GameInput {
   GameControllerInput controllers[5];
 };
 
-struct GameState {
-  f32 player_x;
-  f32 player_y;
+#include "handmade_render.h"
+#include "handmade_asset.h"
+#include "handmade_world.h"
+#include "handmade_entity.h"
+#include "handmade_spatial.h"
+#include "handmade_path.h"
+#include "handmade_sim_region.h"
+#include "handmade_synth.h"
+#include "handmade_audio.h"
 
-  i32 player_tile_map_x;
-  i32 player_tile_map_y;
-};
+// How many entities GameState::entities has room for
+#define MAX_ENTITY_COUNT (1 << 18)
 
-struct TileMap {
-  u32 *tiles;
-};
+// Lives at the start of GameMemory::permanent_storage
+struct GameState {
+  // Everything in permanent storage after the GameState
+  MemoryArena permanent_arena;
+
+  // Optional, 0 when the art isn't there and the player is drawn as a rectangle
+  LoadedBitmap *player_bitmap;
+
+  World *world;
+
+  EntityStore entities;
+  // Its position is the bottom center of the player
+  EntityHandle player;
+
+  // Lands on the center of the screen
+  WorldPosition camera_p;
+
+#if HANDMADE_INTERNAL
+  // xorshift32 state for picking what GameDebugLoad's work runs on
+  u32 debug_load_random_state;
+  // Made the first time GameDebugLoad asks for path queries
+  Pathfinder *debug_pathfinder;
+
+  // Voices GameDebugLoad has playing, of a sound made the first time
+  LoadedSound *debug_sound;
+  u32 debug_voice_count;
+  Voice *debug_voices[MAX_VOICE_COUNT];
+  // Oscillators GameDebugLoad has playing, and how far into their vibrato
+  u32 debug_tone_count;
+  Voice *debug_tones[MAX_VOICE_COUNT];
+  f32 debug_tone_seconds;
+  // The test tone GameDebugLoad plays through the resampler
+  LoadedSound *debug_test_tone;
+  Voice *debug_test_tone_voice;
+#endif
 
-struct WorldPosition {
-  // TODO: Pack tile map and tile indexes into single u32 x + y with hi-lo bits for each set of indexes
-  i32 tile_map_x;  
-  i32 tile_map_y;
-  i32 tile_x;
-  i32 tile_y;
+  AudioMixer *mixer;
 
-  // Tile relative x/y
-  f32 x;
-  f32 y;
+  // Streamed from music.wav when there is one
+  StreamingSound *music;
 };
 
-struct RawPosition {
-  i32 tile_map_x;  
-  i32 tile_map_y;
-
-  // tile-map relative x/y
-  f32 x;
-  f32 y;
+// Render group layers, drawn from lowest to highest
+enum RenderLayer {
+  RenderLayer_TileMap,
+  RenderLayer_Entities,
 };
 
-struct World {
-  f32 tile_size_meters;
-  i32 tile_size_pixels;
+/* Debug Specific */
+struct DebugFileReadResult {
+  u32 contents_size;
+  void *contents;
+};
 
-  i32 tile_map_count_x;
-  i32 tile_map_count_y;
 
-  i32 count_x;
-  i32 count_y;
-  
-  f32 upper_left_x;
-  f32 upper_left_y;
+/*
+  Debug cycle counters
 
-  TileMap *tile_maps;
+  Timed blocks accumulate cycles (and a hit count, which is whatever unit of work
+  makes sense for the block, eg: pixels filled) into GameMemory. The platform layer
+  prints and resets them once per frame.
+*/
+#if HANDMADE_INTERNAL
+#include <x86intrin.h> // __rdtsc
+
+enum {
+  DebugCycleCounter_GameUpdateAndRender,
+  DebugCycleCounter_FillRectangle,
+  DebugCycleCounter_RenderTiled,
+  DebugCycleCounter_RenderTile,
+  DebugCycleCounter_BlitRectangle,
+  DebugCycleCounter_DrawBitmapOpaque,
+  DebugCycleCounter_DrawBitmapBlended,
+  DebugCycleCounter_UpdateEntities,
+  DebugCycleCounter_SweepEntities,
+  DebugCycleCounter_BuildSpatialHash,
+  DebugCycleCounter_FindEntityPairs,
+  DebugCycleCounter_QuerySpatialHash,
+  DebugCycleCounter_FindPath,
+  DebugCycleCounter_BuildFlowField,
+  DebugCycleCounter_UpdateFlowFields,
+  DebugCycleCounter_BeginSimRegion,
+  DebugCycleCounter_EndSimRegion,
+  DebugCycleCounter_MixVoices,
+  DebugCycleCounter_Count
 };
 
-/* Debug Specific */
-struct DebugFileReadResult {
-  u32 contents_size;
-  void *contents;
+struct DebugCycleCounter {
+  u64 cycle_count;
+  u32 hit_count;
 };
 
+extern struct GameMemory *debug_global_memory;
+
+#define BEGIN_TIMED_BLOCK(id) u64 start_cycle_count_##id = __rdtsc();
+// Timed blocks can run on the worker threads, so the adds are atomic.
+#define END_TIMED_BLOCK_COUNTED(id, count) \
+  __atomic_fetch_add(&debug_global_memory->counters[DebugCycleCounter_##id].cycle_count, __rdtsc() - start_cycle_count_##id, __ATOMIC_RELAXED); \
+  __atomic_fetch_add(&debug_global_memory->counters[DebugCycleCounter_##id].hit_count, (u32)(count), __ATOMIC_RELAXED);
+#define END_TIMED_BLOCK(id) END_TIMED_BLOCK_COUNTED(id, 1)
+#else
+#define BEGIN_TIMED_BLOCK(id)
+#define END_TIMED_BLOCK_COUNTED(id, count)
+#define END_TIMED_BLOCK(id)
+#endif
+
 
 // Calling back into the platform layer will need this (free file memory, etc..)
 // Not every platform does a good job of returning what thread you're on.
 struct ThreadContext {
-  int placeholder;
+  // 0 is the main thread, worker threads are numbered from 1
+  u32 logical_thread_index;
 };
 
 
+/*
+  Work queue
+
+  The platform owns a pool of worker threads. The game adds entries to a queue and
+  then calls complete_all_work, which also puts the calling thread to work until
+  every entry that was added has finished. PlatformWorkQueue is defined by each
+  platform layer.
+*/
+struct PlatformWorkQueue;
+
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(ThreadContext *thread_ctx, void *data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+#define PLATFORM_ADD_ENTRY(name) void name(PlatformWorkQueue *queue, platform_work_queue_callback *callback, void *data)
+typedef PLATFORM_ADD_ENTRY(platform_add_entry);
+
+#define PLATFORM_COMPLETE_ALL_WORK(name) void name(PlatformWorkQueue *queue)
+typedef PLATFORM_COMPLETE_ALL_WORK(platform_complete_all_work);
+
+
 // How this works...
 // 1 - Define the macro and what it expands to.
 //     the (name) portion allows you to put a custom name that will expand when it is used in the definition.
@@ -202,6 +335,52 @@ typedef DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_platform_read_entire_file);
 #define DEBUG_PLATFORM_WRITE_ENTIRE_FILE(name) bool name(ThreadContext *thread_ctx, const char *file_name, u32 memory_size, void *memory)
 typedef DEBUG_PLATFORM_WRITE_ENTIRE_FILE(debug_platform_write_entire_file);
 
+// Reads up to size bytes from offset into dest and returns how many it read,
+// which is less than size past the end of the file and 0 if it can't be opened.
+// Safe to call from any thread.
+#define DEBUG_PLATFORM_READ_FILE_CHUNK(name) u32 name(ThreadContext *thread_ctx, const char *file_name, u64 offset, u32 size, void *dest)
+typedef DEBUG_PLATFORM_READ_FILE_CHUNK(debug_platform_read_file_chunk);
+
+#if HANDMADE_INTERNAL
+// Extra work the platform can ask the game for every frame, to load systems
+// nothing in the game leans on hard yet and time them with the cycle counters.
+// All zero normally. linux_headless_handmade fills it in from its options.
+struct GameDebugLoad {
+  // Pulls every entity into the sim region, not just the ones near the camera
+  bool simulate_everything;
+
+  // Random entities other than the player removed and added back at a random
+  // open tile of the starting rooms, which moves them between chunks
+  u32 entity_churn_count;
+
+  // Box and radius queries, two tiles each way around random entities, in a
+  // broadphase built over every entity rather than just the sim region's
+  u32 spatial_query_count;
+
+  // find_path queries between random open tiles of the starting rooms
+  u32 path_query_count;
+
+  // Random open tiles of the starting rooms turned solid and back again, each
+  // change passed on by the world to a cached flow field to the player's tile
+  u32 flow_field_change_count;
+  // Compares the field with a rebuild after every one of those changes
+  bool check_flow_field_changes;
+
+  // Looping voices of voice.wav, or of a sine when there isn't one, started or
+  // stopped to keep this many playing
+  u32 voice_count;
+
+  // Looping oscillators of every waveform, each with a vibrato that changes
+  // its frequency every frame, started or stopped to keep this many playing
+  u32 tone_count;
+
+  // Playback rate of a looping 8kHz sine recorded at 44.1kHz, so it always
+  // goes through the resampler, or 0 for none. Played at half volume in the
+  // middle, for the host to check what comes out against the sine it should be.
+  f32 test_tone_rate;
+};
+#endif
+
 struct GameMemory {
   u64 permanent_storage_size;
   u64 transient_storage_size;
@@ -216,12 +395,73 @@ struct GameMemory {
   debug_platform_free_file_memory *dbg_platform_free_file_memory;
   debug_platform_read_entire_file *dbg_platform_read_entire_file;
   debug_platform_write_entire_file *dbg_platform_write_entire_file;
+  debug_platform_read_file_chunk *dbg_platform_read_file_chunk;
+
+  // Queue serviced by every core. Work added to it has to be finished (with
+  // complete_all_work) before game_update_and_render returns.
+  PlatformWorkQueue *high_priority_queue;
+  u32 worker_thread_count;
+
+  // Queue with a worker of its own for slow things like file reads. Nothing
+  // waits on it, entries finish whenever they finish, so whatever they write
+  // has to be published with an atomic the game checks.
+  PlatformWorkQueue *low_priority_queue;
+  platform_add_entry *add_entry;
+  platform_complete_all_work *complete_all_work;
 
   bool is_initialized;
+
+  // Set by the platform when it has just copied game memory back from a
+  // snapshot (looped input playback), cleared by the game once it's dealt
+  // with it. Nothing outside game memory, like what's on screen, went back
+  // with it.
+  bool was_restored;
+
+#if HANDMADE_INTERNAL
+  GameDebugLoad debug_load;
+  DebugCycleCounter counters[DebugCycleCounter_Count];
+#endif
 };
 
 
 
+// Tiles drawn beyond the edge of the screen on every side when the background
+// is re-rendered, so the camera can scroll a little before it has to be again
+#define BACKGROUND_CACHE_MARGIN_TILES 2
+
+// The tiles around the view pre-rendered into their own buffer. Each frame it
+// is copied to the back buffer in one go instead of drawing every tile. It's
+// re-rendered when the view scrolls past its margin or any tile value in it
+// changes.
+struct BackgroundCache {
+  GameOffScreenBuffer bitmap;
+  memory_index bitmap_capacity;
+
+  // Absolute tiles it holds, max exclusive. The bitmap's top left corner is
+  // the top left corner of tile (min_x, min_y).
+  bool is_valid;
+  Rectangle2i tiles;
+
+  // Copy of the tile values it was rendered from, row by row
+  u32 *tile_values;
+  i32 tile_capacity;
+
+  // Where its top left corner went on screen last frame
+  i32 last_x;
+  i32 last_y;
+};
+
+// Lives at the start of GameMemory::transient_storage. Everything in here can be
+// thrown away and rebuilt at any time.
+struct TransientState {
+  bool is_initialized;
+  MemoryArena arena;
+
+  BackgroundCache background;
+  DirtyTracker dirty_tracker;
+};
+
+
 /*
   Functions
 */
@@ -233,11 +473,51 @@ struct GameMemory {
 // Gets the controller from the GameInput and asserts the controller index
 // is in bounds
 inline GameControllerInput *get_controller(GameInput *game_input, int controller_idx) {
-  Assert(controller_idx < ArrayCount(game_input->controllers));
+  Assert((u32)controller_idx < ArrayCount(game_input->controllers));
   GameControllerInput *controller = &game_input->controllers[controller_idx];
   return controller;
 }
 
+inline void initialize_arena(MemoryArena *arena, memory_index size, void *base) {
+  arena->size = size;
+  arena->base = (u8 *)base;
+  arena->used = 0;
+  arena->temp_count = 0;
+}
+
+#define PushStruct(arena, type) (type *)push_size_(arena, sizeof(type))
+#define PushArray(arena, count, type) (type *)push_size_(arena, (count) * sizeof(type))
+#define PushSize(arena, size) push_size_(arena, size)
+
+// alignment must be a power of two
+inline void *push_size_(MemoryArena *arena, memory_index size, memory_index alignment = 4) {
+  memory_index result_pointer = (memory_index)arena->base + arena->used;
+  memory_index alignment_offset = Align(result_pointer, alignment) - result_pointer;
+
+  Assert((arena->used + alignment_offset + size) <= arena->size);
+  void *result = arena->base + arena->used + alignment_offset;
+  arena->used += alignment_offset + size;
+
+  return result;
+}
+
+inline TemporaryMemory begin_temporary_memory(MemoryArena *arena) {
+  TemporaryMemory result;
+  result.arena = arena;
+  result.used = arena->used;
+  ++arena->temp_count;
+
+  return result;
+}
+
+inline void end_temporary_memory(TemporaryMemory temp_memory) {
+  MemoryArena *arena = temp_memory.arena;
+  Assert(arena->used >= temp_memory.used);
+  Assert(arena->temp_count > 0);
+  arena->used = temp_memory.used;
+  --arena->temp_count;
+}
+
 inline u32 u64_safe_truncate_to_u32(u64 value) {
   Assert(value <= 0xFFFFFFFF);
   u32 result = (u32)value;
@@ -248,6 +528,13 @@ inline u32 u64_safe_truncate_to_u32(u64 value) {
   Function stubs
 */
 
+// Marks the functions the platform looks up in the game's shared library
+#if defined(_WIN32)
+#define GAME_EXPORT extern "C" __declspec(dllexport)
+#else
+#define GAME_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
 
 
 #define GAME_UPDATE_AND_RENDER(name) void name(ThreadContext *thread_ctx, GameMemory *memory, GameInput *input,GameOffScreenBuffer *buffer)
@@ -0,0 +1,300 @@
+/*
+  Asset loading
+
+  These go through the debug file api for now, so they read the whole file into
+  memory, convert it into arena and hand the file memory straight back.
+*/
+
+inline u32 premultiply_alpha(u32 red, u32 green, u32 blue, u32 alpha) {
+  u32 result = ((alpha << 24) |
+                (div_255(red * alpha) << 16) |
+                (div_255(green * alpha) << 8) |
+                (div_255(blue * alpha) << 0));
+  return result;
+}
+
+inline u32 extract_masked_channel(u32 pixel, u32 mask, BitScanResult shift) {
+  u32 result = 0;
+
+  if (shift.found) {
+    result = (pixel & mask) >> shift.index;
+  }
+
+  return result;
+}
+
+// Marks the bitmap opaque when every pixel has full alpha
+static void update_bitmap_opacity(LoadedBitmap *bitmap) {
+  bitmap->is_opaque = true;
+  u8 *row = (u8 *)bitmap->memory;
+
+  for (i32 y = 0; (y < bitmap->height) && bitmap->is_opaque; ++y) {
+    u32 *pixel = (u32 *)row;
+
+    for (i32 x = 0; x < bitmap->width; ++x) {
+      if ((*pixel++ >> 24) != 0xFF) {
+        bitmap->is_opaque = false;
+        break;
+      }
+    }
+
+    row += bitmap->pitch;
+  }
+}
+
+static LoadedBitmap *allocate_loaded_bitmap(MemoryArena *arena, i32 width, i32 height) {
+  LoadedBitmap *bitmap = PushStruct(arena, LoadedBitmap);
+  bitmap->width = width;
+  bitmap->height = height;
+  bitmap->pitch = Align(width * (i32)sizeof(u32), 16);
+  bitmap->memory = push_size_(arena, (memory_index)bitmap->pitch * height, 16);
+  bitmap->is_opaque = true;
+
+  return bitmap;
+}
+
+// Loads an uncompressed 24 or 32 bit BMP. Returns 0 if the file can't be read or
+// isn't a kind of BMP handled here.
+static LoadedBitmap *debug_load_bmp(ThreadContext *thread_ctx, GameMemory *memory, MemoryArena *arena, const char *file_name) {
+  LoadedBitmap *result = 0;
+  DebugFileReadResult read_result = memory->dbg_platform_read_entire_file(thread_ctx, file_name);
+
+  if (!read_result.contents) {
+    return result;
+  }
+
+  BitmapHeader *header = (BitmapHeader *)read_result.contents;
+  bool is_valid = (read_result.contents_size >= BITMAP_BASE_HEADER_SIZE) &&
+                  (header->file_type == BITMAP_FILE_TYPE) &&
+                  (header->planes == 1) &&
+                  ((header->bits_per_pixel == 24) || (header->bits_per_pixel == 32)) &&
+                  (header->width > 0) && (header->width <= BITMAP_MAX_DIMENSION) &&
+                  (header->height >= -BITMAP_MAX_DIMENSION) && (header->height <= BITMAP_MAX_DIMENSION) &&
+                  (header->height != 0);
+
+  // Default masks are the BI_RGB layout, BGR(A) in memory
+  u32 red_mask = 0x00FF0000;
+  u32 green_mask = 0x0000FF00;
+  u32 blue_mask = 0x000000FF;
+  u32 alpha_mask = 0;
+
+  i32 width = 0;
+  i32 height = 0;
+  bool is_bottom_up = false;
+  u32 bytes_per_pixel = 0;
+  u64 source_pitch = 0;
+
+  // Nothing past the file type is read until the header is known to be there
+  if (is_valid) {
+    alpha_mask = (header->bits_per_pixel == 32) ? 0xFF000000 : 0;
+
+    if (header->compression == BITMAP_COMPRESSION_BITFIELDS) {
+      is_valid = (header->bits_per_pixel == 32) &&
+                 (read_result.contents_size >= BITMAP_BASE_HEADER_SIZE + 3 * sizeof(u32));
+
+      if (is_valid) {
+        red_mask = header->red_mask;
+        green_mask = header->green_mask;
+        blue_mask = header->blue_mask;
+        alpha_mask = 0;
+
+        if ((header->info_header_size >= 56) &&
+            (read_result.contents_size >= BITMAP_BASE_HEADER_SIZE + 4 * sizeof(u32))) {
+          alpha_mask = header->alpha_mask;
+        }
+      }
+    } else if (header->compression != BITMAP_COMPRESSION_RGB) {
+      is_valid = false;
+    }
+  }
+
+  if (is_valid) {
+    width = header->width;
+    height = (header->height < 0) ? -header->height : header->height;
+    is_bottom_up = header->height > 0;
+    bytes_per_pixel = header->bits_per_pixel / 8;
+    source_pitch = Align((u64)width * bytes_per_pixel, 4);
+
+    u64 pixels_end = (u64)header->bitmap_offset + source_pitch * (u64)height;
+    is_valid = pixels_end <= read_result.contents_size;
+  }
+
+  if (is_valid) {
+    BitScanResult red_shift = find_least_significant_set_bit(red_mask);
+    BitScanResult green_shift = find_least_significant_set_bit(green_mask);
+    BitScanResult blue_shift = find_least_significant_set_bit(blue_mask);
+    BitScanResult alpha_shift = find_least_significant_set_bit(alpha_mask);
+
+    u8 *pixels = (u8 *)read_result.contents + header->bitmap_offset;
+
+    // Lots of 32 bit files leave the alpha channel at zero everywhere. Those are
+    // meant to be opaque, not invisible.
+    if (alpha_shift.found) {
+      bool any_alpha = false;
+
+      for (i32 y = 0; (y < height) && !any_alpha; ++y) {
+        u8 *source = pixels + (u64)y * source_pitch;
+
+        for (i32 x = 0; x < width; ++x) {
+          u32 pixel = source[0] | (source[1] << 8) | (source[2] << 16) | ((u32)source[3] << 24);
+          source += bytes_per_pixel;
+
+          if (pixel & alpha_mask) {
+            any_alpha = true;
+            break;
+          }
+        }
+      }
+
+      alpha_shift.found = any_alpha;
+    }
+
+    result = allocate_loaded_bitmap(arena, width, height);
+    u8 *dest_row = (u8 *)result->memory;
+
+    for (i32 y = 0; y < height; ++y) {
+      i32 source_y = is_bottom_up ? (height - 1 - y) : y;
+      u8 *source = pixels + (u64)source_y * source_pitch;
+      u32 *dest = (u32 *)dest_row;
+
+      for (i32 x = 0; x < width; ++x) {
+        u32 pixel = source[0] | (source[1] << 8) | (source[2] << 16);
+        if (bytes_per_pixel == 4) {
+          pixel |= (u32)source[3] << 24;
+        }
+        source += bytes_per_pixel;
+
+        u32 alpha = alpha_shift.found ? extract_masked_channel(pixel, alpha_mask, alpha_shift) : 255;
+
+        *dest++ = premultiply_alpha(
+          extract_masked_channel(pixel, red_mask, red_shift),
+          extract_masked_channel(pixel, green_mask, green_shift),
+          extract_masked_channel(pixel, blue_mask, blue_shift),
+          alpha
+        );
+      }
+
+      dest_row += result->pitch;
+    }
+  }
+
+  memory->dbg_platform_free_file_memory(thread_ctx, read_result.contents);
+
+  if (result) {
+    update_bitmap_opacity(result);
+  }
+
+  return result;
+}
+
+// Finds the format and samples of 16 bit PCM WAV, mono or stereo, in the first
+// contents_size bytes of a file. Only the headers have to be there, the samples
+// can run past contents_size (see open_streaming_wav). Returns false for
+// anything else.
+static bool parse_wav(void *contents, u32 contents_size, WavInfo *info) {
+  if (contents_size < sizeof(WaveHeader)) {
+    return false;
+  }
+
+  WaveHeader *header = (WaveHeader *)contents;
+  if ((header->riff_id != WAVE_CHUNK_ID_RIFF) || (header->wave_id != WAVE_CHUNK_ID_WAVE)) {
+    return false;
+  }
+
+  bool found_format = false;
+  bool is_valid = false;
+  u32 chunk_offset = sizeof(WaveHeader);
+
+  while (chunk_offset + sizeof(WaveChunk) <= contents_size) {
+    WaveChunk *chunk = (WaveChunk *)((u8 *)contents + chunk_offset);
+    u32 chunk_data_offset = chunk_offset + sizeof(WaveChunk);
+
+    if (chunk->id == WAVE_CHUNK_ID_FMT) {
+      if ((chunk->size < WAVE_BASE_FORMAT_SIZE) || (chunk_data_offset + WAVE_BASE_FORMAT_SIZE > contents_size)) {
+        break;
+      }
+
+      WaveFormat *format = (WaveFormat *)((u8 *)contents + chunk_data_offset);
+      u16 format_tag = format->format_tag;
+      if ((format_tag == WAVE_FORMAT_EXTENSIBLE) && (chunk->size >= sizeof(WaveFormat)) &&
+          (chunk_data_offset + sizeof(WaveFormat) <= contents_size)) {
+        format_tag = (u16)(format->sub_format[0] | (format->sub_format[1] << 8));
+      }
+
+      if ((format_tag != WAVE_FORMAT_PCM) || (format->bits_per_sample != 16) ||
+          ((format->channel_count != 1) && (format->channel_count != 2)) ||
+          (format->block_align != format->channel_count * sizeof(i16)) ||
+          (format->samples_per_second == 0)) {
+        break;
+      }
+
+      info->channel_count = format->channel_count;
+      info->samples_per_second = format->samples_per_second;
+      found_format = true;
+    } else if (chunk->id == WAVE_CHUNK_ID_DATA) {
+      // "fmt " has to come first, there's no way to know what the samples are
+      // otherwise
+      if (found_format) {
+        info->sample_count = chunk->size / (info->channel_count * sizeof(i16));
+        info->data_offset = chunk_data_offset;
+        is_valid = true;
+      }
+      break;
+    }
+
+    chunk_offset = chunk_data_offset + Align(chunk->size, 2);
+    if (chunk_offset < chunk_data_offset) {
+      break; // Size wrapped around
+    }
+  }
+
+  return is_valid;
+}
+
+// Splits count interleaved frames of channel_count samples into left and right.
+// Mono only goes to left.
+static void deinterleave_wav_samples(i16 *source, u32 channel_count, u32 count, i16 *left, i16 *right) {
+  if (channel_count == 1) {
+    memcpy(left, source, count * sizeof(i16));
+  } else {
+    for (u32 idx = 0; idx < count; ++idx) {
+      left[idx] = source[0];
+      right[idx] = source[1];
+      source += 2;
+    }
+  }
+}
+
+// Loads all of a 16 bit PCM WAV, for sound effects and anything else short
+// enough to keep in memory. Long music is streamed instead, see
+// open_streaming_wav. Returns 0 if the file can't be read or isn't a kind of
+// WAV handled here.
+inline LoadedSound *debug_load_wav(ThreadContext *thread_ctx, GameMemory *memory, MemoryArena *arena, const char *file_name) {
+  LoadedSound *result = 0;
+  DebugFileReadResult read_result = memory->dbg_platform_read_entire_file(thread_ctx, file_name);
+
+  if (!read_result.contents) {
+    return result;
+  }
+
+  WavInfo info = {};
+  if (parse_wav(read_result.contents, read_result.contents_size, &info)) {
+    // Files cut short still play what they have
+    u32 available_count = (read_result.contents_size - info.data_offset) / (info.channel_count * sizeof(i16));
+    u32 sample_count = (info.sample_count < available_count) ? info.sample_count : available_count;
+
+    result = PushStruct(arena, LoadedSound);
+    result->sample_count = sample_count;
+    result->channel_count = info.channel_count;
+    result->samples_per_second = info.samples_per_second;
+    result->samples[0] = PushArray(arena, sample_count, i16);
+    result->samples[1] = (info.channel_count == 2) ? PushArray(arena, sample_count, i16) : 0;
+
+    deinterleave_wav_samples((i16 *)((u8 *)read_result.contents + info.data_offset), info.channel_count,
+      sample_count, result->samples[0], result->samples[1]);
+  }
+
+  memory->dbg_platform_free_file_memory(thread_ctx, read_result.contents);
+
+  return result;
+}
@@ -0,0 +1,102 @@
+#if !defined(HANDMADE_ASSET_H)
+#define HANDMADE_ASSET_H
+
+/*
+  File formats
+*/
+
+#pragma pack(push, 1)
+// BITMAPFILEHEADER followed by a BITMAPINFOHEADER. The color masks are only
+// there for BI_BITFIELDS files and alpha_mask only for V3 headers and up
+// (info_header_size >= 56).
+struct BitmapHeader {
+  u16 file_type;
+  u32 file_size;
+  u16 reserved_1;
+  u16 reserved_2;
+  u32 bitmap_offset;
+
+  u32 info_header_size;
+  i32 width;
+  i32 height;
+  u16 planes;
+  u16 bits_per_pixel;
+  u32 compression;
+  u32 size_of_bitmap;
+  i32 horz_resolution;
+  i32 vert_resolution;
+  u32 colors_used;
+  u32 colors_important;
+
+  u32 red_mask;
+  u32 green_mask;
+  u32 blue_mask;
+  u32 alpha_mask;
+};
+#pragma pack(pop)
+
+#define BITMAP_FILE_TYPE 0x4D42 // "BM"
+#define BITMAP_COMPRESSION_RGB 0
+#define BITMAP_COMPRESSION_BITFIELDS 3
+
+// Size of the headers without any of the masks
+#define BITMAP_BASE_HEADER_SIZE 54
+
+// Widest or tallest BMP that's loaded. Keeps the pitch and size math well
+// inside 32 bits and anything bigger wouldn't fit in the arena anyway.
+#define BITMAP_MAX_DIMENSION 16384
+
+#define RIFF_CODE(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#define WAVE_CHUNK_ID_RIFF RIFF_CODE('R', 'I', 'F', 'F')
+#define WAVE_CHUNK_ID_WAVE RIFF_CODE('W', 'A', 'V', 'E')
+#define WAVE_CHUNK_ID_FMT RIFF_CODE('f', 'm', 't', ' ')
+#define WAVE_CHUNK_ID_DATA RIFF_CODE('d', 'a', 't', 'a')
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+#pragma pack(push, 1)
+// A WAV file is this, then chunks one after the other, each a WaveChunk
+// followed by size bytes and a pad byte when size is odd
+struct WaveHeader {
+  u32 riff_id;
+  u32 size;
+  u32 wave_id;
+};
+
+struct WaveChunk {
+  u32 id;
+  u32 size;
+};
+
+// The "fmt " chunk. Everything from extension_size on is only there for
+// WAVE_FORMAT_EXTENSIBLE, where the first two bytes of sub_format hold the
+// real format tag.
+struct WaveFormat {
+  u16 format_tag;
+  u16 channel_count;
+  u32 samples_per_second;
+  u32 average_bytes_per_second;
+  u16 block_align;
+  u16 bits_per_sample;
+
+  u16 extension_size;
+  u16 valid_bits_per_sample;
+  u32 channel_mask;
+  u8 sub_format[16];
+};
+#pragma pack(pop)
+
+// Size of the "fmt " chunk without the extension
+#define WAVE_BASE_FORMAT_SIZE 16
+
+// What parse_wav found out about a WAV file's samples
+struct WavInfo {
+  u32 channel_count;
+  u32 samples_per_second;
+  u32 sample_count;  // Per channel
+  u32 data_offset;   // Of the first sample, from the start of the file
+};
+
+#endif
@@ -0,0 +1,954 @@
+#include <immintrin.h>
+
+/*
+  Mix kernels
+
+  Each one adds count samples of one voice, times its gains, to the bus. The
+  sources are 16 bit, so the wide kernels widen 4 or 8 samples at a time to
+  floats on the way in. The multiply and the add are kept separate (no fused
+  multiply add) so every kernel produces exactly the same bus.
+*/
+#define MIX_SAMPLES(name) void name( \
+    f32 *bus_left, f32 *bus_right, i16 *source_left, i16 *source_right, \
+    u32 count, f32 gain_left, f32 gain_right)
+typedef MIX_SAMPLES(MixSamples);
+
+// Converts count samples of the bus to interleaved, saturated 16 bit samples
+#define CONVERT_MIX_BUS(name) void name(i16 *dest, f32 *bus_left, f32 *bus_right, u32 count)
+typedef CONVERT_MIX_BUS(ConvertMixBus);
+
+// mix_samples through a ResampleBank. Output sample i is filtered at
+// position + i * step (32.32, in source samples), where the filter's first
+// tap for an integer part n is source[n]. The dot products are summed in 8
+// lanes, added up the same way by every kernel.
+#define RESAMPLE_SAMPLES(name) void name( \
+    f32 *bus_left, f32 *bus_right, i16 *source_left, i16 *source_right, \
+    u32 count, u64 position, u64 step, ResampleBank *bank, f32 gain_left, f32 gain_right)
+typedef RESAMPLE_SAMPLES(ResampleSamples);
+
+struct MixKernels {
+  MixSamples *mix;
+  ConvertMixBus *convert;
+  ResampleSamples *resample;
+};
+
+// Picked on first use, same as the render kernels
+global_variable MixKernels global_mix_kernels;
+
+static MIX_SAMPLES(mix_samples_scalar) {
+  for (u32 idx = 0; idx < count; ++idx) {
+    bus_left[idx] += (f32)source_left[idx] * gain_left;
+    bus_right[idx] += (f32)source_right[idx] * gain_right;
+  }
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+// 4 samples sign extended to floats
+inline __m128 load_i16_4x_sse2(i16 *source) {
+  __m128i samples = _mm_loadl_epi64((__m128i *)source);
+  __m128 result = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16));
+  return result;
+}
+
+static MIX_SAMPLES(mix_samples_sse2) {
+  __m128 gain_left_4x = _mm_set1_ps(gain_left);
+  __m128 gain_right_4x = _mm_set1_ps(gain_right);
+
+  u32 idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    __m128 left = _mm_mul_ps(load_i16_4x_sse2(source_left + idx), gain_left_4x);
+    __m128 right = _mm_mul_ps(load_i16_4x_sse2(source_right + idx), gain_right_4x);
+    _mm_storeu_ps(bus_left + idx, _mm_add_ps(_mm_loadu_ps(bus_left + idx), left));
+    _mm_storeu_ps(bus_right + idx, _mm_add_ps(_mm_loadu_ps(bus_right + idx), right));
+  }
+
+  mix_samples_scalar(bus_left + idx, bus_right + idx, source_left + idx, source_right + idx,
+    count - idx, gain_left, gain_right);
+}
+
+__attribute__((target("avx2")))
+static MIX_SAMPLES(mix_samples_avx2) {
+  __m256 gain_left_8x = _mm256_set1_ps(gain_left);
+  __m256 gain_right_8x = _mm256_set1_ps(gain_right);
+
+  u32 idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    __m256 left = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(source_left + idx))));
+    __m256 right = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(source_right + idx))));
+    left = _mm256_mul_ps(left, gain_left_8x);
+    right = _mm256_mul_ps(right, gain_right_8x);
+    _mm256_storeu_ps(bus_left + idx, _mm256_add_ps(_mm256_loadu_ps(bus_left + idx), left));
+    _mm256_storeu_ps(bus_right + idx, _mm256_add_ps(_mm256_loadu_ps(bus_right + idx), right));
+  }
+
+  // Finished here rather than in the sse2 kernel, going from 256 bit code to
+  // legacy SSE code with the upper halves dirty costs more than the tail
+  for (; idx < count; ++idx) {
+    bus_left[idx] += (f32)source_left[idx] * gain_left;
+    bus_right[idx] += (f32)source_right[idx] * gain_right;
+  }
+}
+#endif
+
+// Rounds to nearest even like the wide kernels do
+static CONVERT_MIX_BUS(convert_mix_bus_scalar) {
+  for (u32 idx = 0; idx < count; ++idx) {
+    f32 left = (bus_left[idx] < -32768.0f) ? -32768.0f : (bus_left[idx] > 32767.0f) ? 32767.0f : bus_left[idx];
+    f32 right = (bus_right[idx] < -32768.0f) ? -32768.0f : (bus_right[idx] > 32767.0f) ? 32767.0f : bus_right[idx];
+    *dest++ = (i16)_mm_cvtss_si32(_mm_set_ss(left));
+    *dest++ = (i16)_mm_cvtss_si32(_mm_set_ss(right));
+  }
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+static CONVERT_MIX_BUS(convert_mix_bus_sse2) {
+  // Clamped first, an out of range float converts to INT32_MIN
+  __m128 min = _mm_set1_ps(-32768.0f);
+  __m128 max = _mm_set1_ps(32767.0f);
+
+  u32 idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    __m128i left = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(bus_left + idx), min), max));
+    __m128i right = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(bus_right + idx), min), max));
+
+    // L0 R0 L1 R1 and L2 R2 L3 R3, packed down to 16 bits
+    __m128i interleaved = _mm_packs_epi32(_mm_unpacklo_epi32(left, right), _mm_unpackhi_epi32(left, right));
+    _mm_storeu_si128((__m128i *)dest, interleaved);
+    dest += 8;
+  }
+
+  convert_mix_bus_scalar(dest, bus_left + idx, bus_right + idx, count - idx);
+}
+#endif
+
+// The order the wide kernels add up their 8 lanes in: halves, then quarters,
+// then the last two
+inline f32 sum_resample_lanes(f32 *lanes) {
+  f32 half_0 = lanes[0] + lanes[4];
+  f32 half_1 = lanes[1] + lanes[5];
+  f32 half_2 = lanes[2] + lanes[6];
+  f32 half_3 = lanes[3] + lanes[7];
+
+  f32 result = (half_0 + half_2) + (half_1 + half_3);
+  return result;
+}
+
+#if defined(HANDMADE_FORCE_SCALAR_FILL)
+static RESAMPLE_SAMPLES(resample_samples_scalar) {
+  u32 tap_count = bank->tap_count;
+
+  for (u32 idx = 0; idx < count; ++idx) {
+    u32 fraction = (u32)position;
+    f32 *phase = bank->coefficients + (fraction >> (32 - RESAMPLE_PHASE_BITS)) * tap_count;
+    f32 *next_phase = phase + tap_count;
+    f32 t = (f32)((fraction >> RESAMPLE_FRACTION_SHIFT) & 0xFFFF) * (1.0f / 65536.0f);
+
+    i16 *left = source_left + (position >> 32);
+    i16 *right = source_right + (position >> 32);
+
+    f32 lanes_left[8] = {};
+    f32 lanes_right[8] = {};
+    for (u32 tap = 0; tap < tap_count; ++tap) {
+      f32 coefficient = phase[tap] + (next_phase[tap] - phase[tap]) * t;
+      lanes_left[tap & 7] += coefficient * (f32)left[tap];
+      lanes_right[tap & 7] += coefficient * (f32)right[tap];
+    }
+
+    bus_left[idx] += sum_resample_lanes(lanes_left) * gain_left;
+    bus_right[idx] += sum_resample_lanes(lanes_right) * gain_right;
+    position += step;
+  }
+}
+#endif
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+// Adds the 4 lanes of low and high together, lane 0 and 4 first to match
+// sum_resample_lanes
+inline f32 sum_resample_lanes_sse2(__m128 low, __m128 high) {
+  __m128 halves = _mm_add_ps(low, high);
+  __m128 quarters = _mm_add_ps(halves, _mm_movehl_ps(halves, halves));
+  f32 result = _mm_cvtss_f32(_mm_add_ss(quarters, _mm_shuffle_ps(quarters, quarters, 1)));
+  return result;
+}
+
+static RESAMPLE_SAMPLES(resample_samples_sse2) {
+  u32 tap_count = bank->tap_count;
+  __m128 fraction_scale = _mm_set1_ps(1.0f / 65536.0f);
+
+  for (u32 idx = 0; idx < count; ++idx) {
+    u32 fraction = (u32)position;
+    f32 *phase = bank->coefficients + (fraction >> (32 - RESAMPLE_PHASE_BITS)) * tap_count;
+    f32 *next_phase = phase + tap_count;
+    __m128 t = _mm_mul_ps(_mm_set1_ps((f32)((fraction >> RESAMPLE_FRACTION_SHIFT) & 0xFFFF)), fraction_scale);
+
+    i16 *left = source_left + (position >> 32);
+    i16 *right = source_right + (position >> 32);
+
+    __m128 left_low = _mm_setzero_ps();
+    __m128 left_high = _mm_setzero_ps();
+    __m128 right_low = _mm_setzero_ps();
+    __m128 right_high = _mm_setzero_ps();
+
+    for (u32 tap = 0; tap < tap_count; tap += 8) {
+      __m128 phase_low = _mm_loadu_ps(phase + tap);
+      __m128 phase_high = _mm_loadu_ps(phase + tap + 4);
+      __m128 coefficient_low = _mm_add_ps(phase_low, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(next_phase + tap), phase_low), t));
+      __m128 coefficient_high = _mm_add_ps(phase_high, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(next_phase + tap + 4), phase_high), t));
+
+      // 8 samples, sign extended to two sets of 4 floats
+      __m128i left_samples = _mm_loadu_si128((__m128i *)(left + tap));
+      __m128i right_samples = _mm_loadu_si128((__m128i *)(right + tap));
+      __m128 left_samples_low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(left_samples, left_samples), 16));
+      __m128 left_samples_high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(left_samples, left_samples), 16));
+      __m128 right_samples_low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(right_samples, right_samples), 16));
+      __m128 right_samples_high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(right_samples, right_samples), 16));
+
+      left_low = _mm_add_ps(left_low, _mm_mul_ps(coefficient_low, left_samples_low));
+      left_high = _mm_add_ps(left_high, _mm_mul_ps(coefficient_high, left_samples_high));
+      right_low = _mm_add_ps(right_low, _mm_mul_ps(coefficient_low, right_samples_low));
+      right_high = _mm_add_ps(right_high, _mm_mul_ps(coefficient_high, right_samples_high));
+    }
+
+    bus_left[idx] += sum_resample_lanes_sse2(left_low, left_high) * gain_left;
+    bus_right[idx] += sum_resample_lanes_sse2(right_low, right_high) * gain_right;
+    position += step;
+  }
+}
+
+__attribute__((target("avx2")))
+static RESAMPLE_SAMPLES(resample_samples_avx2) {
+  u32 tap_count = bank->tap_count;
+  __m256 fraction_scale = _mm256_set1_ps(1.0f / 65536.0f);
+
+  for (u32 idx = 0; idx < count; ++idx) {
+    u32 fraction = (u32)position;
+    f32 *phase = bank->coefficients + (fraction >> (32 - RESAMPLE_PHASE_BITS)) * tap_count;
+    f32 *next_phase = phase + tap_count;
+    __m256 t = _mm256_mul_ps(_mm256_set1_ps((f32)((fraction >> RESAMPLE_FRACTION_SHIFT) & 0xFFFF)), fraction_scale);
+
+    i16 *left = source_left + (position >> 32);
+    i16 *right = source_right + (position >> 32);
+
+    __m256 sum_left = _mm256_setzero_ps();
+    __m256 sum_right = _mm256_setzero_ps();
+
+    for (u32 tap = 0; tap < tap_count; tap += 8) {
+      __m256 phase_taps = _mm256_loadu_ps(phase + tap);
+      __m256 coefficient = _mm256_add_ps(phase_taps,
+        _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(next_phase + tap), phase_taps), t));
+
+      __m256 left_samples = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(left + tap))));
+      __m256 right_samples = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)(right + tap))));
+
+      sum_left = _mm256_add_ps(sum_left, _mm256_mul_ps(coefficient, left_samples));
+      sum_right = _mm256_add_ps(sum_right, _mm256_mul_ps(coefficient, right_samples));
+    }
+
+    // Same order as sum_resample_lanes, written out so there's no legacy SSE
+    // call in the loop
+    __m128 halves_left = _mm_add_ps(_mm256_castps256_ps128(sum_left), _mm256_extractf128_ps(sum_left, 1));
+    __m128 halves_right = _mm_add_ps(_mm256_castps256_ps128(sum_right), _mm256_extractf128_ps(sum_right, 1));
+    __m128 quarters_left = _mm_add_ps(halves_left, _mm_movehl_ps(halves_left, halves_left));
+    __m128 quarters_right = _mm_add_ps(halves_right, _mm_movehl_ps(halves_right, halves_right));
+    f32 total_left = _mm_cvtss_f32(_mm_add_ss(quarters_left, _mm_shuffle_ps(quarters_left, quarters_left, 1)));
+    f32 total_right = _mm_cvtss_f32(_mm_add_ss(quarters_right, _mm_shuffle_ps(quarters_right, quarters_right, 1)));
+
+    bus_left[idx] += total_left * gain_left;
+    bus_right[idx] += total_right * gain_right;
+    position += step;
+  }
+}
+#endif
+
+// Define HANDMADE_FORCE_SCALAR_FILL to use the scalar loops here too
+static void select_mix_kernels(void) {
+#if defined(HANDMADE_FORCE_SCALAR_FILL)
+  global_mix_kernels.mix = mix_samples_scalar;
+  global_mix_kernels.convert = convert_mix_bus_scalar;
+  global_mix_kernels.resample = resample_samples_scalar;
+#else
+  global_mix_kernels.mix = mix_samples_sse2;
+  global_mix_kernels.convert = convert_mix_bus_sse2;
+  global_mix_kernels.resample = resample_samples_sse2;
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    global_mix_kernels.mix = mix_samples_avx2;
+    global_mix_kernels.resample = resample_samples_avx2;
+  }
+#endif
+
+  select_synth_kernels();
+}
+
+/*
+  Resample banks
+*/
+// Kaiser window shape, puts the stopband about 70dB down
+#define RESAMPLE_KAISER_BETA 7.0f
+
+// Where a max_step 1 bank cuts off, as a fraction of the source's rate. At
+// RESAMPLE_BASE_TAP_COUNT taps the transition is about 0.14 wide, so it's all
+// the way down by Nyquist.
+#define RESAMPLE_CUTOFF 0.42f
+
+global_variable const f32 resample_bank_max_steps[RESAMPLE_BANK_COUNT] = {1.0f, 1.25f, 1.5f, 1.75f, 2.0f, 2.5f, 3.0f, 4.0f};
+
+// Modified Bessel function of the first kind, order 0, from its series
+static f32 bessel_i0(f32 x) {
+  f32 result = 1.0f;
+  f32 term = 1.0f;
+
+  for (u32 k = 1; k < 32; ++k) {
+    f32 factor = x / (2.0f * (f32)k);
+    term *= factor * factor;
+    result += term;
+  }
+
+  return result;
+}
+
+static void build_resample_banks(AudioMixer *mixer, MemoryArena *arena) {
+  f32 window_scale = 1.0f / bessel_i0(RESAMPLE_KAISER_BETA);
+
+  for (u32 bank_idx = 0; bank_idx < RESAMPLE_BANK_COUNT; ++bank_idx) {
+    ResampleBank *bank = mixer->resample_banks + bank_idx;
+    f32 max_step = resample_bank_max_steps[bank_idx];
+    bank->max_step = (u64)(max_step * (f32)RESAMPLE_UNIT_STEP);
+    bank->tap_count = Align((u32)(max_step * (f32)RESAMPLE_BASE_TAP_COUNT), 8);
+    bank->coefficients = PushArray(arena, (RESAMPLE_PHASE_COUNT + 1) * bank->tap_count, f32);
+    Assert(bank->tap_count <= RESAMPLE_MAX_TAP_COUNT);
+
+    // In cycles per source sample
+    f32 cutoff = RESAMPLE_CUTOFF / max_step;
+    f32 half_width = 0.5f * (f32)bank->tap_count;
+
+    for (u32 phase_idx = 0; phase_idx <= RESAMPLE_PHASE_COUNT; ++phase_idx) {
+      f32 *phase = bank->coefficients + phase_idx * bank->tap_count;
+      f32 fraction = (f32)phase_idx / (f32)RESAMPLE_PHASE_COUNT;
+      f32 sum = 0.0f;
+
+      for (u32 tap = 0; tap < bank->tap_count; ++tap) {
+        // From the output sample's position, in source samples
+        f32 distance = (f32)tap - (half_width - 1.0f) - fraction;
+
+        f32 angle = 2.0f * Pi32 * cutoff * distance;
+        f32 sinc = (angle == 0.0f) ? 1.0f : f32_sin(angle) / angle;
+
+        f32 edge = distance / half_width;
+        f32 window = (edge * edge < 1.0f) ?
+          bessel_i0(RESAMPLE_KAISER_BETA * f32_square_root(1.0f - edge * edge)) * window_scale : 0.0f;
+
+        phase[tap] = sinc * window;
+        sum += phase[tap];
+      }
+
+      // Every phase passes DC unchanged. Phases that differ even slightly
+      // come out as a whine at the rate they're stepped through.
+      for (u32 tap = 0; tap < bank->tap_count; ++tap) {
+        phase[tap] /= sum;
+      }
+    }
+  }
+}
+
+// The bank with the fewest taps that cuts off low enough for step
+inline ResampleBank *get_resample_bank(AudioMixer *mixer, u64 step) {
+  u32 bank_idx = 0;
+  while ((bank_idx + 1 < RESAMPLE_BANK_COUNT) && (mixer->resample_banks[bank_idx].max_step < step)) {
+    ++bank_idx;
+  }
+
+  ResampleBank *result = mixer->resample_banks + bank_idx;
+  return result;
+}
+
+// Source samples per output sample for a voice whose sound is at
+// samples_per_second
+inline u64 get_voice_step(AudioMixer *mixer, Voice *voice, u32 samples_per_second) {
+  f64 step = (f64)samples_per_second / (f64)mixer->samples_per_second * (f64)voice->playback_rate;
+  step *= (f64)RESAMPLE_UNIT_STEP;
+  step = (step < (f64)RESAMPLE_MIN_STEP) ? (f64)RESAMPLE_MIN_STEP : (step > (f64)RESAMPLE_MAX_STEP) ? (f64)RESAMPLE_MAX_STEP : step;
+
+  u64 result = (u64)step;
+  return result;
+}
+
+/*
+  Voices
+*/
+static AudioMixer *allocate_audio_mixer(MemoryArena *arena) {
+  AudioMixer *mixer = PushStruct(arena, AudioMixer);
+  *mixer = {};
+
+  for (u32 voice_idx = 0; voice_idx < MAX_VOICE_COUNT; ++voice_idx) {
+    mixer->voices[voice_idx].next = mixer->first_free;
+    mixer->first_free = mixer->voices + voice_idx;
+  }
+
+  mixer->bus_left = (f32 *)push_size_(arena, MIX_BLOCK_SAMPLE_COUNT * sizeof(f32), 64);
+  mixer->bus_right = (f32 *)push_size_(arena, MIX_BLOCK_SAMPLE_COUNT * sizeof(f32), 64);
+
+  // Every platform outputs 48kHz, mix_voices corrects it if one doesn't
+  mixer->samples_per_second = 48000;
+  mixer->synth_tables = allocate_synth_tables(arena);
+
+  build_resample_banks(mixer, arena);
+  mixer->resample_scratch[0] = PushArray(arena, RESAMPLE_SCRATCH_SAMPLE_COUNT, i16);
+  mixer->resample_scratch[1] = PushArray(arena, RESAMPLE_SCRATCH_SAMPLE_COUNT, i16);
+
+  return mixer;
+}
+
+// volume is linear, 1 plays the sound as it is. pan goes from -1 (left) to 1
+// (right) with equal power in between, so a centered voice is 3dB down on
+// each side.
+static void set_voice_volume(Voice *voice, f32 volume, f32 pan) {
+  pan = (pan < -1.0f) ? -1.0f : (pan > 1.0f) ? 1.0f : pan;
+  f32 angle = (pan + 1.0f) * (0.25f * Pi32);
+
+  voice->gain_left = volume * f32_cos(angle);
+  voice->gain_right = volume * f32_sin(angle);
+}
+
+// 0 when every voice is already playing. The voice stays valid until it
+// finishes (never, for a looping one) or is stopped.
+inline Voice *play_sound(AudioMixer *mixer, LoadedSound *sound, f32 volume, f32 pan, bool is_looping) {
+  Assert((sound->channel_count == 1) || (sound->channel_count == 2));
+
+  Voice *voice = mixer->first_free;
+  if (voice) {
+    mixer->first_free = voice->next;
+
+    voice->source = VoiceSource_Sound;
+    voice->sound = sound;
+    voice->sample_index = 0;
+    voice->sample_fraction = 0;
+    voice->playback_rate = 1.0f;
+    voice->is_looping = is_looping;
+    set_voice_volume(voice, volume, pan);
+
+    voice->next = mixer->first_playing;
+    mixer->first_playing = voice;
+    ++mixer->playing_count;
+  }
+
+  return voice;
+}
+
+inline void stop_voice(AudioMixer *mixer, Voice *voice) {
+  for (Voice **link = &mixer->first_playing; *link; link = &(*link)->next) {
+    if (*link == voice) {
+      *link = voice->next;
+      voice->next = mixer->first_free;
+      mixer->first_free = voice;
+      --mixer->playing_count;
+      break;
+    }
+  }
+}
+
+#if HANDMADE_INTERNAL
+// A sine at half of full scale, for testing the mixer with. It's a whole
+// number of cycles long so it loops without a click, which moves frequency
+// (Hz) a little to fit.
+static LoadedSound *make_sine_sound(MemoryArena *arena, u32 samples_per_second, f32 frequency, f32 seconds) {
+  u32 sample_count = (u32)(seconds * (f32)samples_per_second);
+  u32 cycle_count = (u32)(frequency * seconds + 0.5f);
+  Assert((sample_count > 0) && (cycle_count > 0) && (2 * cycle_count < sample_count));
+
+  LoadedSound *sound = PushStruct(arena, LoadedSound);
+  sound->sample_count = sample_count;
+  sound->channel_count = 1;
+  sound->samples_per_second = samples_per_second;
+  sound->samples[0] = PushArray(arena, sample_count, i16);
+  sound->samples[1] = 0;
+
+  for (u32 sample_idx = 0; sample_idx < sample_count; ++sample_idx) {
+    // Wrapped to one cycle in integers first, f32 can't hold the phase
+    u32 phase = (u32)(((u64)sample_idx * cycle_count) % sample_count);
+    f32 angle = 2.0f * Pi32 * (f32)phase / (f32)sample_count;
+    sound->samples[0][sample_idx] = (i16)f32_round_to_i32(16384.0f * f32_sin(angle));
+  }
+
+  return sound;
+}
+#endif
+
+// rate multiplies how fast a voice goes through its sound, which changes its
+// pitch as well. With the sound's own rate taken into account it's clamped to
+// between RESAMPLE_MIN_STEP and RESAMPLE_MAX_STEP source samples per output
+// sample.
+inline void set_voice_playback_rate(Voice *voice, f32 rate) {
+  Assert(voice->source != VoiceSource_Oscillator);
+  voice->playback_rate = (rate < 0.0f) ? 0.0f : rate;
+}
+
+// mix_voice through the resampler. Where the filter reaches past either end
+// of the sound, the samples it needs are copied to the mixer's scratch first:
+// from the other end for a looping voice, silence for one that isn't.
+static bool mix_resampled_voice(AudioMixer *mixer, Voice *voice, u32 bus_offset, u32 count, u64 step) {
+  LoadedSound *sound = voice->sound;
+  if (sound->sample_count == 0) {
+    return false;
+  }
+
+  ResampleBank *bank = get_resample_bank(mixer, step);
+  i64 filter_offset = bank->tap_count / 2 - 1;
+  u64 position = ((u64)voice->sample_index << 32) | voice->sample_fraction;
+  bool result = true;
+
+  if (!voice->is_looping) {
+    u64 remaining_count = (((u64)sound->sample_count << 32) - position + step - 1) / step;
+    if (remaining_count <= count) {
+      count = (u32)remaining_count;
+      result = false;
+    }
+  }
+
+  if (count == 0) {
+    return result;
+  }
+
+  // Every source sample the filter reads for this run
+  i64 first_source = (i64)(position >> 32) - filter_offset;
+  i64 end_source = (i64)((position + (u64)(count - 1) * step) >> 32) - filter_offset + bank->tap_count;
+
+  i16 *source_left;
+  i16 *source_right;
+  if ((first_source >= 0) && (end_source <= (i64)sound->sample_count)) {
+    source_left = sound->samples[0] + first_source;
+    source_right = sound->samples[(sound->channel_count == 2) ? 1 : 0] + first_source;
+  } else {
+    u32 window_count = (u32)(end_source - first_source);
+    Assert(window_count <= RESAMPLE_SCRATCH_SAMPLE_COUNT);
+
+    for (u32 channel_idx = 0; channel_idx < sound->channel_count; ++channel_idx) {
+      i16 *source = sound->samples[channel_idx];
+      i16 *dest = mixer->resample_scratch[channel_idx];
+
+      for (u32 idx = 0; idx < window_count; ++idx) {
+        i64 source_idx = first_source + idx;
+
+        if (voice->is_looping) {
+          source_idx %= (i64)sound->sample_count;
+          source_idx += (source_idx < 0) ? (i64)sound->sample_count : 0;
+          dest[idx] = source[source_idx];
+        } else {
+          dest[idx] = ((source_idx >= 0) && (source_idx < (i64)sound->sample_count)) ? source[source_idx] : 0;
+        }
+      }
+    }
+
+    source_left = mixer->resample_scratch[0];
+    source_right = mixer->resample_scratch[(sound->channel_count == 2) ? 1 : 0];
+  }
+
+  global_mix_kernels.resample(mixer->bus_left + bus_offset, mixer->bus_right + bus_offset,
+    source_left, source_right, count, position & 0xFFFFFFFF, step, bank, voice->gain_left, voice->gain_right);
+
+  position += (u64)count * step;
+  voice->sample_index = (u32)((position >> 32) % sound->sample_count);
+  voice->sample_fraction = (u32)position;
+
+  return result;
+}
+
+// Adds up to count samples of voice to the bus from bus_offset on. Returns
+// false once a voice that doesn't loop has run out.
+static bool mix_voice(AudioMixer *mixer, Voice *voice, u32 bus_offset, u32 count) {
+  LoadedSound *sound = voice->sound;
+
+  u64 step = get_voice_step(mixer, voice, sound->samples_per_second);
+  if ((step != RESAMPLE_UNIT_STEP) || voice->sample_fraction) {
+    return mix_resampled_voice(mixer, voice, bus_offset, count, step);
+  }
+
+  i16 *source_left = sound->samples[0];
+  i16 *source_right = sound->samples[(sound->channel_count == 2) ? 1 : 0];
+
+  while (count) {
+    u32 remaining = sound->sample_count - voice->sample_index;
+    u32 run = (remaining < count) ? remaining : count;
+
+    global_mix_kernels.mix(mixer->bus_left + bus_offset, mixer->bus_right + bus_offset,
+      source_left + voice->sample_index, source_right + voice->sample_index,
+      run, voice->gain_left, voice->gain_right);
+
+    voice->sample_index += run;
+    bus_offset += run;
+    count -= run;
+
+    if (voice->sample_index == sound->sample_count) {
+      if (!voice->is_looping || (sound->sample_count == 0)) {
+        return false;
+      }
+      voice->sample_index = 0;
+    }
+  }
+
+  return true;
+}
+
+/*
+  Streaming
+*/
+// Reads count frames from frame first on to interleaved. first can be before
+// the start, and the frames can go past the end: a looping stream wraps around
+// there and one that doesn't reads silence.
+static void read_stream_frames(ThreadContext *thread_ctx, StreamingSound *stream, i64 first, u32 count, i16 *interleaved) {
+  u32 frame_size = stream->channel_count * sizeof(i16);
+
+  while (count) {
+    i64 frame = first;
+    if (stream->is_looping) {
+      frame %= (i64)stream->sample_count;
+      frame += (frame < 0) ? (i64)stream->sample_count : 0;
+    }
+
+    u32 run = count;
+    u32 read_count = 0;
+    if (frame < 0) {
+      run = (-frame < (i64)count) ? (u32)-frame : count;
+    } else if (frame < (i64)stream->sample_count) {
+      u32 remaining = stream->sample_count - (u32)frame;
+      run = (remaining < count) ? remaining : count;
+
+      u32 bytes_read = stream->memory->dbg_platform_read_file_chunk(thread_ctx, stream->file_name,
+        stream->data_offset + (u64)frame * frame_size, run * frame_size, interleaved);
+      read_count = bytes_read / frame_size;
+    }
+
+    // A file that got shorter since it was opened plays silence for the rest
+    memset((u8 *)interleaved + read_count * frame_size, 0, (run - read_count) * frame_size);
+
+    interleaved += run * stream->channel_count;
+    first += run;
+    count -= run;
+  }
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(load_stream_chunk) {
+  StreamChunk *chunk = (StreamChunk *)data;
+  StreamingSound *stream = chunk->stream;
+
+  // Read interleaved, margins and all, then split into the chunk's channels
+  i16 interleaved[(STREAM_CHUNK_SAMPLE_COUNT + 2 * RESAMPLE_MARGIN_SAMPLE_COUNT) * 2];
+  u32 frame_count = chunk->sample_count + 2 * RESAMPLE_MARGIN_SAMPLE_COUNT;
+  read_stream_frames(thread_ctx, stream, (i64)chunk->first_sample - RESAMPLE_MARGIN_SAMPLE_COUNT, frame_count, interleaved);
+
+  deinterleave_wav_samples(interleaved, stream->channel_count, frame_count,
+    chunk->samples[0] - RESAMPLE_MARGIN_SAMPLE_COUNT,
+    chunk->samples[1] ? (chunk->samples[1] - RESAMPLE_MARGIN_SAMPLE_COUNT) : 0);
+
+  __atomic_store_n(&chunk->state, StreamChunk_Ready, __ATOMIC_RELEASE);
+}
+
+// Queues reads for every chunk the mixer has finished with. Called once a
+// frame for each stream that's playing, from the game's thread.
+static void update_streaming_sound(GameMemory *memory, StreamingSound *stream) {
+  while (!stream->is_fully_queued) {
+    StreamChunk *chunk = stream->chunks + stream->next_load_chunk;
+    if (__atomic_load_n(&chunk->state, __ATOMIC_ACQUIRE) != StreamChunk_Empty) {
+      break;
+    }
+
+    u32 remaining = stream->sample_count - stream->next_load_sample;
+    chunk->first_sample = stream->next_load_sample;
+    chunk->sample_count = (remaining < STREAM_CHUNK_SAMPLE_COUNT) ? remaining : STREAM_CHUNK_SAMPLE_COUNT;
+    chunk->state = StreamChunk_Loading;
+
+    memory->add_entry(memory->low_priority_queue, load_stream_chunk, chunk);
+
+    stream->next_load_chunk = (stream->next_load_chunk + 1) % STREAM_CHUNK_COUNT;
+    stream->next_load_sample += chunk->sample_count;
+    if (stream->next_load_sample == stream->sample_count) {
+      if (stream->is_looping) {
+        stream->next_load_sample = 0;
+      } else {
+        stream->is_fully_queued = true;
+      }
+    }
+  }
+}
+
+// Queues the stream's reads again from where the mixer is up to, after its
+// memory was copied back from a snapshot. The snapshot can hold a chunk that
+// was still Loading, which no read is going to finish now.
+static void restart_streaming_sound(GameMemory *memory, StreamingSound *stream) {
+  StreamChunk *play_chunk = stream->chunks + stream->next_play_chunk;
+  if (play_chunk->state != StreamChunk_Empty) {
+    // Otherwise nothing was queued past the mixer, and the cursor is already
+    // there
+    stream->next_load_sample = play_chunk->first_sample;
+    stream->is_fully_queued = false;
+  }
+  stream->next_load_chunk = stream->next_play_chunk;
+
+  for (u32 chunk_idx = 0; chunk_idx < STREAM_CHUNK_COUNT; ++chunk_idx) {
+    stream->chunks[chunk_idx].state = StreamChunk_Empty;
+  }
+
+  update_streaming_sound(memory, stream);
+}
+
+// Reads the header of a 16 bit PCM WAV and starts reading its first chunks.
+// Returns 0 if the file can't be read or isn't a kind of WAV handled here.
+static StreamingSound *open_streaming_wav(
+  ThreadContext *thread_ctx,
+  GameMemory *memory,
+  MemoryArena *arena,
+  const char *file_name,
+  bool is_looping
+) {
+  StreamingSound *result = 0;
+
+  u32 file_name_length = 0;
+  while (file_name[file_name_length]) {
+    ++file_name_length;
+  }
+  if (file_name_length >= STREAM_MAX_FILE_NAME_COUNT) {
+    return result;
+  }
+
+  u8 header[STREAM_HEADER_READ_SIZE];
+  u32 header_size = memory->dbg_platform_read_file_chunk(thread_ctx, file_name, 0, sizeof(header), header);
+
+  WavInfo info = {};
+  if (!parse_wav(header, header_size, &info) || (info.sample_count == 0)) {
+    return result;
+  }
+
+  result = PushStruct(arena, StreamingSound);
+  *result = {};
+  memcpy(result->file_name, file_name, file_name_length + 1);
+  result->memory = memory;
+  result->data_offset = info.data_offset;
+  result->sample_count = info.sample_count;
+  result->channel_count = info.channel_count;
+  result->samples_per_second = info.samples_per_second;
+  result->is_looping = is_looping;
+
+  for (u32 chunk_idx = 0; chunk_idx < STREAM_CHUNK_COUNT; ++chunk_idx) {
+    StreamChunk *chunk = result->chunks + chunk_idx;
+    chunk->stream = result;
+    chunk->state = StreamChunk_Empty;
+    for (u32 channel_idx = 0; channel_idx < info.channel_count; ++channel_idx) {
+      chunk->samples[channel_idx] = PushArray(arena, STREAM_CHUNK_SAMPLE_COUNT + 2 * RESAMPLE_MARGIN_SAMPLE_COUNT, i16) +
+        RESAMPLE_MARGIN_SAMPLE_COUNT;
+    }
+  }
+
+  update_streaming_sound(memory, result);
+
+  return result;
+}
+
+// Same as play_sound, for a stream that isn't already playing
+static Voice *play_streaming_sound(AudioMixer *mixer, StreamingSound *stream, f32 volume, f32 pan) {
+  Voice *voice = mixer->first_free;
+  if (voice) {
+    mixer->first_free = voice->next;
+
+    voice->source = VoiceSource_Stream;
+    voice->stream = stream;
+    voice->sample_index = 0;
+    voice->sample_fraction = 0;
+    voice->playback_rate = 1.0f;
+    voice->is_looping = stream->is_looping;
+    set_voice_volume(voice, volume, pan);
+
+    voice->next = mixer->first_playing;
+    mixer->first_playing = voice;
+    ++mixer->playing_count;
+  }
+
+  return voice;
+}
+
+// mix_voice for a stream. When the next chunk isn't in yet the rest of the
+// block is left silent and the stream picks up where it was next time, so a
+// slow read is a gap rather than skipped music. Resampling reads the chunk's
+// margins, so it never needs more than the chunk it's in.
+static bool mix_streaming_voice(AudioMixer *mixer, Voice *voice, u32 bus_offset, u32 count) {
+  StreamingSound *stream = voice->stream;
+
+  u64 step = get_voice_step(mixer, voice, stream->samples_per_second);
+  ResampleBank *bank = get_resample_bank(mixer, step);
+  u32 filter_offset = bank->tap_count / 2 - 1;
+
+  while (count) {
+    StreamChunk *chunk = stream->chunks + stream->next_play_chunk;
+    if (__atomic_load_n(&chunk->state, __ATOMIC_ACQUIRE) != StreamChunk_Ready) {
+      ++stream->underrun_count;
+      break;
+    }
+
+    i16 *source_left = chunk->samples[0];
+    i16 *source_right = chunk->samples[(stream->channel_count == 2) ? 1 : 0];
+
+    if (stream->chunk_sample_index < chunk->sample_count) {
+      u32 run;
+
+      if ((step != RESAMPLE_UNIT_STEP) || stream->chunk_sample_fraction) {
+        // Up to the first output sample past the end of the chunk
+        u64 position = ((u64)stream->chunk_sample_index << 32) | stream->chunk_sample_fraction;
+        u64 chunk_count = (((u64)chunk->sample_count << 32) - position + step - 1) / step;
+        run = (chunk_count < count) ? (u32)chunk_count : count;
+
+        global_mix_kernels.resample(mixer->bus_left + bus_offset, mixer->bus_right + bus_offset,
+          source_left - filter_offset, source_right - filter_offset, run, position, step, bank,
+          voice->gain_left, voice->gain_right);
+
+        position += (u64)run * step;
+        stream->chunk_sample_index = (u32)(position >> 32);
+        stream->chunk_sample_fraction = (u32)position;
+      } else {
+        u32 remaining = chunk->sample_count - stream->chunk_sample_index;
+        run = (remaining < count) ? remaining : count;
+
+        global_mix_kernels.mix(mixer->bus_left + bus_offset, mixer->bus_right + bus_offset,
+          source_left + stream->chunk_sample_index, source_right + stream->chunk_sample_index,
+          run, voice->gain_left, voice->gain_right);
+
+        stream->chunk_sample_index += run;
+      }
+
+      bus_offset += run;
+      count -= run;
+    }
+
+    // A step can carry past the end of a short chunk, onto the next one or
+    // further
+    if (stream->chunk_sample_index >= chunk->sample_count) {
+      bool is_last = !stream->is_looping && (chunk->first_sample + chunk->sample_count == stream->sample_count);
+
+      stream->chunk_sample_index -= chunk->sample_count;
+      stream->next_play_chunk = (stream->next_play_chunk + 1) % STREAM_CHUNK_COUNT;
+      __atomic_store_n(&chunk->state, StreamChunk_Empty, __ATOMIC_RELEASE);
+
+      if (is_last) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+/*
+  Tones
+*/
+// Plays an oscillator for seconds, or until it's stopped when seconds is 0.
+// frequency is in Hz, see Waveform_Noise for what it means for noise.
+inline Voice *play_tone(AudioMixer *mixer, Waveform waveform, f32 frequency, f32 seconds, f32 volume, f32 pan) {
+  Voice *voice = mixer->first_free;
+  if (voice) {
+    mixer->first_free = voice->next;
+
+    voice->source = VoiceSource_Oscillator;
+    voice->oscillator.waveform = waveform;
+    voice->oscillator.phase = 0;
+    voice->oscillator.phase_increment = get_phase_increment(frequency, mixer->samples_per_second);
+    voice->oscillator.sample_count = (u32)(seconds * (f32)mixer->samples_per_second);
+    voice->sample_index = 0;
+    voice->sample_fraction = 0;
+    voice->playback_rate = 1.0f;
+    voice->is_looping = seconds <= 0.0f;
+    set_voice_volume(voice, volume, pan);
+
+    voice->next = mixer->first_playing;
+    mixer->first_playing = voice;
+    ++mixer->playing_count;
+  }
+
+  return voice;
+}
+
+// For sweeps and vibrato, the phase carries on from where it is so there's no
+// click
+inline void set_tone_frequency(AudioMixer *mixer, Voice *voice, f32 frequency) {
+  Assert(voice->source == VoiceSource_Oscillator);
+  voice->oscillator.phase_increment = get_phase_increment(frequency, mixer->samples_per_second);
+}
+
+// mix_voice for an oscillator
+static bool mix_oscillator_voice(AudioMixer *mixer, Voice *voice, u32 bus_offset, u32 count) {
+  Oscillator *oscillator = &voice->oscillator;
+  bool result = true;
+
+  if (!voice->is_looping) {
+    u32 remaining = oscillator->sample_count - voice->sample_index;
+    if (remaining <= count) {
+      count = remaining;
+      result = false;
+    }
+    voice->sample_index += count;
+  }
+
+  oscillator->phase = global_synth_kernels.synthesize(mixer->bus_left + bus_offset, mixer->bus_right + bus_offset,
+    get_oscillator_table(mixer->synth_tables, oscillator), oscillator->phase, oscillator->phase_increment,
+    count, voice->gain_left, voice->gain_right);
+
+  return result;
+}
+
+/*
+  Mixing
+*/
+// Fills sound_buffer with every playing voice, a block at a time. Voices that
+// finish are put back in the free list.
+static void mix_voices(AudioMixer *mixer, GameSoundOutputBuffer *sound_buffer) {
+  if (!global_mix_kernels.mix) {
+    select_mix_kernels();
+  }
+
+  mixer->samples_per_second = (u32)sound_buffer->samples_per_second;
+
+  BEGIN_TIMED_BLOCK(MixVoices);
+
+  u32 voice_sample_count = 0;
+  i16 *dest = sound_buffer->samples;
+
+  for (u32 first_sample = 0; first_sample < (u32)sound_buffer->sample_count; first_sample += MIX_BLOCK_SAMPLE_COUNT) {
+    u32 block_count = (u32)sound_buffer->sample_count - first_sample;
+    block_count = (block_count < MIX_BLOCK_SAMPLE_COUNT) ? block_count : MIX_BLOCK_SAMPLE_COUNT;
+
+    memset(mixer->bus_left, 0, block_count * sizeof(f32));
+    memset(mixer->bus_right, 0, block_count * sizeof(f32));
+
+    for (Voice **link = &mixer->first_playing; *link;) {
+      Voice *voice = *link;
+      voice_sample_count += block_count;
+
+      bool is_playing = false;
+      switch (voice->source) {
+        case VoiceSource_Sound: {
+          is_playing = mix_voice(mixer, voice, 0, block_count);
+        } break;
+
+        case VoiceSource_Stream: {
+          is_playing = mix_streaming_voice(mixer, voice, 0, block_count);
+        } break;
+
+        case VoiceSource_Oscillator: {
+          is_playing = mix_oscillator_voice(mixer, voice, 0, block_count);
+        } break;
+      }
+
+      if (is_playing) {
+        link = &voice->next;
+      } else {
+        *link = voice->next;
+        voice->next = mixer->first_free;
+        mixer->first_free = voice;
+        --mixer->playing_count;
+      }
+    }
+
+    global_mix_kernels.convert(dest, mixer->bus_left, mixer->bus_right, block_count);
+    dest += 2 * block_count;
+  }
+
+  END_TIMED_BLOCK_COUNTED(MixVoices, voice_sample_count);
+}
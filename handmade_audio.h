@@ -0,0 +1,188 @@
+#if !defined(HANDMADE_AUDIO_H)
+#define HANDMADE_AUDIO_H
+
+/*
+  Mixer
+
+  Every playing sound is a voice. Voices are mixed into a float bus, one
+  MIX_BLOCK_SAMPLE_COUNT block of output at a time, and the bus is converted to
+  the platform's interleaved 16 bit samples at the end of each block. Bus
+  values are in 16 bit sample units, so a sound at full volume adds its
+  samples unchanged and converting is just a saturating round.
+*/
+#define MAX_VOICE_COUNT 512
+#define MIX_BLOCK_SAMPLE_COUNT 1024
+
+// One channel (played on both sides) or two. Channels are kept apart so they
+// can be loaded a vector at a time.
+struct LoadedSound {
+  u32 sample_count; // Per channel
+  u32 channel_count;
+  u32 samples_per_second;
+  i16 *samples[2];
+};
+
+/*
+  Resampling
+
+  A voice whose sound isn't at the output's rate, or that's being played
+  faster or slower, goes through a polyphase windowed sinc (Kaiser) filter.
+  The position in the source is 32.32 fixed point. The top
+  RESAMPLE_PHASE_BITS of the fraction pick a phase of the filter and the 16
+  bits under them interpolate its coefficients towards the next phase.
+
+  Each bank covers steps (source samples per output sample) up to its
+  max_step and cuts off under the Nyquist of whichever rate is lower. Cutting
+  lower for faster steps makes the filter longer in source samples, so the
+  banks for bigger steps have more taps: RESAMPLE_BASE_TAP_COUNT * max_step.
+*/
+#define RESAMPLE_PHASE_BITS 7
+#define RESAMPLE_PHASE_COUNT (1 << RESAMPLE_PHASE_BITS)
+#define RESAMPLE_FRACTION_SHIFT (32 - RESAMPLE_PHASE_BITS - 16)
+
+#define RESAMPLE_BANK_COUNT 8
+#define RESAMPLE_BASE_TAP_COUNT 32
+#define RESAMPLE_MAX_TAP_COUNT 128
+
+// 1.0 in the 32.32 steps and positions
+#define RESAMPLE_UNIT_STEP ((u64)1 << 32)
+#define RESAMPLE_MIN_STEP (RESAMPLE_UNIT_STEP / 64)
+#define RESAMPLE_MAX_STEP (4 * RESAMPLE_UNIT_STEP)
+
+// A block's worth of source at RESAMPLE_MAX_STEP, plus the filter either side
+#define RESAMPLE_SCRATCH_SAMPLE_COUNT (MIX_BLOCK_SAMPLE_COUNT * 4 + RESAMPLE_MAX_TAP_COUNT)
+
+struct ResampleBank {
+  u64 max_step;
+  u32 tap_count; // Multiple of 8
+
+  // (RESAMPLE_PHASE_COUNT + 1) phases of tap_count each, the last one being
+  // the first one a whole source sample on so interpolating never wraps. Tap
+  // t of the phase for fraction f weights the source sample
+  // t - (tap_count / 2 - 1) from the one before the output's position.
+  f32 *coefficients;
+};
+
+/*
+  Streaming
+
+  Music is too long to load whole, so it's read a chunk at a time into a small
+  ring on the low priority queue. Each chunk goes Empty -> Loading (queued by
+  update_streaming_sound on the game's thread) -> Ready (the read finished) ->
+  Empty again once the mixer has played all of it. Only the owner of the state
+  a chunk is in touches it, so the state is the only thing shared between
+  threads.
+
+  4 chunks of 8192 stereo samples is 128KB a stream and about 0.7s of sound at
+  48kHz, which is how long a read can take before the mixer runs dry.
+
+  Chunks also hold RESAMPLE_MARGIN_SAMPLE_COUNT samples from either side of
+  them (read from the file again), so resampling near the end of one doesn't
+  need the one before or after.
+*/
+#define STREAM_CHUNK_SAMPLE_COUNT 8192
+#define STREAM_CHUNK_COUNT 4
+#define STREAM_MAX_FILE_NAME_COUNT 256
+#define RESAMPLE_MARGIN_SAMPLE_COUNT (RESAMPLE_MAX_TAP_COUNT / 2)
+
+// Enough of the start of the file to find the samples in any WAV that's
+// streamed. Only metadata chunks ahead of "data" can push it further.
+#define STREAM_HEADER_READ_SIZE 4096
+
+enum StreamChunkState {
+  StreamChunk_Empty,
+  StreamChunk_Loading,
+  StreamChunk_Ready,
+};
+
+struct StreamingSound;
+struct GameMemory;
+
+struct StreamChunk {
+  StreamingSound *stream;
+  u32 volatile state;
+
+  u32 first_sample;
+  u32 sample_count;
+  // STREAM_CHUNK_SAMPLE_COUNT each, the second only for stereo, with
+  // RESAMPLE_MARGIN_SAMPLE_COUNT more before and after
+  i16 *samples[2];
+};
+
+// Lives in permanent storage. Only one voice can play it at a time, and only
+// once through (or for ever when it loops).
+struct StreamingSound {
+  // Copied so it outlives the string it was opened with across a code reload
+  char file_name[STREAM_MAX_FILE_NAME_COUNT];
+  GameMemory *memory; // For the platform's read_file_chunk from the worker
+
+  u32 data_offset;
+  u32 sample_count; // Per channel
+  u32 channel_count;
+  u32 samples_per_second;
+  bool is_looping;
+
+  StreamChunk chunks[STREAM_CHUNK_COUNT];
+
+  // Game's thread only
+  u32 next_load_chunk;
+  u32 next_load_sample;
+  bool is_fully_queued;
+
+  // Mixer only
+  u32 next_play_chunk;
+  u32 chunk_sample_index;
+  u32 chunk_sample_fraction; // 32.32 with chunk_sample_index when resampling
+  u32 underrun_count; // Blocks that went (partly) silent waiting on a read
+};
+
+enum VoiceSource {
+  VoiceSource_Sound,
+  VoiceSource_Stream,
+  VoiceSource_Oscillator,
+};
+
+struct Voice {
+  Voice *next;
+
+  // Only the one source says is used
+  u32 source;
+  LoadedSound *sound;
+  StreamingSound *stream;
+  Oscillator oscillator;
+  u32 sample_index;
+  u32 sample_fraction; // 32.32 with sample_index when resampling
+  bool is_looping;
+
+  // Times the sound's own rate, see set_voice_playback_rate
+  f32 playback_rate;
+
+  // From volume and pan, see set_voice_volume
+  f32 gain_left;
+  f32 gain_right;
+};
+
+// Lives in permanent storage
+struct AudioMixer {
+  Voice voices[MAX_VOICE_COUNT];
+  Voice *first_playing;
+  Voice *first_free;
+  u32 playing_count;
+
+  // Of the output, as of the last mix. Tones are tuned to it.
+  u32 samples_per_second;
+  SynthTables *synth_tables;
+
+  // Smallest max_step first
+  ResampleBank resample_banks[RESAMPLE_BANK_COUNT];
+
+  // Where a sound's samples get copied when the filter reaches past its
+  // start or end, RESAMPLE_SCRATCH_SAMPLE_COUNT each
+  i16 *resample_scratch[2];
+
+  // MIX_BLOCK_SAMPLE_COUNT each
+  f32 *bus_left;
+  f32 *bus_right;
+};
+
+#endif
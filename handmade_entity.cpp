@@ -0,0 +1,437 @@
+#include <emmintrin.h>
+
+/*
+  Entity store
+*/
+// Just the per slot arrays, for stores that never hand out handles
+static void allocate_entity_components(MemoryArena *arena, EntityStore *store, u32 capacity) {
+  *store = {};
+  store->capacity = capacity;
+  store->first_free_index = ENTITY_INVALID_SLOT;
+
+  store->handle_indices = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+  store->flags = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+  store->abs_tile_x = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->abs_tile_y = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->offset_x = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->offset_y = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->velocity_x = (f32 *)push_size_(arena, capacity * sizeof(f32), 64);
+  store->velocity_y = (f32 *)push_size_(arena, capacity * sizeof(f32), 64);
+  store->box_min_x = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->box_min_y = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->box_max_x = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+  store->box_max_y = (i32 *)push_size_(arena, capacity * sizeof(i32), 64);
+}
+
+static void allocate_entity_store(MemoryArena *arena, EntityStore *store, u32 capacity) {
+  allocate_entity_components(arena, store, capacity);
+
+  store->generations = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+  store->slots = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+  store->chunk_next = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+  store->chunk_prev = (u32 *)push_size_(arena, capacity * sizeof(u32), 64);
+
+  u32 chunk_slot_count = 64;
+  while (chunk_slot_count < 2 * capacity) {
+    chunk_slot_count *= 2;
+  }
+  store->chunk_shift = 64 - find_least_significant_set_bit(chunk_slot_count).index;
+  store->chunk_count = 0;
+  store->chunks = (EntityChunk *)push_size_(arena, chunk_slot_count * sizeof(EntityChunk), 64);
+  for (u32 slot_idx = 0; slot_idx < chunk_slot_count; ++slot_idx) {
+    store->chunks[slot_idx].first_index = ENTITY_INVALID_SLOT;
+  }
+}
+
+
+/*
+  Chunks
+*/
+inline u32 get_entity_chunk_slot_count(EntityStore *store) {
+  u32 slot_count = 1u << (64 - store->chunk_shift);
+  return slot_count;
+}
+
+// Where the chunk's probe sequence starts. Same key and Fibonacci hashing as
+// the tile map hash.
+inline u32 get_entity_chunk_home_slot(EntityStore *store, i32 chunk_x, i32 chunk_y) {
+  u64 key = tile_map_hash_key(chunk_x, chunk_y);
+  u32 slot_idx = (u32)((key * 11400714819323198485ull) >> store->chunk_shift);
+  return slot_idx;
+}
+
+// The chunk's slot, or the free one it would go in
+static u32 find_entity_chunk_slot(EntityStore *store, i32 chunk_x, i32 chunk_y) {
+  u32 slot_mask = get_entity_chunk_slot_count(store) - 1;
+
+  // Never more than half full, so this always ends at a match or a free slot
+  for (u32 slot_idx = get_entity_chunk_home_slot(store, chunk_x, chunk_y);; slot_idx = (slot_idx + 1) & slot_mask) {
+    EntityChunk *chunk = store->chunks + slot_idx;
+    if ((chunk->first_index == ENTITY_INVALID_SLOT) ||
+        ((chunk->chunk_x == chunk_x) && (chunk->chunk_y == chunk_y)))
+    {
+      return slot_idx;
+    }
+  }
+}
+
+// Frees a chunk's slot, moving back any chunk further along the probe
+// sequence that could have gone in it, so lookups still find them
+static void remove_entity_chunk(EntityStore *store, u32 slot_idx) {
+  u32 slot_mask = get_entity_chunk_slot_count(store) - 1;
+  u32 hole = slot_idx;
+
+  for (u32 next = (hole + 1) & slot_mask; store->chunks[next].first_index != ENTITY_INVALID_SLOT; next = (next + 1) & slot_mask) {
+    EntityChunk *chunk = store->chunks + next;
+    u32 home = get_entity_chunk_home_slot(store, chunk->chunk_x, chunk->chunk_y);
+
+    // The hole is somewhere from its home slot up to where it is now
+    if (((next - home) & slot_mask) >= ((next - hole) & slot_mask)) {
+      store->chunks[hole] = *chunk;
+      hole = next;
+    }
+  }
+
+  store->chunks[hole].first_index = ENTITY_INVALID_SLOT;
+  --store->chunk_count;
+}
+
+// Puts the entity with this handle index at the front of the list of the
+// chunk that absolute tile is in
+static void file_entity(EntityStore *store, u32 index, i32 abs_tile_x, i32 abs_tile_y) {
+  i32 chunk_x = abs_tile_x >> ENTITY_CHUNK_SHIFT;
+  i32 chunk_y = abs_tile_y >> ENTITY_CHUNK_SHIFT;
+  EntityChunk *chunk = store->chunks + find_entity_chunk_slot(store, chunk_x, chunk_y);
+
+  if (chunk->first_index == ENTITY_INVALID_SLOT) {
+    chunk->chunk_x = chunk_x;
+    chunk->chunk_y = chunk_y;
+    ++store->chunk_count;
+  } else {
+    store->chunk_prev[chunk->first_index] = index;
+  }
+
+  store->chunk_next[index] = chunk->first_index;
+  store->chunk_prev[index] = ENTITY_INVALID_SLOT;
+  chunk->first_index = index;
+}
+
+// Takes the entity out of the list it was filed in, at that absolute tile
+static void unfile_entity(EntityStore *store, u32 index, i32 abs_tile_x, i32 abs_tile_y) {
+  u32 next = store->chunk_next[index];
+  u32 prev = store->chunk_prev[index];
+
+  if (next != ENTITY_INVALID_SLOT) {
+    store->chunk_prev[next] = prev;
+  }
+
+  if (prev != ENTITY_INVALID_SLOT) {
+    store->chunk_next[prev] = next;
+  } else {
+    u32 slot_idx = find_entity_chunk_slot(store, abs_tile_x >> ENTITY_CHUNK_SHIFT, abs_tile_y >> ENTITY_CHUNK_SHIFT);
+    Assert(store->chunks[slot_idx].first_index == index);
+
+    if (next != ENTITY_INVALID_SLOT) {
+      store->chunks[slot_idx].first_index = next;
+    } else {
+      remove_entity_chunk(store, slot_idx);
+    }
+  }
+}
+
+// ENTITY_INVALID_SLOT when the entity has been removed (or the handle is zero)
+inline u32 get_entity_slot(EntityStore *store, EntityHandle handle) {
+  u32 slot = ENTITY_INVALID_SLOT;
+
+  if ((handle.index < store->index_count) &&
+      (handle.generation != 0) &&
+      (store->generations[handle.index] == handle.generation))
+  {
+    slot = store->slots[handle.index];
+  }
+
+  return slot;
+}
+
+inline WorldPosition get_entity_position(EntityStore *store, u32 slot) {
+  WorldPosition pos;
+  pos.abs_tile_x = store->abs_tile_x[slot];
+  pos.abs_tile_y = store->abs_tile_y[slot];
+  pos.offset_x = store->offset_x[slot];
+  pos.offset_y = store->offset_y[slot];
+
+  return pos;
+}
+
+inline void set_entity_position(EntityStore *store, u32 slot, WorldPosition pos) {
+  store->abs_tile_x[slot] = pos.abs_tile_x;
+  store->abs_tile_y[slot] = pos.abs_tile_y;
+  store->offset_x[slot] = pos.offset_x;
+  store->offset_y[slot] = pos.offset_y;
+}
+
+inline CollisionBox get_entity_box(EntityStore *store, u32 slot) {
+  CollisionBox box;
+  box.min_x = store->box_min_x[slot];
+  box.min_y = store->box_min_y[slot];
+  box.max_x = store->box_max_x[slot];
+  box.max_y = store->box_max_y[slot];
+
+  return box;
+}
+
+// Starts out standing still
+static EntityHandle add_entity(EntityStore *store, WorldPosition pos, CollisionBox box, u32 flags) {
+  Assert(store->count < store->capacity);
+
+  u32 index = store->first_free_index;
+  if (index != ENTITY_INVALID_SLOT) {
+    store->first_free_index = store->slots[index];
+  } else {
+    index = store->index_count++;
+    store->generations[index] = 1;
+  }
+
+  u32 slot = store->count++;
+  store->slots[index] = slot;
+  store->handle_indices[slot] = index;
+
+  store->flags[slot] = flags;
+  set_entity_position(store, slot, pos);
+  file_entity(store, index, pos.abs_tile_x, pos.abs_tile_y);
+  store->velocity_x[slot] = 0.0f;
+  store->velocity_y[slot] = 0.0f;
+  store->box_min_x[slot] = box.min_x;
+  store->box_min_y[slot] = box.min_y;
+  store->box_max_x[slot] = box.max_x;
+  store->box_max_y[slot] = box.max_y;
+
+  EntityHandle handle = {index, store->generations[index]};
+  return handle;
+}
+
+// Moves the last entity into slot, keeping the arrays packed
+inline void remove_entity(EntityStore *store, EntityHandle handle) {
+  u32 slot = get_entity_slot(store, handle);
+  if (slot == ENTITY_INVALID_SLOT) {
+    return;
+  }
+
+  unfile_entity(store, handle.index, store->abs_tile_x[slot], store->abs_tile_y[slot]);
+
+  u32 last_slot = --store->count;
+  if (slot != last_slot) {
+    u32 moved_index = store->handle_indices[last_slot];
+    store->slots[moved_index] = slot;
+    store->handle_indices[slot] = moved_index;
+
+    store->flags[slot] = store->flags[last_slot];
+    store->abs_tile_x[slot] = store->abs_tile_x[last_slot];
+    store->abs_tile_y[slot] = store->abs_tile_y[last_slot];
+    store->offset_x[slot] = store->offset_x[last_slot];
+    store->offset_y[slot] = store->offset_y[last_slot];
+    store->velocity_x[slot] = store->velocity_x[last_slot];
+    store->velocity_y[slot] = store->velocity_y[last_slot];
+    store->box_min_x[slot] = store->box_min_x[last_slot];
+    store->box_min_y[slot] = store->box_min_y[last_slot];
+    store->box_max_x[slot] = store->box_max_x[last_slot];
+    store->box_max_y[slot] = store->box_max_y[last_slot];
+  }
+
+  // Generation 0 is the zero handle's, skip it when wrapping around
+  u32 generation = store->generations[handle.index] + 1;
+  store->generations[handle.index] = generation ? generation : 1;
+  store->slots[handle.index] = store->first_free_index;
+  store->first_free_index = handle.index;
+}
+
+
+/*
+  Update
+
+  Every entity moves by velocity * dt. Anything that doesn't collide, and any
+  collider whose box stays on the tiles it's already on (which have to be
+  empty), is moved right there by the integrate pass, a vector at a time. That's
+  nearly every entity on a given frame. Colliders whose box edges cross into
+  new tiles go on the sweep list and are moved one at a time by
+  world_move_box.
+*/
+// True when moving [offset + min, offset + max) by delta changes which tiles
+// its edges are in
+inline bool box_axis_crosses_tiles(i32 offset, i32 min, i32 max, i32 delta) {
+  i32 low = offset + min;
+  i32 high = offset + max - 1;
+  bool crosses = (((low + delta) >> TILE_OFFSET_SHIFT) != (low >> TILE_OFFSET_SHIFT)) ||
+                 (((high + delta) >> TILE_OFFSET_SHIFT) != (high >> TILE_OFFSET_SHIFT));
+
+  return crosses;
+}
+
+inline void add_entity_sweep(EntitySweepList *sweeps, u32 slot, i32 delta_x, i32 delta_y) {
+  u32 sweep_idx = sweeps->count++;
+  sweeps->slots[sweep_idx] = slot;
+  sweeps->delta_x[sweep_idx] = delta_x;
+  sweeps->delta_y[sweep_idx] = delta_y;
+}
+
+static void integrate_entities_scalar(World *world, EntityStore *store, f32 dt, u32 first_slot, EntitySweepList *sweeps) {
+  for (u32 slot = first_slot; slot < store->count; ++slot) {
+    i32 delta_x = pixels_to_tile_offset(world, dt * store->velocity_x[slot]);
+    i32 delta_y = pixels_to_tile_offset(world, dt * store->velocity_y[slot]);
+
+    if ((store->flags[slot] & EntityFlag_Collides) &&
+        (box_axis_crosses_tiles(store->offset_x[slot], store->box_min_x[slot], store->box_max_x[slot], delta_x) ||
+         box_axis_crosses_tiles(store->offset_y[slot], store->box_min_y[slot], store->box_max_y[slot], delta_y)))
+    {
+      add_entity_sweep(sweeps, slot, delta_x, delta_y);
+    } else {
+      set_entity_position(store, slot, offset_position(get_entity_position(store, slot), delta_x, delta_y));
+    }
+  }
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+// All ones in the lanes where box_axis_crosses_tiles would be true
+inline __m128i box_axis_crosses_tiles_sse2(__m128i offset, __m128i min, __m128i max, __m128i delta) {
+  __m128i low = _mm_add_epi32(offset, min);
+  __m128i high = _mm_sub_epi32(_mm_add_epi32(offset, max), _mm_set1_epi32(1));
+
+  __m128i low_stays = _mm_cmpeq_epi32(
+    _mm_srai_epi32(_mm_add_epi32(low, delta), TILE_OFFSET_SHIFT), _mm_srai_epi32(low, TILE_OFFSET_SHIFT));
+  __m128i high_stays = _mm_cmpeq_epi32(
+    _mm_srai_epi32(_mm_add_epi32(high, delta), TILE_OFFSET_SHIFT), _mm_srai_epi32(high, TILE_OFFSET_SHIFT));
+
+  return _mm_andnot_si128(_mm_and_si128(low_stays, high_stays), _mm_set1_epi32(-1));
+}
+
+// Moves abs_tile / offset by delta and recanonicalizes, except in the keep lanes
+inline void offset_entity_axis_sse2(i32 *abs_tile, i32 *offset, __m128i delta, __m128i keep) {
+  __m128i old_abs_tile = _mm_load_si128((__m128i *)abs_tile);
+  __m128i old_offset = _mm_load_si128((__m128i *)offset);
+
+  __m128i moved_offset = _mm_add_epi32(old_offset, delta);
+  __m128i new_abs_tile = _mm_add_epi32(old_abs_tile, _mm_srai_epi32(moved_offset, TILE_OFFSET_SHIFT));
+  __m128i new_offset = _mm_and_si128(moved_offset, _mm_set1_epi32(TILE_OFFSET_MASK));
+
+  _mm_store_si128((__m128i *)abs_tile, _mm_or_si128(_mm_and_si128(keep, old_abs_tile), _mm_andnot_si128(keep, new_abs_tile)));
+  _mm_store_si128((__m128i *)offset, _mm_or_si128(_mm_and_si128(keep, old_offset), _mm_andnot_si128(keep, new_offset)));
+}
+
+// Same float operations as pixels_to_tile_offset, so it moves entities exactly
+// as far as the scalar loop does
+static void integrate_entities_sse2(World *world, EntityStore *store, f32 dt, EntitySweepList *sweeps) {
+  __m128 dt_4x = _mm_set1_ps(dt);
+  __m128 pixels_to_offset = _mm_set1_ps((f32)TILE_OFFSET_ONE / (f32)world->tile_size_pixels);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128i collides_flag = _mm_set1_epi32(EntityFlag_Collides);
+
+  u32 slot = 0;
+  for (; slot + 4 <= store->count; slot += 4) {
+    __m128i delta_x = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(dt_4x, _mm_load_ps(store->velocity_x + slot)), pixels_to_offset), half));
+    __m128i delta_y = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(dt_4x, _mm_load_ps(store->velocity_y + slot)), pixels_to_offset), half));
+
+    __m128i crosses = _mm_or_si128(
+      box_axis_crosses_tiles_sse2(
+        _mm_load_si128((__m128i *)(store->offset_x + slot)),
+        _mm_load_si128((__m128i *)(store->box_min_x + slot)),
+        _mm_load_si128((__m128i *)(store->box_max_x + slot)),
+        delta_x),
+      box_axis_crosses_tiles_sse2(
+        _mm_load_si128((__m128i *)(store->offset_y + slot)),
+        _mm_load_si128((__m128i *)(store->box_min_y + slot)),
+        _mm_load_si128((__m128i *)(store->box_max_y + slot)),
+        delta_y)
+    );
+    __m128i collides = _mm_cmpeq_epi32(
+      _mm_and_si128(_mm_load_si128((__m128i *)(store->flags + slot)), collides_flag), collides_flag);
+    __m128i needs_sweep = _mm_and_si128(collides, crosses);
+
+    offset_entity_axis_sse2(store->abs_tile_x + slot, store->offset_x + slot, delta_x, needs_sweep);
+    offset_entity_axis_sse2(store->abs_tile_y + slot, store->offset_y + slot, delta_y, needs_sweep);
+
+    u32 sweep_mask = (u32)_mm_movemask_ps(_mm_castsi128_ps(needs_sweep));
+    if (sweep_mask) {
+      alignas(16) i32 lane_delta_x[4];
+      alignas(16) i32 lane_delta_y[4];
+      _mm_store_si128((__m128i *)lane_delta_x, delta_x);
+      _mm_store_si128((__m128i *)lane_delta_y, delta_y);
+
+      do {
+        u32 lane = find_least_significant_set_bit(sweep_mask).index;
+        add_entity_sweep(sweeps, slot + lane, lane_delta_x[lane], lane_delta_y[lane]);
+        sweep_mask &= sweep_mask - 1;
+      } while (sweep_mask);
+    }
+  }
+
+  integrate_entities_scalar(world, store, dt, slot, sweeps);
+}
+#endif
+
+// Moves every entity in store by its velocity for dt seconds. The sweep list
+// goes in temp_arena and is gone again by the time this returns.
+static void update_entities(World *world, EntityStore *store, f32 dt, MemoryArena *temp_arena) {
+  BEGIN_TIMED_BLOCK(UpdateEntities);
+
+  TemporaryMemory sweep_memory = begin_temporary_memory(temp_arena);
+  EntitySweepList sweeps = {};
+  sweeps.slots = PushArray(temp_arena, store->count, u32);
+  sweeps.delta_x = PushArray(temp_arena, store->count, i32);
+  sweeps.delta_y = PushArray(temp_arena, store->count, i32);
+
+#if defined(HANDMADE_FORCE_SCALAR_FILL)
+  integrate_entities_scalar(world, store, dt, 0, &sweeps);
+#else
+  integrate_entities_sse2(world, store, dt, &sweeps);
+#endif
+
+  BEGIN_TIMED_BLOCK(SweepEntities);
+  for (u32 sweep_idx = 0; sweep_idx < sweeps.count; ++sweep_idx) {
+    u32 slot = sweeps.slots[sweep_idx];
+
+    BoxMove move = world_move_box(world, get_entity_position(store, slot), get_entity_box(store, slot),
+      sweeps.delta_x[sweep_idx], sweeps.delta_y[sweep_idx]);
+    set_entity_position(store, slot, move.pos);
+
+    f32 hit_velocity_scale = (store->flags[slot] & EntityFlag_Bounces) ? -1.0f : 0.0f;
+    if (move.hit_x) {
+      store->velocity_x[slot] *= hit_velocity_scale;
+    }
+    if (move.hit_y) {
+      store->velocity_y[slot] *= hit_velocity_scale;
+    }
+  }
+  END_TIMED_BLOCK_COUNTED(SweepEntities, sweeps.count);
+
+  end_temporary_memory(sweep_memory);
+
+  END_TIMED_BLOCK_COUNTED(UpdateEntities, store->count);
+}
+
+// Bouncing entities whose boxes overlap swap velocities, which is an elastic
+// collision between equal masses, unless they're already moving apart
+static void bounce_entity_pairs(EntityStore *store, EntityPair *pairs, u32 pair_count) {
+  for (u32 pair_idx = 0; pair_idx < pair_count; ++pair_idx) {
+    u32 slot_a = pairs[pair_idx].slot_a;
+    u32 slot_b = pairs[pair_idx].slot_b;
+    if (!(store->flags[slot_a] & store->flags[slot_b] & EntityFlag_Bounces)) {
+      continue;
+    }
+
+    f32 distance_x = (f32)((i64)(store->abs_tile_x[slot_b] - store->abs_tile_x[slot_a]) * TILE_OFFSET_ONE +
+                           (store->offset_x[slot_b] - store->offset_x[slot_a]));
+    f32 distance_y = (f32)((i64)(store->abs_tile_y[slot_b] - store->abs_tile_y[slot_a]) * TILE_OFFSET_ONE +
+                           (store->offset_y[slot_b] - store->offset_y[slot_a]));
+    f32 closing_x = store->velocity_x[slot_b] - store->velocity_x[slot_a];
+    f32 closing_y = store->velocity_y[slot_b] - store->velocity_y[slot_a];
+
+    if (distance_x * closing_x + distance_y * closing_y < 0.0f) {
+      f32 velocity_x = store->velocity_x[slot_a];
+      f32 velocity_y = store->velocity_y[slot_a];
+      store->velocity_x[slot_a] = store->velocity_x[slot_b];
+      store->velocity_y[slot_a] = store->velocity_y[slot_b];
+      store->velocity_x[slot_b] = velocity_x;
+      store->velocity_y[slot_b] = velocity_y;
+    }
+  }
+}
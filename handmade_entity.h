@@ -0,0 +1,95 @@
+#if !defined(HANDMADE_ENTITY_H)
+#define HANDMADE_ENTITY_H
+
+// Refers to an entity for as long as it exists. Removing an entity moves its
+// index on to the next generation, so handles to it stop resolving instead of
+// finding whatever is added there next. The zero handle never resolves.
+struct EntityHandle {
+  u32 index;
+  u32 generation;
+};
+
+#define ENTITY_INVALID_SLOT 0xFFFFFFFF
+
+enum EntityFlag {
+  // Moved with world_move_box and stopped by solid tiles, otherwise entities
+  // fly straight through them
+  EntityFlag_Collides = (1 << 0),
+  // Velocity reverses along an axis that hits something instead of stopping
+  EntityFlag_Bounces = (1 << 1),
+};
+
+// Entities are filed by which square of 2^ENTITY_CHUNK_SHIFT tiles their
+// position is in, so finding the ones in an area only looks at the squares
+// it covers
+#define ENTITY_CHUNK_SHIFT 4
+
+// A square with entities in it. Squares without any aren't kept.
+struct EntityChunk {
+  i32 chunk_x;
+  i32 chunk_y;
+  u32 first_index; // Handle index, ENTITY_INVALID_SLOT when the hash slot is free
+};
+
+/*
+  Entities live in permanent storage as struct of arrays, one array per
+  component, and are packed: slots 0..count-1 are the live ones, so update
+  passes run straight through them a vector at a time. Removing an entity moves
+  the last one into its slot, which is why everything outside the store holds
+  EntityHandles and looks the slot up with get_entity_slot.
+*/
+struct EntityStore {
+  u32 capacity;
+  u32 count;
+
+  // Per handle index. A free index's slot is the next free index instead.
+  u32 *generations;
+  u32 *slots;
+  u32 first_free_index; // ENTITY_INVALID_SLOT when there are none
+  u32 index_count;      // Handle indexes that have been handed out so far
+
+  // Per handle index, the entity's neighbours in its chunk's list
+  // (ENTITY_INVALID_SLOT at either end). Only written back positions move an
+  // entity between chunks, so an EntityStore is only filed like this when it
+  // hands out handles.
+  u32 *chunk_next;
+  u32 *chunk_prev;
+
+  // Open addressing with linear probing from chunk to its list. Never holds
+  // more chunks than entities, and has twice as many slots as the store.
+  u32 chunk_shift; // 64 - log2(slot count)
+  u32 chunk_count;
+  EntityChunk *chunks;
+
+  // Per slot
+  u32 *handle_indices;
+  u32 *flags;
+
+  // WorldPosition
+  i32 *abs_tile_x;
+  i32 *abs_tile_y;
+  i32 *offset_x;
+  i32 *offset_y;
+
+  // Pixels per second
+  f32 *velocity_x;
+  f32 *velocity_y;
+
+  // CollisionBox
+  i32 *box_min_x;
+  i32 *box_min_y;
+  i32 *box_max_x;
+  i32 *box_max_y;
+};
+
+// Colliders that are crossing into new tiles this update, and how far each one
+// is moving (tile offset units). Filled by the integrate pass in transient
+// memory, then swept one by one.
+struct EntitySweepList {
+  u32 count;
+  u32 *slots;
+  i32 *delta_x;
+  i32 *delta_y;
+};
+
+#endif
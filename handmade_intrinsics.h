@@ -22,21 +22,64 @@ inline i32 f32_floor_to_i32(f32 val) {
   return result;
 }
 
-inline f32 sin(f32 angle) {
+inline f32 f32_sin(f32 angle) {
   f32 result = sinf(angle);
   return result;
 }
 
-inline f32 cos(f32 angle) {
+inline f32 f32_cos(f32 angle) {
   f32 result = cosf(angle);
   return result;
 }
 
-inline f32 atan2(f32 y, f32 x) {
+inline f32 f32_square_root(f32 val) {
+  f32 result = sqrtf(val);
+  return result;
+}
+
+inline f32 f32_atan2(f32 y, f32 x) {
   f32 result = atan2f(y, x);
   return result;
 }
 
+struct BitScanResult {
+  bool found;
+  u32 index;
+};
+
+inline BitScanResult find_least_significant_set_bit(u32 value) {
+  BitScanResult result = {};
+
+  if (value) {
+    result.found = true;
+    result.index = (u32)__builtin_ctz(value);
+  }
+
+  return result;
+}
+
+inline BitScanResult find_least_significant_set_bit(u64 value) {
+  BitScanResult result = {};
+
+  if (value) {
+    result.found = true;
+    result.index = (u32)__builtin_ctzll(value);
+  }
+
+  return result;
+}
+
+inline BitScanResult find_most_significant_set_bit(u64 value) {
+  BitScanResult result = {};
+
+  if (value) {
+    result.found = true;
+    result.index = 63 - (u32)__builtin_clzll(value);
+  }
+
+  return result;
+}
+
 
 #define HANDMADE_INTRINSICS_H
 #endif
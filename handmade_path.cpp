@@ -0,0 +1,924 @@
+/*
+  Pathfinding
+
+  A* over jump points (Harabor and Grastien's jump point search, the variant
+  that never cuts a corner). Straight and diagonal runs across open ground are
+  skipped over in one go, so only the tiles where the path might have to turn
+  become nodes. Walkability is read through a cursor over absolute tiles,
+  which moves between tile maps as runs cross their seams.
+*/
+// Every array is pushed onto arena, so the pathfinder lasts as long as the
+// memory it's in. A query that needs more than max_node_count jump points
+// fails.
+inline Pathfinder *allocate_pathfinder(MemoryArena *arena, World *world, u32 max_node_count) {
+  u32 slot_count = PATH_INITIAL_HASH_SLOT_COUNT;
+  while (slot_count < 2 * max_node_count) {
+    slot_count *= 2;
+  }
+
+  Pathfinder *pathfinder = PushStruct(arena, Pathfinder);
+  *pathfinder = {};
+  pathfinder->world = world;
+  pathfinder->max_node_count = max_node_count;
+  pathfinder->max_hash_slot_count = slot_count;
+  pathfinder->hash_slots = (PathHashSlot *)push_size_(arena, slot_count * sizeof(PathHashSlot), 64);
+  memset(pathfinder->hash_slots, 0, slot_count * sizeof(PathHashSlot));
+
+  pathfinder->node_x = PushArray(arena, max_node_count, i32);
+  pathfinder->node_y = PushArray(arena, max_node_count, i32);
+  pathfinder->node_cost = PushArray(arena, max_node_count, u32);
+  pathfinder->node_estimate = PushArray(arena, max_node_count, u32);
+  pathfinder->node_parent = PushArray(arena, max_node_count, u32);
+  pathfinder->node_heap_index = PushArray(arena, max_node_count, u32);
+  pathfinder->heap = PushArray(arena, max_node_count, u32);
+
+  return pathfinder;
+}
+
+// The tile map an absolute tile is in (0 when there isn't one), and where in
+// it the tile is
+inline TileMap *path_get_tile_map(Pathfinder *pathfinder, i32 abs_tile_x, i32 abs_tile_y, i32 *tile_x, i32 *tile_y) {
+  World *world = pathfinder->world;
+  i32 x = abs_tile_x - pathfinder->cursor_min_x;
+  i32 y = abs_tile_y - pathfinder->cursor_min_y;
+
+  if (!pathfinder->cursor_is_valid ||
+      (x < -world->count_x) || (x >= 2 * world->count_x) ||
+      (y < -world->count_y) || (y >= 2 * world->count_y))
+  {
+    WorldPosition pos = {abs_tile_x, abs_tile_y, 0, 0};
+    TileMapPosition tile_map_pos = get_tile_map_position(world, pos);
+
+    pathfinder->cursor_is_valid = true;
+    pathfinder->cursor_looked_up = 0;
+    pathfinder->cursor_min_x = abs_tile_x - tile_map_pos.tile_x;
+    pathfinder->cursor_min_y = abs_tile_y - tile_map_pos.tile_y;
+    x = tile_map_pos.tile_x;
+    y = tile_map_pos.tile_y;
+  }
+
+  i32 col = (x >= 0) + (x >= world->count_x);
+  i32 row = (y >= 0) + (y >= world->count_y);
+  *tile_x = x - (col - 1) * world->count_x;
+  *tile_y = y - (row - 1) * world->count_y;
+
+  u32 cursor_bit = 1 << (row * 3 + col);
+  if (!(pathfinder->cursor_looked_up & cursor_bit)) {
+    WorldPosition middle_pos = {pathfinder->cursor_min_x, pathfinder->cursor_min_y, 0, 0};
+    TileMapPosition middle = get_tile_map_position(world, middle_pos);
+    pathfinder->cursor_tile_maps[row][col] = world_get_tile_map(world,
+      middle.tile_map_x + col - 1, middle.tile_map_y + row - 1);
+    pathfinder->cursor_looked_up |= cursor_bit;
+  }
+
+  return pathfinder->cursor_tile_maps[row][col];
+}
+
+// Tiles outside of any tile map are solid, same as for collision
+inline bool path_is_walkable(Pathfinder *pathfinder, i32 abs_tile_x, i32 abs_tile_y) {
+  i32 tile_x, tile_y;
+  TileMap *tile_map = path_get_tile_map(pathfinder, abs_tile_x, abs_tile_y, &tile_x, &tile_y);
+
+  bool walkable = tile_map_is_point_empty(pathfinder->world, tile_map, tile_x, tile_y);
+  return walkable;
+}
+
+// Octile distance: diagonal steps for the short axis, straight for the rest
+inline u32 path_distance(i32 from_x, i32 from_y, i32 to_x, i32 to_y) {
+  u32 distance_x = (u32)((from_x < to_x) ? to_x - from_x : from_x - to_x);
+  u32 distance_y = (u32)((from_y < to_y) ? to_y - from_y : from_y - to_y);
+  u32 diagonal = (distance_x < distance_y) ? distance_x : distance_y;
+  u32 straight = distance_x + distance_y - 2 * diagonal;
+
+  return diagonal * PATH_DIAGONAL_COST + straight * PATH_STRAIGHT_COST;
+}
+
+/*
+  Open set
+*/
+// Lower estimate first, ties go to whichever is further along
+inline bool path_node_is_before(Pathfinder *pathfinder, u32 node_a, u32 node_b) {
+  u32 estimate_a = pathfinder->node_estimate[node_a];
+  u32 estimate_b = pathfinder->node_estimate[node_b];
+  bool before = (estimate_a < estimate_b) ||
+    ((estimate_a == estimate_b) && (pathfinder->node_cost[node_a] > pathfinder->node_cost[node_b]));
+
+  return before;
+}
+
+inline void path_heap_place(Pathfinder *pathfinder, u32 heap_idx, u32 node) {
+  pathfinder->heap[heap_idx] = node;
+  pathfinder->node_heap_index[node] = heap_idx;
+}
+
+static void path_heap_sift_up(Pathfinder *pathfinder, u32 heap_idx) {
+  u32 node = pathfinder->heap[heap_idx];
+
+  while (heap_idx > 0) {
+    u32 parent_idx = (heap_idx - 1) / 2;
+    u32 parent = pathfinder->heap[parent_idx];
+    if (!path_node_is_before(pathfinder, node, parent)) {
+      break;
+    }
+
+    path_heap_place(pathfinder, heap_idx, parent);
+    heap_idx = parent_idx;
+  }
+
+  path_heap_place(pathfinder, heap_idx, node);
+}
+
+static u32 path_heap_pop(Pathfinder *pathfinder) {
+  u32 result = pathfinder->heap[0];
+  pathfinder->node_heap_index[result] = PATH_INVALID_NODE;
+
+  u32 node = pathfinder->heap[--pathfinder->heap_count];
+  u32 heap_idx = 0;
+  if (pathfinder->heap_count > 0) {
+    for (;;) {
+      u32 child_idx = 2 * heap_idx + 1;
+      if (child_idx >= pathfinder->heap_count) {
+        break;
+      }
+      if ((child_idx + 1 < pathfinder->heap_count) &&
+          path_node_is_before(pathfinder, pathfinder->heap[child_idx + 1], pathfinder->heap[child_idx]))
+      {
+        ++child_idx;
+      }
+      if (!path_node_is_before(pathfinder, pathfinder->heap[child_idx], node)) {
+        break;
+      }
+
+      path_heap_place(pathfinder, heap_idx, pathfinder->heap[child_idx]);
+      heap_idx = child_idx;
+    }
+
+    path_heap_place(pathfinder, heap_idx, node);
+  }
+
+  return result;
+}
+
+inline u32 path_hash_slot_index(Pathfinder *pathfinder, i32 abs_tile_x, i32 abs_tile_y) {
+  u64 key = tile_map_hash_key(abs_tile_x, abs_tile_y);
+  u32 slot = (u32)((key * 11400714819323198485ull) >> pathfinder->hash_shift);
+
+  return slot;
+}
+
+// Moves on to a fresh stamp, which empties every slot. Stamps have to be
+// cleared by hand once every 4 billion.
+static void path_hash_next_stamp(Pathfinder *pathfinder) {
+  if (++pathfinder->query_stamp == 0) {
+    memset(pathfinder->hash_slots, 0, pathfinder->max_hash_slot_count * sizeof(PathHashSlot));
+    pathfinder->query_stamp = 1;
+  }
+}
+
+static void path_hash_use_slot_count(Pathfinder *pathfinder, u32 slot_count) {
+  pathfinder->hash_shift = 64 - find_least_significant_set_bit(slot_count).index;
+  pathfinder->hash_mask = slot_count - 1;
+}
+
+// Doubles the slots in use and puts every node back, under a new stamp
+static void grow_path_hash(Pathfinder *pathfinder) {
+  path_hash_next_stamp(pathfinder);
+  path_hash_use_slot_count(pathfinder, 2 * (pathfinder->hash_mask + 1));
+
+  for (u32 node = 0; node < pathfinder->node_count; ++node) {
+    u32 slot = path_hash_slot_index(pathfinder, pathfinder->node_x[node], pathfinder->node_y[node]);
+    while (pathfinder->hash_slots[slot].stamp == pathfinder->query_stamp) {
+      slot = (slot + 1) & pathfinder->hash_mask;
+    }
+
+    pathfinder->hash_slots[slot].stamp = pathfinder->query_stamp;
+    pathfinder->hash_slots[slot].node = node;
+  }
+}
+
+// The node for a tile, made if this query hasn't seen it yet (with *is_new
+// set). PATH_INVALID_NODE when the query is out of nodes.
+static u32 get_path_node(Pathfinder *pathfinder, i32 abs_tile_x, i32 abs_tile_y, bool *is_new) {
+  u32 slot = path_hash_slot_index(pathfinder, abs_tile_x, abs_tile_y);
+
+  while (pathfinder->hash_slots[slot].stamp == pathfinder->query_stamp) {
+    u32 node = pathfinder->hash_slots[slot].node;
+    if ((pathfinder->node_x[node] == abs_tile_x) && (pathfinder->node_y[node] == abs_tile_y)) {
+      *is_new = false;
+      return node;
+    }
+
+    slot = (slot + 1) & pathfinder->hash_mask;
+  }
+
+  if (pathfinder->node_count == pathfinder->max_node_count) {
+    return PATH_INVALID_NODE;
+  }
+
+  u32 node = pathfinder->node_count++;
+  pathfinder->node_x[node] = abs_tile_x;
+  pathfinder->node_y[node] = abs_tile_y;
+  pathfinder->node_parent[node] = PATH_INVALID_NODE;
+  pathfinder->node_heap_index[node] = PATH_INVALID_NODE;
+  pathfinder->hash_slots[slot].stamp = pathfinder->query_stamp;
+  pathfinder->hash_slots[slot].node = node;
+
+  // Keep it at most half full
+  if (2 * pathfinder->node_count > pathfinder->hash_mask + 1) {
+    grow_path_hash(pathfinder);
+  }
+
+  *is_new = true;
+  return node;
+}
+
+/*
+  Jumps
+
+  Each one starts on a walkable tile, steps in its direction and keeps going
+  until it reaches the goal or a tile where the path could have to turn (a
+  jump point), which it returns in *jump_x / *jump_y. False when it runs into
+  something first.
+*/
+// Along a row, up to 64 tiles at a time (as far as the tile map the run is in
+// goes) using the solid bits of the row and the rows either side of it
+static bool jump_horizontal(
+    Pathfinder *pathfinder, i32 x, i32 y, i32 direction_x,
+    PathTile goal, i32 *jump_x, i32 *jump_y
+  ) {
+  World *world = pathfinder->world;
+
+  for (;;) {
+    i32 next_x = x + direction_x;
+    i32 tile_x, tile_y, above_x, above_y, below_x, below_y;
+    TileMap *tile_map = path_get_tile_map(pathfinder, next_x, y, &tile_x, &tile_y);
+    TileMap *above = path_get_tile_map(pathfinder, next_x, y - 1, &above_x, &above_y);
+    TileMap *below = path_get_tile_map(pathfinder, next_x, y + 1, &below_x, &below_y);
+
+    // Bit i of the run is tile first_x + i
+    i32 run_tile_x = (direction_x > 0) ? tile_x : ((tile_x > 63) ? tile_x - 63 : 0);
+    i32 run_count = (direction_x > 0) ? world->count_x - tile_x : tile_x - run_tile_x + 1;
+    run_count = (run_count < 64) ? run_count : 64;
+    i32 first_x = next_x - tile_x + run_tile_x;
+    u64 run_mask = (run_count == 64) ? ~0ull : ((1ull << run_count) - 1);
+
+    u64 solid = tile_map_get_solid_run(world, tile_map, run_tile_x, tile_y);
+    u64 solid_above = tile_map_get_solid_run(world, above, run_tile_x, above_y);
+    u64 solid_below = tile_map_get_solid_run(world, below, run_tile_x, below_y);
+
+    // Whether the tile behind each one, above and below the row, is solid.
+    // The first tile's is in the run before this one.
+    u64 behind_above_edge = !path_is_walkable(pathfinder, x, y - 1);
+    u64 behind_below_edge = !path_is_walkable(pathfinder, x, y + 1);
+    u64 behind_above, behind_below;
+    if (direction_x > 0) {
+      behind_above = (solid_above << 1) | behind_above_edge;
+      behind_below = (solid_below << 1) | behind_below_edge;
+    } else {
+      behind_above = ((solid_above & run_mask) >> 1) | (behind_above_edge << (run_count - 1));
+      behind_below = ((solid_below & run_mask) >> 1) | (behind_below_edge << (run_count - 1));
+    }
+
+    // A side opens up that couldn't be reached past the wall behind it
+    u64 forced = (~solid_above & behind_above) | (~solid_below & behind_below);
+    u64 stops = (solid | forced) & run_mask;
+    if ((goal.abs_tile_y == y) && (goal.abs_tile_x >= first_x) && (goal.abs_tile_x < first_x + run_count)) {
+      stops |= 1ull << (goal.abs_tile_x - first_x);
+    }
+
+    if (stops) {
+      u32 stop_idx = (direction_x > 0) ?
+        find_least_significant_set_bit(stops).index : find_most_significant_set_bit(stops).index;
+      if ((solid >> stop_idx) & 1) {
+        return false;
+      }
+
+      *jump_x = first_x + (i32)stop_idx;
+      *jump_y = y;
+      return true;
+    }
+
+    x = (direction_x > 0) ? first_x + run_count - 1 : first_x;
+  }
+}
+
+// (direction_x, direction_y) is (+-1, 0) or (0, +-1)
+static bool jump_straight(
+    Pathfinder *pathfinder, i32 x, i32 y, i32 direction_x, i32 direction_y,
+    PathTile goal, i32 *jump_x, i32 *jump_y
+  ) {
+  if (direction_x) {
+    return jump_horizontal(pathfinder, x, y, direction_x, goal, jump_x, jump_y);
+  }
+
+  // Down a column a tile map at a time, reading the column and the ones
+  // either side of it straight out of their tile maps
+  World *world = pathfinder->world;
+  bool left_was_walkable = path_is_walkable(pathfinder, x - 1, y);
+  bool right_was_walkable = path_is_walkable(pathfinder, x + 1, y);
+
+  for (;;) {
+    i32 next_y = y + direction_y;
+    i32 tile_x, tile_y, left_x, left_y, right_x, right_y;
+    TileMap *tile_map = path_get_tile_map(pathfinder, x, next_y, &tile_x, &tile_y);
+    TileMap *left = path_get_tile_map(pathfinder, x - 1, next_y, &left_x, &left_y);
+    TileMap *right = path_get_tile_map(pathfinder, x + 1, next_y, &right_x, &right_y);
+    i32 step_count = (direction_y > 0) ? world->count_y - tile_y : tile_y + 1;
+
+    for (i32 step_idx = 0; step_idx < step_count; ++step_idx) {
+      i32 row = tile_y + step_idx * direction_y;
+      if (!tile_map_is_point_empty(world, tile_map, tile_x, row)) {
+        return false;
+      }
+
+      // A side opens up that couldn't be reached past the wall behind it
+      bool left_is_walkable = tile_map_is_point_empty(world, left, left_x, row);
+      bool right_is_walkable = tile_map_is_point_empty(world, right, right_x, row);
+      i32 abs_y = next_y + step_idx * direction_y;
+
+      if (((x == goal.abs_tile_x) && (abs_y == goal.abs_tile_y)) ||
+          (left_is_walkable && !left_was_walkable) ||
+          (right_is_walkable && !right_was_walkable))
+      {
+        *jump_x = x;
+        *jump_y = abs_y;
+        return true;
+      }
+
+      left_was_walkable = left_is_walkable;
+      right_was_walkable = right_is_walkable;
+    }
+
+    y = next_y + (step_count - 1) * direction_y;
+  }
+}
+
+// Both directions are +-1. A diagonal step needs both tiles it passes between
+// to be open.
+static bool jump_diagonal(
+    Pathfinder *pathfinder, i32 x, i32 y, i32 direction_x, i32 direction_y,
+    PathTile goal, i32 *jump_x, i32 *jump_y
+  ) {
+  for (;;) {
+    if (!path_is_walkable(pathfinder, x + direction_x, y) ||
+        !path_is_walkable(pathfinder, x, y + direction_y))
+    {
+      return false;
+    }
+
+    x += direction_x;
+    y += direction_y;
+
+    if (!path_is_walkable(pathfinder, x, y)) {
+      return false;
+    }
+
+    // A straight run from here that finds something makes this a turn
+    i32 ignored_x, ignored_y;
+    if (((x == goal.abs_tile_x) && (y == goal.abs_tile_y)) ||
+        jump_straight(pathfinder, x, y, direction_x, 0, goal, &ignored_x, &ignored_y) ||
+        jump_straight(pathfinder, x, y, 0, direction_y, goal, &ignored_x, &ignored_y))
+    {
+      *jump_x = x;
+      *jump_y = y;
+      return true;
+    }
+  }
+}
+
+/*
+  Queries
+*/
+// Finds the shortest path from one tile to another. Returns how many
+// waypoints it has (0 when there's no path or the query ran out of nodes),
+// and writes the first max_waypoint_count of them to waypoints, starting with
+// from and ending with to. Consecutive waypoints are joined by a straight or
+// a diagonal line of walkable tiles.
+inline u32 find_path(Pathfinder *pathfinder, PathTile from, PathTile to, PathTile *waypoints, u32 max_waypoint_count) {
+  BEGIN_TIMED_BLOCK(FindPath);
+
+  path_hash_next_stamp(pathfinder);
+  path_hash_use_slot_count(pathfinder, PATH_INITIAL_HASH_SLOT_COUNT);
+  pathfinder->node_count = 0;
+  pathfinder->heap_count = 0;
+  pathfinder->cursor_is_valid = false;
+
+  u32 waypoint_count = 0;
+
+  if (path_is_walkable(pathfinder, from.abs_tile_x, from.abs_tile_y) &&
+      path_is_walkable(pathfinder, to.abs_tile_x, to.abs_tile_y))
+  {
+    bool is_new;
+    u32 start = get_path_node(pathfinder, from.abs_tile_x, from.abs_tile_y, &is_new);
+    pathfinder->node_cost[start] = 0;
+    pathfinder->node_estimate[start] = path_distance(from.abs_tile_x, from.abs_tile_y, to.abs_tile_x, to.abs_tile_y);
+    pathfinder->heap_count = 1;
+    path_heap_place(pathfinder, 0, start);
+
+    u32 goal = PATH_INVALID_NODE;
+    bool is_out_of_nodes = false;
+
+    while ((pathfinder->heap_count > 0) && (goal == PATH_INVALID_NODE) && !is_out_of_nodes) {
+      u32 node = path_heap_pop(pathfinder);
+      i32 x = pathfinder->node_x[node];
+      i32 y = pathfinder->node_y[node];
+
+      if ((x == to.abs_tile_x) && (y == to.abs_tile_y)) {
+        goal = node;
+        break;
+      }
+
+      // Directions worth jumping in, given the one this node was reached from.
+      // The start has nothing behind it and tries all eight.
+      i32 directions[8][2];
+      u32 direction_count = 0;
+      u32 parent = pathfinder->node_parent[node];
+      if (parent == PATH_INVALID_NODE) {
+        for (i32 direction_y = -1; direction_y <= 1; ++direction_y) {
+          for (i32 direction_x = -1; direction_x <= 1; ++direction_x) {
+            if (direction_x || direction_y) {
+              directions[direction_count][0] = direction_x;
+              directions[direction_count][1] = direction_y;
+              ++direction_count;
+            }
+          }
+        }
+      } else {
+        i32 parent_x = pathfinder->node_x[parent];
+        i32 parent_y = pathfinder->node_y[parent];
+        i32 direction_x = (x > parent_x) - (x < parent_x);
+        i32 direction_y = (y > parent_y) - (y < parent_y);
+
+        // Straight ahead, plus: for a diagonal, both of its straight parts; for
+        // a straight run, turning off to either side, which opens up once a
+        // wall alongside it ends
+        i32 pruned[5][2] = {
+          {direction_x, direction_y},
+          {direction_x, 0},
+          {0, direction_y},
+        };
+        direction_count = 3;
+        if (!direction_y) {
+          i32 sides[5][2] = {{direction_x, 0}, {direction_x, 1}, {direction_x, -1}, {0, 1}, {0, -1}};
+          memcpy(pruned, sides, sizeof(pruned));
+          direction_count = 5;
+        } else if (!direction_x) {
+          i32 sides[5][2] = {{0, direction_y}, {1, direction_y}, {-1, direction_y}, {1, 0}, {-1, 0}};
+          memcpy(pruned, sides, sizeof(pruned));
+          direction_count = 5;
+        }
+        memcpy(directions, pruned, direction_count * sizeof(directions[0]));
+      }
+
+      for (u32 direction_idx = 0; direction_idx < direction_count; ++direction_idx) {
+        i32 direction_x = directions[direction_idx][0];
+        i32 direction_y = directions[direction_idx][1];
+
+        i32 jump_x, jump_y;
+        bool jumped = (direction_x && direction_y) ?
+          jump_diagonal(pathfinder, x, y, direction_x, direction_y, to, &jump_x, &jump_y) :
+          jump_straight(pathfinder, x, y, direction_x, direction_y, to, &jump_x, &jump_y);
+        if (!jumped) {
+          continue;
+        }
+
+        u32 successor = get_path_node(pathfinder, jump_x, jump_y, &is_new);
+        if (successor == PATH_INVALID_NODE) {
+          is_out_of_nodes = true;
+          break;
+        }
+
+        u32 cost = pathfinder->node_cost[node] + path_distance(x, y, jump_x, jump_y);
+        if (is_new) {
+          pathfinder->node_cost[successor] = cost;
+          pathfinder->node_estimate[successor] = cost + path_distance(jump_x, jump_y, to.abs_tile_x, to.abs_tile_y);
+          pathfinder->node_parent[successor] = node;
+          path_heap_place(pathfinder, pathfinder->heap_count++, successor);
+          path_heap_sift_up(pathfinder, pathfinder->heap_count - 1);
+        } else if ((pathfinder->node_heap_index[successor] != PATH_INVALID_NODE) &&
+                   (cost < pathfinder->node_cost[successor]))
+        {
+          // Still open and now cheaper. The heuristic is consistent, so
+          // nodes that have been expanded never get cheaper.
+          pathfinder->node_estimate[successor] -= pathfinder->node_cost[successor] - cost;
+          pathfinder->node_cost[successor] = cost;
+          pathfinder->node_parent[successor] = node;
+          path_heap_sift_up(pathfinder, pathfinder->node_heap_index[successor]);
+        }
+      }
+    }
+
+    if (goal != PATH_INVALID_NODE) {
+      for (u32 node = goal; node != PATH_INVALID_NODE; node = pathfinder->node_parent[node]) {
+        ++waypoint_count;
+      }
+
+      u32 waypoint_idx = waypoint_count;
+      for (u32 node = goal; node != PATH_INVALID_NODE; node = pathfinder->node_parent[node]) {
+        --waypoint_idx;
+        if (waypoint_idx < max_waypoint_count) {
+          waypoints[waypoint_idx].abs_tile_x = pathfinder->node_x[node];
+          waypoints[waypoint_idx].abs_tile_y = pathfinder->node_y[node];
+        }
+      }
+    }
+  }
+
+  END_TIMED_BLOCK(FindPath);
+  return waypoint_count;
+}
+
+/*
+  Flow fields
+
+  Dijkstra out from the goal over a dense copy of the world's walkability.
+  Each tile points at the neighbour its cheapest way to the goal goes
+  through, so the directions form a tree rooted at the goal. When a tile
+  changes, only what it can affect is redone: a tile that opens up can only
+  make things cheaper, which spreads out from it, and a tile that closes only
+  breaks the part of the tree hanging off it.
+*/
+global_variable const i32 flow_direction_x[FLOW_DIRECTION_COUNT] = {1, 1, 0, -1, -1, -1, 0, 1};
+global_variable const i32 flow_direction_y[FLOW_DIRECTION_COUNT] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+// Every array is pushed onto arena. Each field covers (2 * tile_map_radius + 1)
+// squared tile maps.
+inline FlowFieldCache *allocate_flow_field_cache(MemoryArena *arena, World *world, u32 field_count, i32 tile_map_radius) {
+  FlowFieldCache *cache = PushStruct(arena, FlowFieldCache);
+  *cache = {};
+  cache->world = world;
+  cache->tile_map_radius = tile_map_radius;
+  cache->width = (2 * tile_map_radius + 1) * world->count_x;
+  cache->height = (2 * tile_map_radius + 1) * world->count_y;
+  cache->tile_count = (u32)(cache->width * cache->height);
+
+  cache->field_count = field_count;
+  cache->fields = PushArray(arena, field_count, FlowField);
+  for (u32 field_idx = 0; field_idx < field_count; ++field_idx) {
+    FlowField *field = cache->fields + field_idx;
+    *field = {};
+    field->costs = PushArray(arena, cache->tile_count, u32);
+    field->directions = PushArray(arena, cache->tile_count, u8);
+    field->walkable = PushArray(arena, cache->tile_count, u8);
+  }
+
+  cache->heap = PushArray(arena, cache->tile_count, u32);
+  cache->heap_index = PushArray(arena, cache->tile_count, u32);
+  cache->invalid_tiles = PushArray(arena, cache->tile_count, u32);
+  memset(cache->heap_index, 0xFF, cache->tile_count * sizeof(u32));
+
+  return cache;
+}
+
+inline void flow_heap_place(FlowFieldCache *cache, u32 heap_idx, u32 tile) {
+  cache->heap[heap_idx] = tile;
+  cache->heap_index[tile] = heap_idx;
+}
+
+// Adds tile to the heap, or moves it up after its cost went down
+static void flow_heap_push(FlowFieldCache *cache, FlowField *field, u32 tile) {
+  u32 heap_idx = cache->heap_index[tile];
+  if (heap_idx == PATH_INVALID_NODE) {
+    heap_idx = cache->heap_count++;
+  }
+
+  u32 cost = field->costs[tile];
+  while (heap_idx > 0) {
+    u32 parent_idx = (heap_idx - 1) / 2;
+    u32 parent = cache->heap[parent_idx];
+    if (field->costs[parent] <= cost) {
+      break;
+    }
+
+    flow_heap_place(cache, heap_idx, parent);
+    heap_idx = parent_idx;
+  }
+
+  flow_heap_place(cache, heap_idx, tile);
+}
+
+static u32 flow_heap_pop(FlowFieldCache *cache, FlowField *field) {
+  u32 top = cache->heap[0];
+  cache->heap_index[top] = PATH_INVALID_NODE;
+
+  u32 tile = cache->heap[--cache->heap_count];
+  u32 cost = field->costs[tile];
+  u32 heap_idx = 0;
+
+  if (cache->heap_count) {
+    for (;;) {
+      u32 child_idx = 2 * heap_idx + 1;
+      if (child_idx >= cache->heap_count) {
+        break;
+      }
+      if ((child_idx + 1 < cache->heap_count) &&
+          (field->costs[cache->heap[child_idx + 1]] < field->costs[cache->heap[child_idx]])) {
+        ++child_idx;
+      }
+
+      u32 child = cache->heap[child_idx];
+      if (field->costs[child] >= cost) {
+        break;
+      }
+
+      flow_heap_place(cache, heap_idx, child);
+      heap_idx = child_idx;
+    }
+
+    flow_heap_place(cache, heap_idx, tile);
+  }
+
+  return top;
+}
+
+// Whether the step from (x, y) in field coordinates along direction can be
+// taken. A diagonal step needs both tiles it passes between to be open.
+inline bool flow_field_can_step(FlowFieldCache *cache, FlowField *field, i32 x, i32 y, u32 direction) {
+  i32 to_x = x + flow_direction_x[direction];
+  i32 to_y = y + flow_direction_y[direction];
+
+  if ((to_x < 0) || (to_x >= cache->width) || (to_y < 0) || (to_y >= cache->height) ||
+      !field->walkable[to_y * cache->width + to_x])
+  {
+    return false;
+  }
+
+  bool can_step = (direction & 1) == 0 ||
+    (field->walkable[y * cache->width + to_x] && field->walkable[to_y * cache->width + x]);
+  return can_step;
+}
+
+inline u32 flow_step_cost(u32 direction) {
+  u32 cost = (direction & 1) ? PATH_DIAGONAL_COST : PATH_STRAIGHT_COST;
+  return cost;
+}
+
+// Dijkstra from whatever is in the heap, lowering costs as it goes
+static void flow_field_integrate(FlowFieldCache *cache, FlowField *field) {
+  while (cache->heap_count) {
+    u32 tile = flow_heap_pop(cache, field);
+    i32 x = (i32)(tile % (u32)cache->width);
+    i32 y = (i32)(tile / (u32)cache->width);
+    u32 cost = field->costs[tile];
+
+    for (u32 direction = 0; direction < FLOW_DIRECTION_COUNT; ++direction) {
+      if (!flow_field_can_step(cache, field, x, y, direction)) {
+        continue;
+      }
+
+      u32 neighbour = (u32)((y + flow_direction_y[direction]) * cache->width + x + flow_direction_x[direction]);
+      u32 neighbour_cost = cost + flow_step_cost(direction);
+      if (neighbour_cost < field->costs[neighbour]) {
+        field->costs[neighbour] = neighbour_cost;
+        field->directions[neighbour] = (u8)((direction + FLOW_DIRECTION_COUNT / 2) % FLOW_DIRECTION_COUNT);
+        flow_heap_push(cache, field, neighbour);
+      }
+    }
+  }
+}
+
+// Takes the cheapest way to the goal through a neighbour, if that's cheaper
+// than the tile's own, and queues the tile to pass it on
+static void flow_field_pull_from_neighbours(FlowFieldCache *cache, FlowField *field, i32 x, i32 y) {
+  u32 tile = (u32)(y * cache->width + x);
+  if (!field->walkable[tile]) {
+    return;
+  }
+
+  bool is_goal = ((x + field->min_x) == field->goal.abs_tile_x) && ((y + field->min_y) == field->goal.abs_tile_y);
+  u32 best_cost = is_goal ? 0 : field->costs[tile];
+  u8 best_direction = is_goal ? FLOW_DIRECTION_NONE : field->directions[tile];
+
+  for (u32 direction = 0; direction < FLOW_DIRECTION_COUNT; ++direction) {
+    if (!flow_field_can_step(cache, field, x, y, direction)) {
+      continue;
+    }
+
+    u32 neighbour = (u32)((y + flow_direction_y[direction]) * cache->width + x + flow_direction_x[direction]);
+    u32 neighbour_cost = field->costs[neighbour];
+    if ((neighbour_cost != FLOW_UNREACHABLE) && (neighbour_cost + flow_step_cost(direction) < best_cost)) {
+      best_cost = neighbour_cost + flow_step_cost(direction);
+      best_direction = (u8)direction;
+    }
+  }
+
+  if (best_cost < field->costs[tile]) {
+    field->costs[tile] = best_cost;
+    field->directions[tile] = best_direction;
+    flow_heap_push(cache, field, tile);
+  }
+}
+
+static void build_flow_field(FlowFieldCache *cache, FlowField *field, PathTile goal) {
+  BEGIN_TIMED_BLOCK(BuildFlowField);
+
+  World *world = cache->world;
+  WorldPosition goal_pos = {goal.abs_tile_x, goal.abs_tile_y, 0, 0};
+  TileMapPosition goal_tile_map_pos = get_tile_map_position(world, goal_pos);
+
+  field->is_valid = true;
+  field->goal = goal;
+  field->min_x = goal.abs_tile_x - goal_tile_map_pos.tile_x - cache->tile_map_radius * world->count_x;
+  field->min_y = goal.abs_tile_y - goal_tile_map_pos.tile_y - cache->tile_map_radius * world->count_y;
+
+  // Copy the world's walkability one tile map at a time
+  i32 tile_maps_across = 2 * cache->tile_map_radius + 1;
+  for (i32 map_row = 0; map_row < tile_maps_across; ++map_row) {
+    for (i32 map_col = 0; map_col < tile_maps_across; ++map_col) {
+      TileMap *tile_map = world_get_tile_map(world,
+        goal_tile_map_pos.tile_map_x + map_col - cache->tile_map_radius,
+        goal_tile_map_pos.tile_map_y + map_row - cache->tile_map_radius);
+
+      for (i32 tile_y = 0; tile_y < world->count_y; ++tile_y) {
+        u8 *walkable = field->walkable + (map_row * world->count_y + tile_y) * cache->width + map_col * world->count_x;
+        for (i32 tile_x = 0; tile_x < world->count_x; ++tile_x) {
+          walkable[tile_x] = tile_map_is_point_empty(world, tile_map, tile_x, tile_y);
+        }
+      }
+    }
+  }
+
+  memset(field->costs, 0xFF, cache->tile_count * sizeof(u32));
+  memset(field->directions, FLOW_DIRECTION_NONE, cache->tile_count);
+
+  flow_field_pull_from_neighbours(cache, field, goal.abs_tile_x - field->min_x, goal.abs_tile_y - field->min_y);
+  flow_field_integrate(cache, field);
+
+  END_TIMED_BLOCK_COUNTED(BuildFlowField, cache->tile_count);
+}
+
+// The field for goal, built over the least recently used one when it isn't
+// cached. Stays valid until a field for a goal that isn't cached is asked for.
+inline FlowField *get_flow_field(FlowFieldCache *cache, PathTile goal) {
+  ++cache->use_clock;
+
+  FlowField *result = 0;
+  for (u32 field_idx = 0; field_idx < cache->field_count; ++field_idx) {
+    FlowField *field = cache->fields + field_idx;
+    if (field->is_valid &&
+        (field->goal.abs_tile_x == goal.abs_tile_x) && (field->goal.abs_tile_y == goal.abs_tile_y))
+    {
+      result = field;
+      break;
+    }
+
+    if (!result || !field->is_valid || (result->is_valid && (field->last_used < result->last_used))) {
+      result = field;
+    }
+  }
+
+  if (!result->is_valid ||
+      (result->goal.abs_tile_x != goal.abs_tile_x) || (result->goal.abs_tile_y != goal.abs_tile_y))
+  {
+    build_flow_field(cache, result, goal);
+  }
+
+  result->last_used = cache->use_clock;
+  return result;
+}
+
+// Direction to step from an absolute tile to get closer to the goal, one of
+// the FLOW_DIRECTIONs. FLOW_DIRECTION_NONE at the goal, where it can't be
+// reached from, and outside of the field.
+inline u32 get_flow_direction(FlowFieldCache *cache, FlowField *field, i32 abs_tile_x, i32 abs_tile_y) {
+  i32 x = abs_tile_x - field->min_x;
+  i32 y = abs_tile_y - field->min_y;
+
+  u32 direction = FLOW_DIRECTION_NONE;
+  if ((x >= 0) && (x < cache->width) && (y >= 0) && (y < cache->height)) {
+    direction = field->directions[y * cache->width + x];
+  }
+
+  return direction;
+}
+
+// Marks the tile and every tile whose way to the goal goes through it as
+// unreachable, adding them to invalid_tiles
+static u32 flow_field_cut_subtree(FlowFieldCache *cache, FlowField *field, u32 root, u32 invalid_count) {
+  if (field->costs[root] == FLOW_UNREACHABLE) {
+    return invalid_count;
+  }
+
+  u32 first_idx = invalid_count;
+  field->costs[root] = FLOW_UNREACHABLE;
+  field->directions[root] = FLOW_DIRECTION_NONE;
+  cache->invalid_tiles[invalid_count++] = root;
+
+  for (u32 invalid_idx = first_idx; invalid_idx < invalid_count; ++invalid_idx) {
+    u32 tile = cache->invalid_tiles[invalid_idx];
+    i32 x = (i32)(tile % (u32)cache->width);
+    i32 y = (i32)(tile / (u32)cache->width);
+
+    // Neighbours that step back along this direction to get here
+    for (u32 direction = 0; direction < FLOW_DIRECTION_COUNT; ++direction) {
+      i32 child_x = x + flow_direction_x[direction];
+      i32 child_y = y + flow_direction_y[direction];
+      if ((child_x < 0) || (child_x >= cache->width) || (child_y < 0) || (child_y >= cache->height)) {
+        continue;
+      }
+
+      u32 child = (u32)(child_y * cache->width + child_x);
+      if ((field->costs[child] != FLOW_UNREACHABLE) &&
+          (field->directions[child] == (direction + FLOW_DIRECTION_COUNT / 2) % FLOW_DIRECTION_COUNT))
+      {
+        field->costs[child] = FLOW_UNREACHABLE;
+        field->directions[child] = FLOW_DIRECTION_NONE;
+        cache->invalid_tiles[invalid_count++] = child;
+      }
+    }
+  }
+
+  return invalid_count;
+}
+
+// Call after changing whether an absolute tile is solid, to bring every cached
+// field that covers it up to date
+static void update_flow_fields_for_tile(FlowFieldCache *cache, i32 abs_tile_x, i32 abs_tile_y) {
+  BEGIN_TIMED_BLOCK(UpdateFlowFields);
+
+  WorldPosition pos = {abs_tile_x, abs_tile_y, 0, 0};
+  bool walkable = world_is_point_empty(cache->world, pos);
+
+  for (u32 field_idx = 0; field_idx < cache->field_count; ++field_idx) {
+    FlowField *field = cache->fields + field_idx;
+    i32 x = abs_tile_x - field->min_x;
+    i32 y = abs_tile_y - field->min_y;
+    if (!field->is_valid ||
+        (x < 0) || (x >= cache->width) || (y < 0) || (y >= cache->height))
+    {
+      continue;
+    }
+
+    u32 tile = (u32)(y * cache->width + x);
+    if (field->walkable[tile] == walkable) {
+      continue;
+    }
+    field->walkable[tile] = walkable;
+
+    if (walkable) {
+      // It can be stepped through now, and the orthogonal neighbours can step
+      // diagonally past its corners
+      flow_field_pull_from_neighbours(cache, field, x, y);
+      for (u32 direction = 0; direction < FLOW_DIRECTION_COUNT; direction += 2) {
+        i32 neighbour_x = x + flow_direction_x[direction];
+        i32 neighbour_y = y + flow_direction_y[direction];
+        if ((neighbour_x >= 0) && (neighbour_x < cache->width) && (neighbour_y >= 0) && (neighbour_y < cache->height)) {
+          flow_field_pull_from_neighbours(cache, field, neighbour_x, neighbour_y);
+        }
+      }
+    } else {
+      // Everything that went through the tile, or diagonally past one of its
+      // corners, has to find another way
+      u32 invalid_count = flow_field_cut_subtree(cache, field, tile, 0);
+      for (u32 direction = 0; direction < FLOW_DIRECTION_COUNT; direction += 2) {
+        i32 neighbour_x = x + flow_direction_x[direction];
+        i32 neighbour_y = y + flow_direction_y[direction];
+        if ((neighbour_x < 0) || (neighbour_x >= cache->width) || (neighbour_y < 0) || (neighbour_y >= cache->height)) {
+          continue;
+        }
+
+        u32 neighbour = (u32)(neighbour_y * cache->width + neighbour_x);
+        u32 neighbour_direction = field->directions[neighbour];
+        if ((neighbour_direction & 1) && (neighbour_direction != FLOW_DIRECTION_NONE) &&
+            ((neighbour_x + flow_direction_x[neighbour_direction] == x) ||
+             (neighbour_y + flow_direction_y[neighbour_direction] == y)))
+        {
+          invalid_count = flow_field_cut_subtree(cache, field, neighbour, invalid_count);
+        }
+      }
+
+      for (u32 invalid_idx = 0; invalid_idx < invalid_count; ++invalid_idx) {
+        u32 invalid_tile = cache->invalid_tiles[invalid_idx];
+        flow_field_pull_from_neighbours(cache, field,
+          (i32)(invalid_tile % (u32)cache->width), (i32)(invalid_tile / (u32)cache->width));
+      }
+    }
+
+    flow_field_integrate(cache, field);
+  }
+
+  END_TIMED_BLOCK(UpdateFlowFields);
+}
+
+#if HANDMADE_INTERNAL
+// Whether field has the costs building it from scratch would give it now, to
+// check update_flow_fields_for_tile with. The rebuild is pushed onto arena.
+// Only costs are compared: where two ways to the goal cost the same, which
+// one a tile points along depends on the order the tiles were reached in.
+static bool flow_field_matches_rebuild(FlowFieldCache *cache, FlowField *field, MemoryArena *arena) {
+  TemporaryMemory check_memory = begin_temporary_memory(arena);
+
+  FlowField *rebuilt = PushStruct(arena, FlowField);
+  *rebuilt = {};
+  rebuilt->costs = PushArray(arena, cache->tile_count, u32);
+  rebuilt->directions = PushArray(arena, cache->tile_count, u8);
+  rebuilt->walkable = PushArray(arena, cache->tile_count, u8);
+  build_flow_field(cache, rebuilt, field->goal);
+
+  bool matches = (memcmp(rebuilt->walkable, field->walkable, cache->tile_count) == 0) &&
+                 (memcmp(rebuilt->costs, field->costs, cache->tile_count * sizeof(u32)) == 0);
+
+  end_temporary_memory(check_memory);
+  return matches;
+}
+#endif
@@ -0,0 +1,116 @@
+#if !defined(HANDMADE_PATH_H)
+#define HANDMADE_PATH_H
+
+// A tile in the world's absolute tile coordinates
+struct PathTile {
+  i32 abs_tile_x;
+  i32 abs_tile_y;
+};
+
+// Costs of a step, in the ratio of a tile's side to its diagonal
+#define PATH_STRAIGHT_COST 70
+#define PATH_DIAGONAL_COST 99
+
+#define PATH_INVALID_NODE 0xFFFFFFFF
+#define PATH_INITIAL_HASH_SLOT_COUNT 1024
+
+struct PathHashSlot {
+  u32 stamp;
+  u32 node;
+};
+
+/*
+  Pathfinding over the tile grid, 8 way, without cutting the corners of solid
+  tiles. Answers any number of queries with the memory it was made with: the
+  tile to node hash is stamped with the query it belongs to, so nothing has to
+  be cleared between queries.
+*/
+struct Pathfinder {
+  World *world;
+
+  u32 max_node_count;
+  u32 query_stamp;
+
+  // Open addressing from tile to node. A slot belongs to the current query
+  // only when its stamp matches query_stamp. Each query starts out using the
+  // first PATH_INITIAL_HASH_SLOT_COUNT slots and doubles that as it finds
+  // more nodes, so small queries stay in cache.
+  u32 max_hash_slot_count;
+  u32 hash_shift; // 64 - log2(slot count in use)
+  u32 hash_mask;
+  PathHashSlot *hash_slots;
+
+  // Jump points found by the current query
+  u32 node_count;
+  i32 *node_x;
+  i32 *node_y;
+  u32 *node_cost;       // From the start
+  u32 *node_estimate;   // node_cost plus the heuristic to the goal
+  u32 *node_parent;
+  u32 *node_heap_index; // PATH_INVALID_NODE once it's been expanded
+
+  // Open set, a binary heap of nodes ordered by node_estimate
+  u32 heap_count;
+  u32 *heap;
+
+  // The block of 3x3 tile maps around where walkability was last read (0
+  // where there's no tile map), so tests along a seam don't go back to the
+  // world's hash. Each is looked up the first time it's needed.
+  // cursor_min_x/y is the middle tile map's first tile. Reset at the start of
+  // every query.
+  bool cursor_is_valid;
+  u32 cursor_looked_up; // Bit row * 3 + col set once that one has been found
+  TileMap *cursor_tile_maps[3][3];
+  i32 cursor_min_x;
+  i32 cursor_min_y;
+};
+
+// Steps a flow field can point along, counterclockwise from +x. Indices into
+// flow_direction_x/y.
+#define FLOW_DIRECTION_COUNT 8
+#define FLOW_DIRECTION_NONE 8
+#define FLOW_UNREACHABLE 0xFFFFFFFF
+
+/*
+  Which way to step from every tile to get to one goal tile, for any number of
+  agents heading to the same place. Covers the square of tile maps within
+  FlowFieldCache::tile_map_radius of the goal's, as one dense grid in absolute
+  tile coordinates. Follows the same rules as the Pathfinder: 8 way, no
+  cutting corners.
+*/
+struct FlowField {
+  bool is_valid;
+  PathTile goal;
+  u32 last_used;
+
+  // Absolute tile of the field's first tile
+  i32 min_x;
+  i32 min_y;
+
+  u32 *costs;     // To the goal, FLOW_UNREACHABLE when there's no way there
+  u8 *directions; // FLOW_DIRECTION_NONE at the goal and where costs is FLOW_UNREACHABLE
+  u8 *walkable;   // The world's tiles as of the last build or update
+};
+
+struct FlowFieldCache {
+  World *world;
+
+  i32 tile_map_radius;
+  i32 width;
+  i32 height;
+  u32 tile_count;
+
+  // Least recently used field is rebuilt for a goal that isn't cached
+  u32 use_clock;
+  u32 field_count;
+  FlowField *fields;
+
+  // Shared by whichever field is being integrated. heap_index is
+  // PATH_INVALID_NODE for every tile that isn't in the heap.
+  u32 heap_count;
+  u32 *heap;
+  u32 *heap_index;
+  u32 *invalid_tiles;
+};
+
+#endif
@@ -0,0 +1,846 @@
+#include <immintrin.h>
+#include <string.h> // memcpy
+
+/*
+  Span fill kernels
+
+  Every flat color rectangle is a run of rows, and every row is a span of
+  identical u32 pixels. The kernels below fill one span. The wide kernels write
+  the unaligned head and tail with a single unaligned store each (overlapping
+  pixels just get the same color twice) so the stores in the middle are aligned.
+*/
+#define SPAN_FILL(name) void name(u32 *dest, i32 count, u32 color)
+typedef SPAN_FILL(SpanFill);
+
+// Blends count premultiplied source pixels over dest:
+//   dest = source + dest * (255 - source_alpha) / 255
+#define BLEND_ROW(name) void name(u32 *dest, u32 *source, i32 count)
+typedef BLEND_ROW(BlendRow);
+
+struct RenderKernels {
+  SpanFill *fill;
+  BlendRow *blend_row;
+};
+
+// Picked on first use. Globals get reset whenever the game code is reloaded,
+// which just means the cpu gets checked again.
+global_variable RenderKernels global_render_kernels;
+
+
+// The plain loop rectangles were always filled with. Kept as the fallback and
+// as the baseline to measure the wide kernels against.
+static SPAN_FILL(span_fill_scalar) {
+  for (i32 idx = 0; idx < count; ++idx) {
+    *dest++ = color;
+  }
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+static SPAN_FILL(span_fill_sse2) {
+  if (count < 4) {
+    span_fill_scalar(dest, count, color);
+    return;
+  }
+
+  __m128i wide_color = _mm_set1_epi32((i32)color);
+  u32 *end = dest + count;
+
+  _mm_storeu_si128((__m128i *)dest, wide_color);
+  u32 *aligned = (u32 *)(((uintptr_t)dest + 16) & ~(uintptr_t)15);
+
+  for (; aligned + 16 <= end; aligned += 16) {
+    _mm_store_si128((__m128i *)aligned + 0, wide_color);
+    _mm_store_si128((__m128i *)aligned + 1, wide_color);
+    _mm_store_si128((__m128i *)aligned + 2, wide_color);
+    _mm_store_si128((__m128i *)aligned + 3, wide_color);
+  }
+
+  for (; aligned + 4 <= end; aligned += 4) {
+    _mm_store_si128((__m128i *)aligned, wide_color);
+  }
+
+  _mm_storeu_si128((__m128i *)(end - 4), wide_color);
+}
+
+__attribute__((target("avx2")))
+static SPAN_FILL(span_fill_avx2) {
+  if (count < 8) {
+    span_fill_sse2(dest, count, color);
+    return;
+  }
+
+  __m256i wide_color = _mm256_set1_epi32((i32)color);
+  u32 *end = dest + count;
+
+  _mm256_storeu_si256((__m256i *)dest, wide_color);
+  u32 *aligned = (u32 *)(((uintptr_t)dest + 32) & ~(uintptr_t)31);
+
+  for (; aligned + 16 <= end; aligned += 16) {
+    _mm256_store_si256((__m256i *)aligned + 0, wide_color);
+    _mm256_store_si256((__m256i *)aligned + 1, wide_color);
+  }
+
+  if (aligned + 8 <= end) {
+    _mm256_store_si256((__m256i *)aligned, wide_color);
+  }
+
+  _mm256_storeu_si256((__m256i *)(end - 8), wide_color);
+}
+#endif
+
+// (x + 128 + ((x + 128) >> 8)) >> 8 is x / 255 rounded to nearest for every
+// x in [0, 255 * 255], which is all that blending ever divides.
+inline u32 div_255(u32 value) {
+  value += 128;
+  u32 result = (value + (value >> 8)) >> 8;
+  return result;
+}
+
+inline u32 blend_premultiplied(u32 source, u32 dest) {
+  u32 inv_alpha = 255 - (source >> 24);
+  u32 result = 0;
+
+  for (u32 shift = 0; shift < 32; shift += 8) {
+    u32 channel = ((source >> shift) & 0xFF) + div_255(((dest >> shift) & 0xFF) * inv_alpha);
+    if (channel > 255) {
+      channel = 255;
+    }
+    result |= channel << shift;
+  }
+
+  return result;
+}
+
+static BLEND_ROW(blend_row_scalar) {
+  for (i32 idx = 0; idx < count; ++idx) {
+    *dest = blend_premultiplied(*source++, *dest);
+    ++dest;
+  }
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+inline __m128i div_255_epu16_sse2(__m128i value) {
+  value = _mm_add_epi16(value, _mm_set1_epi16(128));
+  __m128i result = _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+  return result;
+}
+
+// Same math as blend_premultiplied, 4 pixels at a time in 16 bit lanes
+inline __m128i blend_premultiplied_sse2(__m128i source, __m128i dest) {
+  __m128i zero = _mm_setzero_si128();
+
+  // 255 - alpha copied into every byte of its pixel
+  __m128i inv_alpha = _mm_sub_epi32(_mm_set1_epi32(255), _mm_srli_epi32(source, 24));
+  inv_alpha = _mm_or_si128(inv_alpha, _mm_slli_epi32(inv_alpha, 8));
+  inv_alpha = _mm_or_si128(inv_alpha, _mm_slli_epi32(inv_alpha, 16));
+
+  __m128i scaled_lo = div_255_epu16_sse2(_mm_mullo_epi16(
+    _mm_unpacklo_epi8(dest, zero), _mm_unpacklo_epi8(inv_alpha, zero)));
+  __m128i scaled_hi = div_255_epu16_sse2(_mm_mullo_epi16(
+    _mm_unpackhi_epi8(dest, zero), _mm_unpackhi_epi8(inv_alpha, zero)));
+
+  __m128i result = _mm_adds_epu8(source, _mm_packus_epi16(scaled_lo, scaled_hi));
+  return result;
+}
+
+static BLEND_ROW(blend_row_sse2) {
+  i32 idx = 0;
+
+  for (; idx + 4 <= count; idx += 4) {
+    __m128i source_pixels = _mm_loadu_si128((__m128i *)(source + idx));
+    __m128i dest_pixels = _mm_loadu_si128((__m128i *)(dest + idx));
+    _mm_storeu_si128((__m128i *)(dest + idx), blend_premultiplied_sse2(source_pixels, dest_pixels));
+  }
+
+  blend_row_scalar(dest + idx, source + idx, count - idx);
+}
+
+__attribute__((target("avx2")))
+inline __m256i div_255_epu16_avx2(__m256i value) {
+  value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+  __m256i result = _mm256_srli_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), 8);
+  return result;
+}
+
+// 8 pixels at a time. Unpack and pack both work within 128 bit lanes, so the
+// pixels come back out in the order they went in.
+__attribute__((target("avx2")))
+inline __m256i blend_premultiplied_avx2(__m256i source, __m256i dest) {
+  __m256i zero = _mm256_setzero_si256();
+
+  __m256i inv_alpha = _mm256_sub_epi32(_mm256_set1_epi32(255), _mm256_srli_epi32(source, 24));
+  inv_alpha = _mm256_or_si256(inv_alpha, _mm256_slli_epi32(inv_alpha, 8));
+  inv_alpha = _mm256_or_si256(inv_alpha, _mm256_slli_epi32(inv_alpha, 16));
+
+  __m256i scaled_lo = div_255_epu16_avx2(_mm256_mullo_epi16(
+    _mm256_unpacklo_epi8(dest, zero), _mm256_unpacklo_epi8(inv_alpha, zero)));
+  __m256i scaled_hi = div_255_epu16_avx2(_mm256_mullo_epi16(
+    _mm256_unpackhi_epi8(dest, zero), _mm256_unpackhi_epi8(inv_alpha, zero)));
+
+  __m256i result = _mm256_adds_epu8(source, _mm256_packus_epi16(scaled_lo, scaled_hi));
+  return result;
+}
+
+__attribute__((target("avx2")))
+static BLEND_ROW(blend_row_avx2) {
+  i32 idx = 0;
+
+  for (; idx + 8 <= count; idx += 8) {
+    __m256i source_pixels = _mm256_loadu_si256((__m256i *)(source + idx));
+    __m256i dest_pixels = _mm256_loadu_si256((__m256i *)(dest + idx));
+    _mm256_storeu_si256((__m256i *)(dest + idx), blend_premultiplied_avx2(source_pixels, dest_pixels));
+  }
+
+  blend_row_sse2(dest + idx, source + idx, count - idx);
+}
+#endif
+
+// Define HANDMADE_FORCE_SCALAR_FILL to always use the scalar loops, eg: when
+// comparing the FillRectangle cycle counter against the wide kernels.
+static void select_render_kernels(void) {
+#if defined(HANDMADE_FORCE_SCALAR_FILL)
+  global_render_kernels.fill = span_fill_scalar;
+  global_render_kernels.blend_row = blend_row_scalar;
+#else
+  // SSE2 is part of x64 so it is always there
+  global_render_kernels.fill = span_fill_sse2;
+  global_render_kernels.blend_row = blend_row_sse2;
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    global_render_kernels.fill = span_fill_avx2;
+    global_render_kernels.blend_row = blend_row_avx2;
+  }
+#endif
+}
+
+// Fills the pixels in [x_min, x_max) x [y_min, y_max) with color.
+// The rectangle must already be clipped to the buffer.
+static void fill_rectangle(GameOffScreenBuffer *buffer, i32 x_min, i32 y_min, i32 x_max, i32 y_max, u32 color) {
+  if (!global_render_kernels.fill) {
+    select_render_kernels();
+  }
+
+  i32 width = x_max - x_min;
+  i32 height = y_max - y_min;
+
+  if ((width <= 0) || (height <= 0)) {
+    return;
+  }
+
+  BEGIN_TIMED_BLOCK(FillRectangle);
+
+  u8 *row = (u8 *)buffer->memory +
+      (x_min * buffer->bytes_per_pixel) +
+      (y_min * buffer->pitch);
+
+  for (int y = y_min; y < y_max; ++y) {
+    global_render_kernels.fill((u32 *)row, width, color);
+    row += buffer->pitch;
+  }
+
+  END_TIMED_BLOCK_COUNTED(FillRectangle, width * height);
+}
+
+// Copies source into dest so source's top left lands at (x, y). Only the part
+// inside [min_x, max_x) x [min_y, max_y) of dest is written, which must already
+// be clipped to dest.
+static void blit_rectangle(
+  GameOffScreenBuffer *dest,
+  GameOffScreenBuffer *source,
+  i32 x, i32 y,
+  i32 min_x, i32 min_y,
+  i32 max_x, i32 max_y
+) {
+  if (min_x < x) { min_x = x; }
+  if (min_y < y) { min_y = y; }
+  if (max_x > x + source->width) { max_x = x + source->width; }
+  if (max_y > y + source->height) { max_y = y + source->height; }
+
+  i32 width = max_x - min_x;
+  i32 height = max_y - min_y;
+
+  if ((width <= 0) || (height <= 0)) {
+    return;
+  }
+
+  BEGIN_TIMED_BLOCK(BlitRectangle);
+
+  u8 *dest_row = (u8 *)dest->memory + min_x * dest->bytes_per_pixel + min_y * dest->pitch;
+  u8 *source_row = (u8 *)source->memory +
+      (min_x - x) * source->bytes_per_pixel +
+      (min_y - y) * source->pitch;
+  memory_index row_size = (memory_index)width * dest->bytes_per_pixel;
+
+  for (i32 row = 0; row < height; ++row) {
+    memcpy(dest_row, source_row, row_size);
+    dest_row += dest->pitch;
+    source_row += source->pitch;
+  }
+
+  END_TIMED_BLOCK_COUNTED(BlitRectangle, width * height);
+}
+
+// Draws bitmap with its top left corner at (x, y). Only the part inside
+// [min_x, max_x) x [min_y, max_y) of buffer is written, which must already be
+// clipped to buffer.
+static void draw_bitmap(
+  GameOffScreenBuffer *buffer,
+  LoadedBitmap *bitmap,
+  i32 x, i32 y,
+  i32 min_x, i32 min_y,
+  i32 max_x, i32 max_y
+) {
+  if (!global_render_kernels.blend_row) {
+    select_render_kernels();
+  }
+
+  if (min_x < x) { min_x = x; }
+  if (min_y < y) { min_y = y; }
+  if (max_x > x + bitmap->width) { max_x = x + bitmap->width; }
+  if (max_y > y + bitmap->height) { max_y = y + bitmap->height; }
+
+  i32 width = max_x - min_x;
+  i32 height = max_y - min_y;
+
+  if ((width <= 0) || (height <= 0)) {
+    return;
+  }
+
+  u8 *dest_row = (u8 *)buffer->memory + min_x * buffer->bytes_per_pixel + min_y * buffer->pitch;
+  u8 *source_row = (u8 *)bitmap->memory + (min_x - x) * sizeof(u32) + (min_y - y) * bitmap->pitch;
+
+  if (bitmap->is_opaque) {
+    BEGIN_TIMED_BLOCK(DrawBitmapOpaque);
+
+    memory_index row_size = (memory_index)width * sizeof(u32);
+    for (i32 row = 0; row < height; ++row) {
+      memcpy(dest_row, source_row, row_size);
+      dest_row += buffer->pitch;
+      source_row += bitmap->pitch;
+    }
+
+    END_TIMED_BLOCK_COUNTED(DrawBitmapOpaque, width * height);
+  } else {
+    BEGIN_TIMED_BLOCK(DrawBitmapBlended);
+
+    for (i32 row = 0; row < height; ++row) {
+      global_render_kernels.blend_row((u32 *)dest_row, (u32 *)source_row, width);
+      dest_row += buffer->pitch;
+      source_row += bitmap->pitch;
+    }
+
+    END_TIMED_BLOCK_COUNTED(DrawBitmapBlended, width * height);
+  }
+}
+
+inline u32 pack_color(f32 r, f32 g, f32 b) {
+  u32 color = ((f32_round_to_u32(r * 255.0f) << 16) |
+               (f32_round_to_u32(g * 255.0f) << 8) |
+               (f32_round_to_u32(b * 255.0f) << 0));
+  return color;
+}
+
+inline Rectangle2i rectangle_intersect(Rectangle2i a, Rectangle2i b) {
+  Rectangle2i result;
+  result.min_x = (a.min_x < b.min_x) ? b.min_x : a.min_x;
+  result.min_y = (a.min_y < b.min_y) ? b.min_y : a.min_y;
+  result.max_x = (a.max_x > b.max_x) ? b.max_x : a.max_x;
+  result.max_y = (a.max_y > b.max_y) ? b.max_y : a.max_y;
+  return result;
+}
+
+inline bool rectangle_has_area(Rectangle2i rect) {
+  bool result = (rect.min_x < rect.max_x) && (rect.min_y < rect.max_y);
+  return result;
+}
+
+static PLATFORM_WORK_QUEUE_CALLBACK(do_tiled_render_work) {
+  TiledRenderJob *job = (TiledRenderJob *)data;
+  GameOffScreenBuffer *buffer = job->buffer;
+  u32 tile_count = (u32)(job->tile_count_x * job->tile_count_y);
+
+  for (;;) {
+    u32 tile_index = __atomic_fetch_add(&job->next_tile_index, 1, __ATOMIC_RELAXED);
+    if (tile_index >= tile_count) {
+      break;
+    }
+
+    i32 tile_x = (i32)tile_index % job->tile_count_x;
+    i32 tile_y = (i32)tile_index / job->tile_count_x;
+
+    Rectangle2i clip_rect;
+    clip_rect.min_x = tile_x * RENDER_TILE_WIDTH;
+    clip_rect.min_y = tile_y * RENDER_TILE_HEIGHT;
+    clip_rect.max_x = clip_rect.min_x + RENDER_TILE_WIDTH;
+    clip_rect.max_y = clip_rect.min_y + RENDER_TILE_HEIGHT;
+
+    // Tiles along the right and bottom edges can hang off the buffer
+    if (clip_rect.max_x > buffer->width) { clip_rect.max_x = buffer->width; }
+    if (clip_rect.max_y > buffer->height) { clip_rect.max_y = buffer->height; }
+
+    BEGIN_TIMED_BLOCK(RenderTile);
+    job->render(job->scene, buffer, clip_rect);
+    END_TIMED_BLOCK(RenderTile);
+  }
+}
+
+// Renders the scene into the buffer one tile at a time on every core. Returns
+// once every tile is done. Without a work queue the calling thread renders all
+// of the tiles itself.
+//
+// RenderTile is timed per tile and RenderTiled times the whole pass, so
+// RenderTile cycles / RenderTiled cycles is how many cores were effectively busy.
+static void render_tiled(
+  ThreadContext *thread_ctx,
+  GameMemory *memory,
+  GameOffScreenBuffer *buffer,
+  render_scene *render,
+  void *scene
+) {
+  BEGIN_TIMED_BLOCK(RenderTiled);
+
+  TiledRenderJob job = {};
+  job.buffer = buffer;
+  job.render = render;
+  job.scene = scene;
+  job.tile_count_x = (buffer->width + RENDER_TILE_WIDTH - 1) / RENDER_TILE_WIDTH;
+  job.tile_count_y = (buffer->height + RENDER_TILE_HEIGHT - 1) / RENDER_TILE_HEIGHT;
+  job.next_tile_index = 0;
+
+  PlatformWorkQueue *queue = memory->high_priority_queue;
+
+  if (queue) {
+    for (u32 worker_idx = 0; worker_idx < memory->worker_thread_count; ++worker_idx) {
+      memory->add_entry(queue, do_tiled_render_work, &job);
+    }
+  }
+
+  do_tiled_render_work(thread_ctx, &job);
+
+  if (queue) {
+    memory->complete_all_work(queue);
+  }
+
+  END_TIMED_BLOCK(RenderTiled);
+}
+
+static RenderGroup *allocate_render_group(
+  MemoryArena *arena,
+  u32 max_push_buffer_size,
+  u32 max_sort_entry_count,
+  i32 output_width,
+  i32 output_height
+) {
+  RenderGroup *group = PushStruct(arena, RenderGroup);
+  group->output_width = output_width;
+  group->output_height = output_height;
+
+  group->max_push_buffer_size = max_push_buffer_size;
+  group->push_buffer_size = 0;
+  group->push_buffer_base = (u8 *)push_size_(arena, max_push_buffer_size, 16);
+
+  group->max_sort_entry_count = max_sort_entry_count;
+  group->sort_entry_count = 0;
+  group->sort_entries = PushArray(arena, max_sort_entry_count, RenderSortEntry);
+  group->temp_sort_entries = PushArray(arena, max_sort_entry_count, RenderSortEntry);
+
+  group->is_sorted = false;
+  group->background_changed = false;
+  group->dirty_rects = 0;
+
+  return group;
+}
+
+#define PushRenderElement(group, type, layer) (type *)push_render_element_(group, sizeof(type), RenderGroupEntryType_##type, layer)
+
+// Returns 0 when the group is full, in which case the command is dropped.
+inline void *push_render_element_(RenderGroup *group, u32 size, RenderGroupEntryType type, i32 layer) {
+  void *result = 0;
+
+  size += sizeof(RenderGroupEntryHeader);
+
+  if (((group->push_buffer_size + size) <= group->max_push_buffer_size) &&
+      (group->sort_entry_count < group->max_sort_entry_count))
+  {
+    RenderGroupEntryHeader *header = (RenderGroupEntryHeader *)(group->push_buffer_base + group->push_buffer_size);
+    header->type = type;
+
+    // Flipping the sign bit makes signed layers sort correctly as unsigned keys
+    u32 layer_key = (u32)layer ^ 0x80000000;
+
+    RenderSortEntry *sort_entry = &group->sort_entries[group->sort_entry_count];
+    sort_entry->sort_key = ((u64)layer_key << 32) | group->sort_entry_count;
+    sort_entry->push_buffer_offset = group->push_buffer_size;
+    ++group->sort_entry_count;
+
+    result = header + 1;
+    group->push_buffer_size += size;
+    group->is_sorted = false;
+  }
+
+  return result;
+}
+
+static void push_clear(RenderGroup *group, f32 r, f32 g, f32 b) {
+  RenderEntryClear *entry = PushRenderElement(group, RenderEntryClear, RENDER_LAYER_CLEAR);
+  if (entry) {
+    entry->color = pack_color(r, g, b);
+  }
+}
+
+// Pushes a flat color rectangle. Rectangles that are entirely off screen are
+// culled here.
+static void push_rectangle(
+  RenderGroup *group,
+  i32 layer,
+  f32 min_x, f32 min_y,
+  f32 max_x, f32 max_y,
+  f32 r, f32 g, f32 b
+) {
+  Rectangle2i rect = {
+    f32_round_to_i32(min_x),
+    f32_round_to_i32(min_y),
+    f32_round_to_i32(max_x),
+    f32_round_to_i32(max_y),
+  };
+
+  Rectangle2i output_rect = {0, 0, group->output_width, group->output_height};
+  rect = rectangle_intersect(rect, output_rect);
+
+  if ((rect.min_x < rect.max_x) && (rect.min_y < rect.max_y)) {
+    RenderEntryRectangle *entry = PushRenderElement(group, RenderEntryRectangle, layer);
+    if (entry) {
+      entry->rect = rect;
+      entry->color = pack_color(r, g, b);
+    }
+  }
+}
+
+// Pushes an opaque copy of source with its top left corner at (x, y)
+static void push_blit(RenderGroup *group, i32 layer, GameOffScreenBuffer *source, i32 x, i32 y) {
+  RenderEntryBlit *entry = PushRenderElement(group, RenderEntryBlit, layer);
+  if (entry) {
+    entry->source = source;
+    entry->x = x;
+    entry->y = y;
+  }
+}
+
+// Pushes bitmap with its top left corner at (x, y). Bitmaps that are entirely
+// off screen are culled here.
+static void push_bitmap(RenderGroup *group, i32 layer, LoadedBitmap *bitmap, f32 x, f32 y) {
+  i32 min_x = f32_round_to_i32(x);
+  i32 min_y = f32_round_to_i32(y);
+
+  Rectangle2i bounds = {min_x, min_y, min_x + bitmap->width, min_y + bitmap->height};
+  Rectangle2i output_rect = {0, 0, group->output_width, group->output_height};
+
+  if (rectangle_has_area(rectangle_intersect(bounds, output_rect))) {
+    RenderEntryBitmap *entry = PushRenderElement(group, RenderEntryBitmap, layer);
+    if (entry) {
+      entry->bitmap = bitmap;
+      entry->x = min_x;
+      entry->y = min_y;
+    }
+  }
+}
+
+static void sort_entries_merge_sort(u32 count, RenderSortEntry *first, RenderSortEntry *temp) {
+  if (count <= 1) {
+    return;
+  }
+
+  u32 half_0 = count / 2;
+  u32 half_1 = count - half_0;
+
+  RenderSortEntry *in_half_0 = first;
+  RenderSortEntry *in_half_1 = first + half_0;
+  RenderSortEntry *end = first + count;
+
+  sort_entries_merge_sort(half_0, in_half_0, temp);
+  sort_entries_merge_sort(half_1, in_half_1, temp);
+
+  RenderSortEntry *read_half_0 = in_half_0;
+  RenderSortEntry *read_half_1 = in_half_1;
+  RenderSortEntry *out = temp;
+
+  for (u32 idx = 0; idx < count; ++idx) {
+    if (read_half_0 == in_half_1) {
+      *out++ = *read_half_1++;
+    } else if (read_half_1 == end) {
+      *out++ = *read_half_0++;
+    } else if (read_half_0->sort_key <= read_half_1->sort_key) {
+      *out++ = *read_half_0++;
+    } else {
+      *out++ = *read_half_1++;
+    }
+  }
+
+  for (u32 idx = 0; idx < count; ++idx) {
+    first[idx] = temp[idx];
+  }
+}
+
+inline RenderEntryRectangle *get_sort_entry_rectangle(RenderGroup *group, RenderSortEntry *sort_entry) {
+  RenderEntryRectangle *result = 0;
+
+  RenderGroupEntryHeader *header = (RenderGroupEntryHeader *)(group->push_buffer_base + sort_entry->push_buffer_offset);
+  if (header->type == RenderGroupEntryType_RenderEntryRectangle) {
+    result = (RenderEntryRectangle *)(header + 1);
+  }
+
+  return result;
+}
+
+// Two rectangles that are next to each other in draw order, share a color and
+// line up along a whole edge draw exactly the same pixels as their union.
+static bool try_merge_rectangles(RenderEntryRectangle *into, RenderEntryRectangle *next) {
+  bool merged = false;
+  Rectangle2i *a = &into->rect;
+  Rectangle2i *b = &next->rect;
+
+  if (into->color == next->color) {
+    if ((a->min_y == b->min_y) && (a->max_y == b->max_y) && (a->max_x == b->min_x)) {
+      a->max_x = b->max_x;
+      merged = true;
+    } else if ((a->min_x == b->min_x) && (a->max_x == b->max_x) && (a->max_y == b->min_y)) {
+      a->max_y = b->max_y;
+      merged = true;
+    }
+  }
+
+  return merged;
+}
+
+// Puts the commands into draw order and merges runs of rectangles. Has to run
+// on one thread before the group is executed.
+static void sort_render_group(RenderGroup *group) {
+  if (group->is_sorted) {
+    return;
+  }
+
+  sort_entries_merge_sort(group->sort_entry_count, group->sort_entries, group->temp_sort_entries);
+
+  u32 kept_count = 0;
+  for (u32 entry_idx = 0; entry_idx < group->sort_entry_count; ++entry_idx) {
+    RenderSortEntry *sort_entry = &group->sort_entries[entry_idx];
+
+    if (kept_count > 0) {
+      RenderSortEntry *last_kept = &group->sort_entries[kept_count - 1];
+      RenderEntryRectangle *last_rect = get_sort_entry_rectangle(group, last_kept);
+      RenderEntryRectangle *rect = get_sort_entry_rectangle(group, sort_entry);
+
+      if (last_rect && rect &&
+          ((last_kept->sort_key >> 32) == (sort_entry->sort_key >> 32)) &&
+          try_merge_rectangles(last_rect, rect))
+      {
+        continue;
+      }
+    }
+
+    group->sort_entries[kept_count++] = *sort_entry;
+  }
+
+  group->sort_entry_count = kept_count;
+  group->is_sorted = true;
+}
+
+inline Rectangle2i rectangle_union(Rectangle2i a, Rectangle2i b) {
+  Rectangle2i result;
+  result.min_x = (a.min_x < b.min_x) ? a.min_x : b.min_x;
+  result.min_y = (a.min_y < b.min_y) ? a.min_y : b.min_y;
+  result.max_x = (a.max_x > b.max_x) ? a.max_x : b.max_x;
+  result.max_y = (a.max_y > b.max_y) ? a.max_y : b.max_y;
+  return result;
+}
+
+// Adds rect to the list, folding it into any rect it overlaps so the renderer
+// never draws a pixel twice. Returns false when the list is full.
+static bool add_dirty_rect(DirtyRectList *dirty_rects, Rectangle2i rect) {
+  bool merged = true;
+
+  while (merged) {
+    merged = false;
+
+    for (u32 rect_idx = 0; rect_idx < dirty_rects->count; ++rect_idx) {
+      if (rectangle_has_area(rectangle_intersect(dirty_rects->rects[rect_idx], rect))) {
+        rect = rectangle_union(dirty_rects->rects[rect_idx], rect);
+        dirty_rects->rects[rect_idx] = dirty_rects->rects[--dirty_rects->count];
+        merged = true;
+        break;
+      }
+    }
+  }
+
+  bool added = false;
+  if (dirty_rects->count < ArrayCount(dirty_rects->rects)) {
+    dirty_rects->rects[dirty_rects->count++] = rect;
+    added = true;
+  }
+
+  return added;
+}
+
+// Works out what changed since the last frame that went through tracker and
+// writes it to dirty_rects. The group will then only redraw those parts. Has to
+// be called before the group is sorted, since sorting merges rectangles.
+static void compute_dirty_rects(RenderGroup *group, DirtyTracker *tracker, DirtyRectList *dirty_rects) {
+  Assert(!group->is_sorted);
+
+  group->dirty_rects = dirty_rects;
+  dirty_rects->is_full_frame = false;
+  dirty_rects->count = 0;
+
+  TrackedRectangle current[MAX_TRACKED_RECTANGLE_COUNT];
+  u32 current_count = 0;
+  bool is_full_frame = false;
+
+  Rectangle2i output_rect = {0, 0, group->output_width, group->output_height};
+
+  for (u32 entry_idx = 0; entry_idx < group->sort_entry_count; ++entry_idx) {
+    RenderSortEntry *sort_entry = &group->sort_entries[entry_idx];
+    RenderGroupEntryHeader *header = (RenderGroupEntryHeader *)(group->push_buffer_base + sort_entry->push_buffer_offset);
+
+    TrackedRectangle tracked = {};
+    bool is_tracked = false;
+
+    if (header->type == RenderGroupEntryType_RenderEntryRectangle) {
+      RenderEntryRectangle *entry = (RenderEntryRectangle *)(header + 1);
+      tracked.rect = entry->rect;
+      tracked.content = entry->color;
+      is_tracked = true;
+    } else if (header->type == RenderGroupEntryType_RenderEntryBitmap) {
+      RenderEntryBitmap *entry = (RenderEntryBitmap *)(header + 1);
+      Rectangle2i bounds = {
+        entry->x, entry->y,
+        entry->x + entry->bitmap->width, entry->y + entry->bitmap->height
+      };
+      tracked.rect = rectangle_intersect(bounds, output_rect);
+      tracked.content = (u64)(uintptr_t)entry->bitmap;
+      is_tracked = true;
+    }
+
+    if (is_tracked) {
+      if (current_count < ArrayCount(current)) {
+        current[current_count++] = tracked;
+      } else {
+        is_full_frame = true;
+      }
+    }
+  }
+
+  if (!tracker->has_last_frame ||
+      group->background_changed ||
+      (tracker->last_width != group->output_width) ||
+      (tracker->last_height != group->output_height))
+  {
+    is_full_frame = true;
+  }
+
+  if (!is_full_frame) {
+    bool unchanged = (current_count == tracker->last_count) &&
+                     (memcmp(current, tracker->last, current_count * sizeof(TrackedRectangle)) == 0);
+
+    if (!unchanged) {
+      for (u32 rect_idx = 0; rect_idx < tracker->last_count; ++rect_idx) {
+        if (!add_dirty_rect(dirty_rects, tracker->last[rect_idx].rect)) {
+          is_full_frame = true;
+        }
+      }
+
+      for (u32 rect_idx = 0; rect_idx < current_count; ++rect_idx) {
+        if (!add_dirty_rect(dirty_rects, current[rect_idx].rect)) {
+          is_full_frame = true;
+        }
+      }
+    }
+  }
+
+  if (is_full_frame) {
+    dirty_rects->is_full_frame = true;
+    dirty_rects->count = 0;
+  }
+
+  tracker->has_last_frame = true;
+  tracker->last_width = group->output_width;
+  tracker->last_height = group->output_height;
+  tracker->last_count = current_count;
+  memcpy(tracker->last, current, current_count * sizeof(TrackedRectangle));
+}
+
+// Executes every command in the (sorted) group, clipped to clip_rect
+static void render_group_entries(RenderGroup *group, GameOffScreenBuffer *buffer, Rectangle2i clip_rect) {
+  Assert(group->is_sorted);
+
+  for (u32 entry_idx = 0; entry_idx < group->sort_entry_count; ++entry_idx) {
+    RenderSortEntry *sort_entry = &group->sort_entries[entry_idx];
+    RenderGroupEntryHeader *header = (RenderGroupEntryHeader *)(group->push_buffer_base + sort_entry->push_buffer_offset);
+    void *data = header + 1;
+
+    switch (header->type) {
+      case RenderGroupEntryType_RenderEntryClear: {
+        RenderEntryClear *entry = (RenderEntryClear *)data;
+        fill_rectangle(buffer, clip_rect.min_x, clip_rect.min_y, clip_rect.max_x, clip_rect.max_y, entry->color);
+      } break;
+
+      case RenderGroupEntryType_RenderEntryRectangle: {
+        RenderEntryRectangle *entry = (RenderEntryRectangle *)data;
+        Rectangle2i rect = rectangle_intersect(entry->rect, clip_rect);
+        fill_rectangle(buffer, rect.min_x, rect.min_y, rect.max_x, rect.max_y, entry->color);
+      } break;
+
+      case RenderGroupEntryType_RenderEntryBitmap: {
+        RenderEntryBitmap *entry = (RenderEntryBitmap *)data;
+        draw_bitmap(buffer, entry->bitmap, entry->x, entry->y,
+                    clip_rect.min_x, clip_rect.min_y, clip_rect.max_x, clip_rect.max_y);
+      } break;
+
+      case RenderGroupEntryType_RenderEntryBlit: {
+        RenderEntryBlit *entry = (RenderEntryBlit *)data;
+        blit_rectangle(buffer, entry->source, entry->x, entry->y,
+                       clip_rect.min_x, clip_rect.min_y, clip_rect.max_x, clip_rect.max_y);
+      } break;
+
+      default: {
+        Assert(!"Unknown render group entry type");
+      } break;
+    }
+  }
+}
+
+// Executes the group clipped to clip_rect, skipping anything that isn't dirty.
+// Takes the group as the scene so it can be handed straight to render_tiled.
+static RENDER_SCENE(render_group_to_output) {
+  RenderGroup *group = (RenderGroup *)scene;
+  DirtyRectList *dirty_rects = group->dirty_rects;
+
+  if (!dirty_rects || dirty_rects->is_full_frame) {
+    render_group_entries(group, buffer, clip_rect);
+  } else {
+    for (u32 rect_idx = 0; rect_idx < dirty_rects->count; ++rect_idx) {
+      Rectangle2i dirty_clip_rect = rectangle_intersect(dirty_rects->rects[rect_idx], clip_rect);
+
+      if (rectangle_has_area(dirty_clip_rect)) {
+        render_group_entries(group, buffer, dirty_clip_rect);
+      }
+    }
+  }
+}
+
+// Sorts the group and renders it across every core
+static void tiled_render_group_to_output(
+  ThreadContext *thread_ctx,
+  GameMemory *memory,
+  RenderGroup *group,
+  GameOffScreenBuffer *buffer
+) {
+  sort_render_group(group);
+
+  DirtyRectList *dirty_rects = group->dirty_rects;
+  bool nothing_changed = dirty_rects && !dirty_rects->is_full_frame && (dirty_rects->count == 0);
+
+  if (!nothing_changed) {
+    render_tiled(thread_ctx, memory, buffer, render_group_to_output, group);
+  }
+}
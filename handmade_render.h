@@ -0,0 +1,147 @@
+#if !defined(HANDMADE_RENDER_H)
+#define HANDMADE_RENDER_H
+
+/*
+  Tiled rendering
+
+  The back buffer is cut into tiles and the tiles are handed out to every core.
+  Each tile draws the whole scene clipped to itself, so no two threads ever write
+  the same pixel. Tiles are a multiple of 16 pixels (one 64 byte cache line) wide
+  and the buffer pitch is cache line aligned, so no two tiles share a cache line
+  either. 128x64 pixels is 32KB, which stays in cache while a core works on it.
+*/
+#define RENDER_TILE_WIDTH 128
+#define RENDER_TILE_HEIGHT 64
+
+// Draws everything in the scene, clipped to clip_rect
+#define RENDER_SCENE(name) void name(void *scene, GameOffScreenBuffer *buffer, Rectangle2i clip_rect)
+typedef RENDER_SCENE(render_scene);
+
+struct TiledRenderJob {
+  GameOffScreenBuffer *buffer;
+  render_scene *render;
+  void *scene;
+
+  i32 tile_count_x;
+  i32 tile_count_y;
+
+  // Every thread working on the job grabs its next tile from here
+  u32 volatile next_tile_index;
+};
+
+// Pixels are 0xAARRGGBB with premultiplied alpha, top row first. Rows start on
+// a 16 byte boundary.
+struct LoadedBitmap {
+  i32 width;
+  i32 height;
+  i32 pitch;
+  void *memory;
+
+  // Every pixel has alpha 255, so it can be drawn with plain row copies
+  bool is_opaque;
+};
+
+/*
+  Render groups
+
+  The game doesn't draw anything directly. It pushes typed commands into a push
+  buffer that lives in transient storage, and the whole buffer is executed in
+  one go at the end of the frame. Before executing, commands are sorted by layer
+  (keeping push order within a layer) and runs of touching, same color
+  rectangles are merged into one.
+*/
+enum RenderGroupEntryType {
+  RenderGroupEntryType_RenderEntryClear,
+  RenderGroupEntryType_RenderEntryRectangle,
+  RenderGroupEntryType_RenderEntryBlit,
+  RenderGroupEntryType_RenderEntryBitmap,
+};
+
+struct RenderGroupEntryHeader {
+  RenderGroupEntryType type;
+};
+
+struct RenderEntryClear {
+  u32 color;
+};
+
+struct RenderEntryRectangle {
+  Rectangle2i rect;
+  u32 color;
+};
+
+// Opaque 1:1 copy of another buffer, with its top left corner landing at x, y
+struct RenderEntryBlit {
+  GameOffScreenBuffer *source;
+  i32 x;
+  i32 y;
+};
+
+// Alpha blended bitmap with its top left corner at x, y
+struct RenderEntryBitmap {
+  LoadedBitmap *bitmap;
+  i32 x;
+  i32 y;
+};
+
+// Clears always draw before everything else
+#define RENDER_LAYER_CLEAR INT32_MIN
+
+/*
+  Dirty rectangles
+
+  Rectangles and bitmaps are the only things in a group that move around from
+  frame to frame. Clears and blits are treated as background: whoever pushes them
+  has to set background_changed on the group when their content changes. Every
+  frame the rectangles and bitmaps are compared against last frame's. Where they
+  differ, both the old and new bounds are dirty.
+*/
+#define MAX_TRACKED_RECTANGLE_COUNT 256
+
+struct TrackedRectangle {
+  Rectangle2i rect;
+
+  // The color for rectangles, the bitmap's address for bitmaps
+  u64 content;
+};
+
+// Survives between frames, lives in transient storage
+struct DirtyTracker {
+  bool has_last_frame;
+  i32 last_width;
+  i32 last_height;
+
+  u32 last_count;
+  TrackedRectangle last[MAX_TRACKED_RECTANGLE_COUNT];
+};
+
+struct RenderSortEntry {
+  // layer in the high 32 bits, push index in the low 32 bits
+  u64 sort_key;
+  u32 push_buffer_offset;
+};
+
+struct RenderGroup {
+  // Commands get culled against this
+  i32 output_width;
+  i32 output_height;
+
+  u32 max_push_buffer_size;
+  u32 push_buffer_size;
+  u8 *push_buffer_base;
+
+  u32 max_sort_entry_count;
+  u32 sort_entry_count;
+  RenderSortEntry *sort_entries;
+
+  // Scratch space for sorting
+  RenderSortEntry *temp_sort_entries;
+
+  bool is_sorted;
+
+  // See "Dirty rectangles"
+  bool background_changed;
+  DirtyRectList *dirty_rects;
+};
+
+#endif
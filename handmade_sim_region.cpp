@@ -0,0 +1,127 @@
+/*
+  Sim regions
+*/
+inline bool sim_region_contains(Rectangle2i bounds, i32 abs_tile_x, i32 abs_tile_y) {
+  bool contains = (abs_tile_x >= bounds.min_x) && (abs_tile_x < bounds.max_x) &&
+                  (abs_tile_y >= bounds.min_y) && (abs_tile_y < bounds.max_y);
+  return contains;
+}
+
+// Copies the entities in store_slots (already pushed onto arena) into a new
+// region
+static SimRegion *gather_sim_region(MemoryArena *arena, EntityStore *store, Rectangle2i bounds, u32 *store_slots, u32 count) {
+  SimRegion *region = PushStruct(arena, SimRegion);
+  region->bounds = bounds;
+  region->store_slots = store_slots;
+  allocate_entity_components(arena, &region->entities, count);
+
+  EntityStore *entities = &region->entities;
+  entities->count = count;
+  for (u32 slot = 0; slot < count; ++slot) {
+    u32 store_slot = store_slots[slot];
+    entities->handle_indices[slot] = store->handle_indices[store_slot];
+    entities->flags[slot] = store->flags[store_slot];
+    entities->abs_tile_x[slot] = store->abs_tile_x[store_slot];
+    entities->abs_tile_y[slot] = store->abs_tile_y[store_slot];
+    entities->offset_x[slot] = store->offset_x[store_slot];
+    entities->offset_y[slot] = store->offset_y[store_slot];
+    entities->velocity_x[slot] = store->velocity_x[store_slot];
+    entities->velocity_y[slot] = store->velocity_y[store_slot];
+    entities->box_min_x[slot] = store->box_min_x[store_slot];
+    entities->box_min_y[slot] = store->box_min_y[store_slot];
+    entities->box_max_x[slot] = store->box_max_x[store_slot];
+    entities->box_max_y[slot] = store->box_max_y[store_slot];
+  }
+
+  return region;
+}
+
+// Adds the slots of the entities in chunk whose position is inside bounds
+// to store_slots, which has count in it already. Returns the new count.
+static u32 gather_chunk_slots(EntityStore *store, EntityChunk *chunk, Rectangle2i bounds, u32 *store_slots, u32 count) {
+  for (u32 index = chunk->first_index; index != ENTITY_INVALID_SLOT; index = store->chunk_next[index]) {
+    u32 slot = store->slots[index];
+    store_slots[count] = slot;
+    count += sim_region_contains(bounds, store->abs_tile_x[slot], store->abs_tile_y[slot]);
+  }
+
+  return count;
+}
+
+// Pulls every entity whose position is inside bounds (absolute tiles, max
+// exclusive) into a region on arena. Only the chunks bounds covers are looked
+// in, or every chunk there is when that's fewer, so how long it takes
+// doesn't depend on how many entities are elsewhere.
+static SimRegion *begin_sim_region(MemoryArena *arena, EntityStore *store, Rectangle2i bounds) {
+  BEGIN_TIMED_BLOCK(BeginSimRegion);
+
+  u32 *store_slots = PushArray(arena, store->count, u32);
+  u32 count = 0;
+
+  if ((bounds.min_x < bounds.max_x) && (bounds.min_y < bounds.max_y)) {
+    i32 min_chunk_x = bounds.min_x >> ENTITY_CHUNK_SHIFT;
+    i32 min_chunk_y = bounds.min_y >> ENTITY_CHUNK_SHIFT;
+    i32 max_chunk_x = (bounds.max_x - 1) >> ENTITY_CHUNK_SHIFT;
+    i32 max_chunk_y = (bounds.max_y - 1) >> ENTITY_CHUNK_SHIFT;
+    u64 covered_count = (u64)((i64)max_chunk_x - min_chunk_x + 1) * (u64)((i64)max_chunk_y - min_chunk_y + 1);
+
+    if (covered_count <= store->chunk_count) {
+      for (i32 chunk_y = min_chunk_y; chunk_y <= max_chunk_y; ++chunk_y) {
+        for (i32 chunk_x = min_chunk_x; chunk_x <= max_chunk_x; ++chunk_x) {
+          EntityChunk *chunk = store->chunks + find_entity_chunk_slot(store, chunk_x, chunk_y);
+          if (chunk->first_index != ENTITY_INVALID_SLOT) {
+            count = gather_chunk_slots(store, chunk, bounds, store_slots, count);
+          }
+        }
+      }
+    } else {
+      u32 chunk_slot_count = get_entity_chunk_slot_count(store);
+      for (u32 slot_idx = 0; slot_idx < chunk_slot_count; ++slot_idx) {
+        EntityChunk *chunk = store->chunks + slot_idx;
+        if ((chunk->first_index != ENTITY_INVALID_SLOT) &&
+            (chunk->chunk_x >= min_chunk_x) && (chunk->chunk_x <= max_chunk_x) &&
+            (chunk->chunk_y >= min_chunk_y) && (chunk->chunk_y <= max_chunk_y))
+        {
+          count = gather_chunk_slots(store, chunk, bounds, store_slots, count);
+        }
+      }
+    }
+  }
+
+  SimRegion *region = gather_sim_region(arena, store, bounds, store_slots, count);
+
+  END_TIMED_BLOCK_COUNTED(BeginSimRegion, count);
+  return region;
+}
+
+// Writes back what simulating can change, filing entities that moved into
+// other chunks there. The store mustn't have had entities added or removed
+// since the region began.
+static void end_sim_region(SimRegion *region, EntityStore *store) {
+  BEGIN_TIMED_BLOCK(EndSimRegion);
+
+  EntityStore *entities = &region->entities;
+  for (u32 slot = 0; slot < entities->count; ++slot) {
+    u32 store_slot = region->store_slots[slot];
+    u32 index = entities->handle_indices[slot];
+    Assert(store->handle_indices[store_slot] == index);
+
+    i32 old_chunk_x = store->abs_tile_x[store_slot] >> ENTITY_CHUNK_SHIFT;
+    i32 old_chunk_y = store->abs_tile_y[store_slot] >> ENTITY_CHUNK_SHIFT;
+    if ((old_chunk_x != (entities->abs_tile_x[slot] >> ENTITY_CHUNK_SHIFT)) ||
+        (old_chunk_y != (entities->abs_tile_y[slot] >> ENTITY_CHUNK_SHIFT)))
+    {
+      unfile_entity(store, index, store->abs_tile_x[store_slot], store->abs_tile_y[store_slot]);
+      file_entity(store, index, entities->abs_tile_x[slot], entities->abs_tile_y[slot]);
+    }
+
+    store->abs_tile_x[store_slot] = entities->abs_tile_x[slot];
+    store->abs_tile_y[store_slot] = entities->abs_tile_y[slot];
+    store->offset_x[store_slot] = entities->offset_x[slot];
+    store->offset_y[store_slot] = entities->offset_y[slot];
+    store->velocity_x[store_slot] = entities->velocity_x[slot];
+    store->velocity_y[store_slot] = entities->velocity_y[slot];
+  }
+
+  END_TIMED_BLOCK_COUNTED(EndSimRegion, entities->count);
+}
@@ -0,0 +1,24 @@
+#if !defined(HANDMADE_SIM_REGION_H)
+#define HANDMADE_SIM_REGION_H
+
+// Tiles past the edge of the screen that are still simulated. Entities
+// further away than that are frozen until the camera comes back near them.
+#define SIM_REGION_MARGIN_TILES 16
+
+/*
+  A sim region is a dense copy of some of the world's entities, pulled into
+  transient memory for one update and written back at the end. Its entities
+  are an EntityStore with only the per slot arrays, so everything that runs
+  over a store runs over a region the same way. Handles mean nothing in it.
+*/
+struct SimRegion {
+  // Absolute tiles whose entities it holds, max exclusive
+  Rectangle2i bounds;
+
+  EntityStore entities;
+
+  // The slot in the world's store each entity came from
+  u32 *store_slots;
+};
+
+#endif
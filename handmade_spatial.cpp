@@ -0,0 +1,254 @@
+/*
+  Spatial hash
+*/
+// Where a tile offset is, in tile offset units counted from tile 0
+inline i64 get_absolute_offset(i32 abs_tile, i32 offset) {
+  i64 result = (i64)abs_tile * TILE_OFFSET_ONE + offset;
+  return result;
+}
+
+inline u32 spatial_hash_bucket_index(SpatialHash *hash, i64 absolute_x, i64 absolute_y) {
+  // Same key and Fibonacci hashing as the tile map hash, on the tile instead
+  u64 key = tile_map_hash_key((i32)(absolute_x >> TILE_OFFSET_SHIFT), (i32)(absolute_y >> TILE_OFFSET_SHIFT));
+  u32 bucket_index = (u32)((key * 11400714819323198485ull) >> hash->bucket_shift);
+
+  return bucket_index;
+}
+
+// Everything is pushed onto arena, so it lasts until the temporary memory
+// it's in ends. Counts every live entity, colliding or not.
+static SpatialHash *build_spatial_hash(MemoryArena *arena, EntityStore *store) {
+  BEGIN_TIMED_BLOCK(BuildSpatialHash);
+
+  u32 entry_count = store->count;
+  u32 bucket_count = 64;
+  while (bucket_count < 2 * entry_count) {
+    bucket_count *= 2;
+  }
+
+  SpatialHash *hash = PushStruct(arena, SpatialHash);
+  hash->bucket_count = bucket_count;
+  hash->bucket_shift = 64 - find_least_significant_set_bit(bucket_count).index;
+  hash->entry_count = entry_count;
+  hash->bucket_starts = PushArray(arena, bucket_count + 1, u32);
+  hash->entries = (SpatialHashEntry *)push_size_(arena, entry_count * sizeof(SpatialHashEntry), 64);
+  hash->max_size_x = 0;
+  hash->max_size_y = 0;
+
+  // Count each bucket's entries, one past where they go so the prefix sum
+  // below leaves bucket_starts[b + 1] at b's first entry
+  memset(hash->bucket_starts, 0, (bucket_count + 1) * sizeof(u32));
+  u32 *entry_buckets = PushArray(arena, entry_count, u32);
+  for (u32 slot = 0; slot < entry_count; ++slot) {
+    i64 min_x = get_absolute_offset(store->abs_tile_x[slot], store->offset_x[slot] + store->box_min_x[slot]);
+    i64 min_y = get_absolute_offset(store->abs_tile_y[slot], store->offset_y[slot] + store->box_min_y[slot]);
+    u32 bucket_index = spatial_hash_bucket_index(hash, min_x, min_y);
+    entry_buckets[slot] = bucket_index;
+    ++hash->bucket_starts[bucket_index + 1];
+
+    i64 size_x = store->box_max_x[slot] - store->box_min_x[slot];
+    i64 size_y = store->box_max_y[slot] - store->box_min_y[slot];
+    hash->max_size_x = (size_x > hash->max_size_x) ? size_x : hash->max_size_x;
+    hash->max_size_y = (size_y > hash->max_size_y) ? size_y : hash->max_size_y;
+  }
+
+  for (u32 bucket_idx = 0; bucket_idx < bucket_count; ++bucket_idx) {
+    hash->bucket_starts[bucket_idx + 1] += hash->bucket_starts[bucket_idx];
+  }
+
+  // Fill each bucket from its start, which moves bucket_starts[b] up to where
+  // b + 1 starts. Shifting them all back down one puts them right again.
+  for (u32 slot = 0; slot < entry_count; ++slot) {
+    SpatialHashEntry *entry = hash->entries + hash->bucket_starts[entry_buckets[slot]]++;
+
+    i64 offset_x = get_absolute_offset(store->abs_tile_x[slot], store->offset_x[slot]);
+    i64 offset_y = get_absolute_offset(store->abs_tile_y[slot], store->offset_y[slot]);
+    entry->min_x = offset_x + store->box_min_x[slot];
+    entry->min_y = offset_y + store->box_min_y[slot];
+    entry->max_x = offset_x + store->box_max_x[slot];
+    entry->max_y = offset_y + store->box_max_y[slot];
+    entry->slot = slot;
+  }
+  memmove(hash->bucket_starts + 1, hash->bucket_starts, bucket_count * sizeof(u32));
+  hash->bucket_starts[0] = 0;
+
+  END_TIMED_BLOCK_COUNTED(BuildSpatialHash, entry_count);
+  return hash;
+}
+
+// Calls visit(entry, data) for every entry whose box overlaps
+// [min_x, max_x) x [min_y, max_y), in absolute tile offset units. Stops early
+// when visit returns false.
+#define SPATIAL_HASH_VISIT(name) bool name(SpatialHashEntry *entry, void *data)
+typedef SPATIAL_HASH_VISIT(SpatialHashVisit);
+
+static void spatial_hash_visit_box(
+    SpatialHash *hash, i64 min_x, i64 min_y, i64 max_x, i64 max_y,
+    SpatialHashVisit *visit, void *data
+  ) {
+  if ((min_x >= max_x) || (min_y >= max_y)) {
+    return;
+  }
+
+  // Boxes that reach into the query have their min corner in
+  // (min - max_size, max), those are the only tiles to look in
+  i64 min_tile_x = (min_x - hash->max_size_x + 1) >> TILE_OFFSET_SHIFT;
+  i64 min_tile_y = (min_y - hash->max_size_y + 1) >> TILE_OFFSET_SHIFT;
+  i64 max_tile_x = (max_x - 1) >> TILE_OFFSET_SHIFT;
+  i64 max_tile_y = (max_y - 1) >> TILE_OFFSET_SHIFT;
+
+  for (i64 tile_y = min_tile_y; tile_y <= max_tile_y; ++tile_y) {
+    for (i64 tile_x = min_tile_x; tile_x <= max_tile_x; ++tile_x) {
+      u32 bucket_index = spatial_hash_bucket_index(hash, tile_x << TILE_OFFSET_SHIFT, tile_y << TILE_OFFSET_SHIFT);
+      u32 first_entry = hash->bucket_starts[bucket_index];
+      u32 end_entry = hash->bucket_starts[bucket_index + 1];
+
+      for (u32 entry_idx = first_entry; entry_idx < end_entry; ++entry_idx) {
+        SpatialHashEntry *entry = hash->entries + entry_idx;
+
+        // Other tiles share the bucket, and one of them can be in the query
+        // too, so only take the entries that are in this tile
+        if (((entry->min_x >> TILE_OFFSET_SHIFT) == tile_x) &&
+            ((entry->min_y >> TILE_OFFSET_SHIFT) == tile_y) &&
+            (entry->min_x < max_x) && (entry->max_x > min_x) &&
+            (entry->min_y < max_y) && (entry->max_y > min_y))
+        {
+          if (!visit(entry, data)) {
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+struct SpatialHashSlotList {
+  u32 count;
+  u32 max_count;
+  u32 *slots;
+
+  // Radius queries only
+  i64 center_x;
+  i64 center_y;
+  i64 radius_squared;
+};
+
+static SPATIAL_HASH_VISIT(add_visited_slot) {
+  SpatialHashSlotList *list = (SpatialHashSlotList *)data;
+  if (list->count == list->max_count) {
+    return false;
+  }
+
+  list->slots[list->count++] = entry->slot;
+  return true;
+}
+
+static SPATIAL_HASH_VISIT(add_visited_slot_in_radius) {
+  SpatialHashSlotList *list = (SpatialHashSlotList *)data;
+
+  // Closest point of the box to the center. max is exclusive, but a unit off
+  // at the far edge doesn't matter at this resolution.
+  i64 closest_x = (list->center_x < entry->min_x) ? entry->min_x :
+                  (list->center_x > entry->max_x) ? entry->max_x : list->center_x;
+  i64 closest_y = (list->center_y < entry->min_y) ? entry->min_y :
+                  (list->center_y > entry->max_y) ? entry->max_y : list->center_y;
+  i64 distance_x = closest_x - list->center_x;
+  i64 distance_y = closest_y - list->center_y;
+
+  if (distance_x * distance_x + distance_y * distance_y > list->radius_squared) {
+    return true;
+  }
+
+  return add_visited_slot(entry, data);
+}
+
+// Writes the slots of up to max_count entities overlapping the box from
+// min_pos to max_pos (max_pos exclusive) to slots, returns how many it wrote
+inline u32 spatial_hash_query_box(SpatialHash *hash, WorldPosition min_pos, WorldPosition max_pos, u32 *slots, u32 max_count) {
+  SpatialHashSlotList list = {};
+  list.max_count = max_count;
+  list.slots = slots;
+
+  spatial_hash_visit_box(hash,
+    get_absolute_offset(min_pos.abs_tile_x, min_pos.offset_x), get_absolute_offset(min_pos.abs_tile_y, min_pos.offset_y),
+    get_absolute_offset(max_pos.abs_tile_x, max_pos.offset_x), get_absolute_offset(max_pos.abs_tile_y, max_pos.offset_y),
+    add_visited_slot, &list);
+
+  return list.count;
+}
+
+// Same as spatial_hash_query_box, for entities that come within radius (tile
+// offset units) of center
+inline u32 spatial_hash_query_radius(SpatialHash *hash, WorldPosition center, i32 radius, u32 *slots, u32 max_count) {
+  Assert(radius >= 0);
+
+  SpatialHashSlotList list = {};
+  list.max_count = max_count;
+  list.slots = slots;
+  list.center_x = get_absolute_offset(center.abs_tile_x, center.offset_x);
+  list.center_y = get_absolute_offset(center.abs_tile_y, center.offset_y);
+  list.radius_squared = (i64)radius * radius;
+
+  spatial_hash_visit_box(hash,
+    list.center_x - radius, list.center_y - radius, list.center_x + radius + 1, list.center_y + radius + 1,
+    add_visited_slot_in_radius, &list);
+
+  return list.count;
+}
+
+// Writes up to max_count pairs of entities whose boxes overlap to pairs and
+// returns how many there were. Each pair comes out once.
+static u32 spatial_hash_find_pairs(SpatialHash *hash, EntityPair *pairs, u32 max_count) {
+  BEGIN_TIMED_BLOCK(FindEntityPairs);
+
+  u32 pair_count = 0;
+
+  for (u32 entry_idx = 0; entry_idx < hash->entry_count; ++entry_idx) {
+    SpatialHashEntry *entry = hash->entries + entry_idx;
+    i64 min_x = entry->min_x;
+    i64 min_y = entry->min_y;
+    i64 max_x = entry->max_x;
+    i64 max_y = entry->max_y;
+    u32 slot = entry->slot;
+
+    // Only looks forward of its own min corner (this tile at or after the
+    // entry, and later tiles), the pairs with anything before it were found
+    // when that was the entry being queried
+    i64 min_tile_x = (min_x - hash->max_size_x + 1) >> TILE_OFFSET_SHIFT;
+    i64 max_tile_x = (max_x - 1) >> TILE_OFFSET_SHIFT;
+    i64 entry_tile_x = min_x >> TILE_OFFSET_SHIFT;
+    i64 entry_tile_y = min_y >> TILE_OFFSET_SHIFT;
+    i64 max_tile_y = (max_y - 1) >> TILE_OFFSET_SHIFT;
+
+    for (i64 tile_y = entry_tile_y; tile_y <= max_tile_y; ++tile_y) {
+      for (i64 tile_x = (tile_y == entry_tile_y) ? entry_tile_x : min_tile_x; tile_x <= max_tile_x; ++tile_x) {
+        u32 bucket_index = spatial_hash_bucket_index(hash, tile_x << TILE_OFFSET_SHIFT, tile_y << TILE_OFFSET_SHIFT);
+        u32 first_entry = hash->bucket_starts[bucket_index];
+        u32 end_entry = hash->bucket_starts[bucket_index + 1];
+        if ((tile_x == entry_tile_x) && (tile_y == entry_tile_y)) {
+          first_entry = entry_idx + 1;
+        }
+
+        for (u32 other_idx = first_entry; other_idx < end_entry; ++other_idx) {
+          SpatialHashEntry *other = hash->entries + other_idx;
+
+          if (((other->min_x >> TILE_OFFSET_SHIFT) == tile_x) &&
+              ((other->min_y >> TILE_OFFSET_SHIFT) == tile_y) &&
+              (other->min_x < max_x) && (other->max_x > min_x) &&
+              (other->min_y < max_y) && (other->max_y > min_y))
+          {
+            if (pair_count < max_count) {
+              u32 other_slot = other->slot;
+              pairs[pair_count].slot_a = (slot < other_slot) ? slot : other_slot;
+              pairs[pair_count].slot_b = (slot < other_slot) ? other_slot : slot;
+            }
+            ++pair_count;
+          }
+        }
+      }
+    }
+  }
+
+  END_TIMED_BLOCK_COUNTED(FindEntityPairs, pair_count);
+  return pair_count;
+}
@@ -0,0 +1,43 @@
+#if !defined(HANDMADE_SPATIAL_H)
+#define HANDMADE_SPATIAL_H
+
+/*
+  Broadphase for entity vs entity queries. Entities are bucketed by the tile
+  their box's min corner is in, using the world's absolute tile coordinates so
+  it doesn't care about tile map seams. The whole thing is rebuilt from the
+  EntityStore every frame, into transient memory, with a counting sort.
+*/
+// Boxes are in absolute tile offset units (abs_tile * TILE_OFFSET_ONE +
+// offset), half open like CollisionBox. Kept together rather than as separate
+// arrays: the build writes each entry to a scattered spot and queries read
+// every field of the entries they look at.
+struct SpatialHashEntry {
+  i64 min_x;
+  i64 min_y;
+  i64 max_x;
+  i64 max_y;
+  u32 slot;
+};
+
+struct SpatialHash {
+  u32 bucket_count; // Power of two, at least twice the entity count
+  u32 bucket_shift; // 64 - log2(bucket_count)
+  u32 entry_count;
+
+  // Bucket b's entries are bucket_starts[b] up to bucket_starts[b + 1]
+  u32 *bucket_starts;
+  SpatialHashEntry *entries;
+
+  // Biggest box in the hash. A query has to look this far up and left of its
+  // own min corner to find every box that reaches into it.
+  i64 max_size_x;
+  i64 max_size_y;
+};
+
+// Two entities whose boxes overlap, slot_a < slot_b
+struct EntityPair {
+  u32 slot_a;
+  u32 slot_b;
+};
+
+#endif
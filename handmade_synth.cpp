@@ -0,0 +1,220 @@
+#include <immintrin.h>
+
+/*
+  Synth kernels
+
+  Each one adds count samples of one oscillator, read from table starting at
+  phase and stepping by phase_increment, times its gains, to the bus and
+  returns the phase after the last one. The wide kernels run 4 or 8 phases a
+  vector apart. Like the mix kernels there's no fused multiply add, so they
+  all produce exactly the same bus.
+*/
+#define SYNTHESIZE_SAMPLES(name) u32 name( \
+    f32 *bus_left, f32 *bus_right, f32 *table, u32 phase, u32 phase_increment, \
+    u32 count, f32 gain_left, f32 gain_right)
+typedef SYNTHESIZE_SAMPLES(SynthesizeSamples);
+
+struct SynthKernels {
+  SynthesizeSamples *synthesize;
+};
+
+// Picked on first use, same as the mix kernels
+global_variable SynthKernels global_synth_kernels;
+
+static SYNTHESIZE_SAMPLES(synthesize_samples_scalar) {
+  for (u32 idx = 0; idx < count; ++idx) {
+    u32 index = phase >> (32 - SYNTH_TABLE_BITS);
+    f32 fraction = (f32)((phase >> SYNTH_FRACTION_SHIFT) & 0xFFFF) * (1.0f / 65536.0f);
+    f32 sample = table[index] + (table[index + 1] - table[index]) * fraction;
+
+    bus_left[idx] += sample * gain_left;
+    bus_right[idx] += sample * gain_right;
+    phase += phase_increment;
+  }
+
+  return phase;
+}
+
+#if !defined(HANDMADE_FORCE_SCALAR_FILL)
+// SSE2 can't gather, so the lookups are scalar and only the interpolation
+// and the mixing are 4 wide
+static SYNTHESIZE_SAMPLES(synthesize_samples_sse2) {
+  __m128 gain_left_4x = _mm_set1_ps(gain_left);
+  __m128 gain_right_4x = _mm_set1_ps(gain_right);
+  __m128 fraction_scale = _mm_set1_ps(1.0f / 65536.0f);
+  __m128i fraction_mask = _mm_set1_epi32(0xFFFF);
+  __m128i phase_step = _mm_set1_epi32((i32)(4 * phase_increment));
+  __m128i phases = _mm_setr_epi32((i32)phase, (i32)(phase + phase_increment),
+    (i32)(phase + 2 * phase_increment), (i32)(phase + 3 * phase_increment));
+
+  u32 idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    alignas(16) u32 indices[4];
+    _mm_store_si128((__m128i *)indices, _mm_srli_epi32(phases, 32 - SYNTH_TABLE_BITS));
+
+    __m128 a = _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+    __m128 b = _mm_setr_ps(table[indices[0] + 1], table[indices[1] + 1], table[indices[2] + 1], table[indices[3] + 1]);
+    __m128 fraction = _mm_mul_ps(
+      _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(phases, SYNTH_FRACTION_SHIFT), fraction_mask)), fraction_scale);
+    __m128 sample = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fraction));
+
+    _mm_storeu_ps(bus_left + idx, _mm_add_ps(_mm_loadu_ps(bus_left + idx), _mm_mul_ps(sample, gain_left_4x)));
+    _mm_storeu_ps(bus_right + idx, _mm_add_ps(_mm_loadu_ps(bus_right + idx), _mm_mul_ps(sample, gain_right_4x)));
+    phases = _mm_add_epi32(phases, phase_step);
+  }
+
+  return synthesize_samples_scalar(bus_left + idx, bus_right + idx, table, (u32)_mm_cvtsi128_si32(phases),
+    phase_increment, count - idx, gain_left, gain_right);
+}
+
+__attribute__((target("avx2")))
+static SYNTHESIZE_SAMPLES(synthesize_samples_avx2) {
+  __m256 gain_left_8x = _mm256_set1_ps(gain_left);
+  __m256 gain_right_8x = _mm256_set1_ps(gain_right);
+  __m256 fraction_scale = _mm256_set1_ps(1.0f / 65536.0f);
+  __m256i fraction_mask = _mm256_set1_epi32(0xFFFF);
+  __m256i phase_step = _mm256_set1_epi32((i32)(8 * phase_increment));
+  __m256i phases = _mm256_add_epi32(_mm256_set1_epi32((i32)phase),
+    _mm256_mullo_epi32(_mm256_set1_epi32((i32)phase_increment), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+  u32 idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    __m256i indices = _mm256_srli_epi32(phases, 32 - SYNTH_TABLE_BITS);
+    __m256 a = _mm256_i32gather_ps(table, indices, 4);
+    __m256 b = _mm256_i32gather_ps(table + 1, indices, 4);
+    __m256 fraction = _mm256_mul_ps(
+      _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(phases, SYNTH_FRACTION_SHIFT), fraction_mask)), fraction_scale);
+    __m256 sample = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fraction));
+
+    _mm256_storeu_ps(bus_left + idx, _mm256_add_ps(_mm256_loadu_ps(bus_left + idx), _mm256_mul_ps(sample, gain_left_8x)));
+    _mm256_storeu_ps(bus_right + idx, _mm256_add_ps(_mm256_loadu_ps(bus_right + idx), _mm256_mul_ps(sample, gain_right_8x)));
+    phases = _mm256_add_epi32(phases, phase_step);
+  }
+
+  // Finished here for the same reason as mix_samples_avx2
+  phase = (u32)_mm256_cvtsi256_si32(phases);
+  for (; idx < count; ++idx) {
+    u32 index = phase >> (32 - SYNTH_TABLE_BITS);
+    f32 fraction = (f32)((phase >> SYNTH_FRACTION_SHIFT) & 0xFFFF) * (1.0f / 65536.0f);
+    f32 sample = table[index] + (table[index + 1] - table[index]) * fraction;
+
+    bus_left[idx] += sample * gain_left;
+    bus_right[idx] += sample * gain_right;
+    phase += phase_increment;
+  }
+
+  return phase;
+}
+#endif
+
+// Define HANDMADE_FORCE_SCALAR_FILL to use the scalar loop here too
+static void select_synth_kernels(void) {
+#if defined(HANDMADE_FORCE_SCALAR_FILL)
+  global_synth_kernels.synthesize = synthesize_samples_scalar;
+#else
+  global_synth_kernels.synthesize = synthesize_samples_sse2;
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    global_synth_kernels.synthesize = synthesize_samples_avx2;
+  }
+#endif
+}
+
+/*
+  Wavetables
+*/
+// Scales table to peak at full scale and fills in its guard entry
+static void finish_synth_table(f32 *table) {
+  f32 peak = 0.0f;
+  for (u32 idx = 0; idx < SYNTH_TABLE_SIZE; ++idx) {
+    f32 magnitude = (table[idx] < 0.0f) ? -table[idx] : table[idx];
+    peak = (magnitude > peak) ? magnitude : peak;
+  }
+
+  f32 scale = (peak > 0.0f) ? (32767.0f / peak) : 0.0f;
+  for (u32 idx = 0; idx < SYNTH_TABLE_SIZE; ++idx) {
+    table[idx] *= scale;
+  }
+  table[SYNTH_TABLE_SIZE] = table[0];
+}
+
+// Built once, when the mixer is made. Takes a few milliseconds.
+static SynthTables *allocate_synth_tables(MemoryArena *arena) {
+  SynthTables *result = PushStruct(arena, SynthTables);
+
+  // Unit sine, the other tables are sums of it sampled at multiples of the
+  // index, which land exactly on its entries
+  f32 *sine = PushArray(arena, SYNTH_TABLE_SIZE + 1, f32);
+  for (u32 idx = 0; idx < SYNTH_TABLE_SIZE; ++idx) {
+    sine[idx] = f32_sin(2.0f * Pi32 * (f32)idx / (f32)SYNTH_TABLE_SIZE);
+  }
+
+  for (u32 octave = 0; octave < SYNTH_OCTAVE_COUNT; ++octave) {
+    f32 *square = PushArray(arena, SYNTH_TABLE_SIZE + 1, f32);
+    f32 *saw = PushArray(arena, SYNTH_TABLE_SIZE + 1, f32);
+    memset(square, 0, SYNTH_TABLE_SIZE * sizeof(f32));
+    memset(saw, 0, SYNTH_TABLE_SIZE * sizeof(f32));
+
+    // Square is the odd harmonics at 1 / h, saw all of them at 1 / h with
+    // alternating signs so it rises through the cycle
+    u32 harmonic_count = (SYNTH_TABLE_SIZE / 4) >> octave;
+    for (u32 harmonic = 1; harmonic <= harmonic_count; ++harmonic) {
+      f32 amplitude = 1.0f / (f32)harmonic;
+      f32 saw_amplitude = (harmonic & 1) ? amplitude : -amplitude;
+
+      for (u32 idx = 0; idx < SYNTH_TABLE_SIZE; ++idx) {
+        f32 value = sine[(harmonic * idx) & (SYNTH_TABLE_SIZE - 1)];
+        saw[idx] += saw_amplitude * value;
+        if (harmonic & 1) {
+          square[idx] += amplitude * value;
+        }
+      }
+    }
+
+    finish_synth_table(square);
+    finish_synth_table(saw);
+    result->tables[Waveform_Square][octave] = square;
+    result->tables[Waveform_Saw][octave] = saw;
+  }
+
+  // Always the same noise, so the same sound plays the same way every time
+  f32 *noise = PushArray(arena, SYNTH_TABLE_SIZE + 1, f32);
+  u32 random_state = 0x9E3779B9;
+  for (u32 idx = 0; idx < SYNTH_TABLE_SIZE; ++idx) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    noise[idx] = (f32)(i32)random_state / 2147483648.0f;
+  }
+
+  finish_synth_table(sine);
+  finish_synth_table(noise);
+  for (u32 octave = 0; octave < SYNTH_OCTAVE_COUNT; ++octave) {
+    result->tables[Waveform_Sine][octave] = sine;
+    result->tables[Waveform_Noise][octave] = noise;
+  }
+
+  return result;
+}
+
+// The table with the most harmonics that all stay under Nyquist
+inline f32 *get_oscillator_table(SynthTables *tables, Oscillator *oscillator) {
+  i32 octave = 0;
+  if (oscillator->phase_increment) {
+    octave = (i32)find_most_significant_set_bit((u64)oscillator->phase_increment).index - (32 - SYNTH_TABLE_BITS);
+  }
+  octave = (octave < 0) ? 0 : (octave >= SYNTH_OCTAVE_COUNT) ? SYNTH_OCTAVE_COUNT - 1 : octave;
+
+  f32 *result = tables->tables[oscillator->waveform][octave];
+  return result;
+}
+
+// frequency in Hz at samples_per_second, clamped under Nyquist
+inline u32 get_phase_increment(f32 frequency, u32 samples_per_second) {
+  f64 cycles_per_sample = (f64)frequency / (f64)samples_per_second;
+  cycles_per_sample = (cycles_per_sample < 0.0) ? 0.0 : (cycles_per_sample > 0.4999) ? 0.4999 : cycles_per_sample;
+
+  u32 result = (u32)(cycles_per_sample * 4294967296.0);
+  return result;
+}
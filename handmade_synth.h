@@ -0,0 +1,51 @@
+#if !defined(HANDMADE_SYNTH_H)
+#define HANDMADE_SYNTH_H
+
+/*
+  Oscillators
+
+  Tones are read out of one cycle wavetables by a 32 bit phase accumulator: the
+  top SYNTH_TABLE_BITS of the phase pick the entry and the 16 bits under them
+  interpolate towards the next one. The phase wraps on its own at the end of a
+  cycle, so a tone stays on pitch however long it plays, and nothing per sample
+  goes near libm.
+
+  Square and saw have a table per octave holding only the harmonics that stay
+  under Nyquist for every frequency in that octave, so high notes don't alias.
+*/
+#define SYNTH_TABLE_BITS 11
+#define SYNTH_TABLE_SIZE (1 << SYNTH_TABLE_BITS)
+#define SYNTH_FRACTION_SHIFT (32 - SYNTH_TABLE_BITS - 16)
+
+// Octave o is used for phase increments below 2^(32 - SYNTH_TABLE_BITS + 1 + o)
+// and has harmonics up to (SYNTH_TABLE_SIZE / 4) >> o. The last one is a sine.
+#define SYNTH_OCTAVE_COUNT 10
+
+enum Waveform {
+  Waveform_Sine,
+  Waveform_Square,
+  Waveform_Saw,
+
+  // SYNTH_TABLE_SIZE random values played like any other table. Its frequency
+  // is how many times a second they all go by, which is 48000 / 2048 (23.4Hz)
+  // for a new value every sample at 48kHz.
+  Waveform_Noise,
+
+  Waveform_Count
+};
+
+// Each table is SYNTH_TABLE_SIZE + 1 entries, the last a copy of the first so
+// interpolating never has to wrap. Values are in 16 bit sample units, the same
+// as the mix bus. Sine and noise only have one table, every octave points at it.
+struct SynthTables {
+  f32 *tables[Waveform_Count][SYNTH_OCTAVE_COUNT];
+};
+
+struct Oscillator {
+  u32 waveform;
+  u32 phase;           // 2^32 is one cycle
+  u32 phase_increment; // Per output sample
+  u32 sample_count;    // How long it plays, when it doesn't loop
+};
+
+#endif
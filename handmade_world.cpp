@@ -0,0 +1,667 @@
+#include <immintrin.h>
+
+/*
+  Tile map storage
+
+  Tile maps live in a hash keyed on their tile map x/y, so the world can be any
+  shape and as far apart as i32 allows. They are created on demand from the
+  arena that's passed in, which should be permanent storage.
+*/
+
+#define TILE_MAP_HASH_INITIAL_BUCKET_COUNT 256
+
+inline u64 tile_map_hash_key(i32 tile_map_x, i32 tile_map_y) {
+  u64 key = ((u64)(u32)tile_map_y << 32) | (u64)(u32)tile_map_x;
+  return key;
+}
+
+// Fibonacci hashing, the top bits of the product pick the bucket
+inline u32 tile_map_hash_bucket_index(TileMapHash *hash, u64 key) {
+  u32 bucket_index = (u32)((key * 11400714819323198485ull) >> hash->bucket_shift);
+  return bucket_index;
+}
+
+static void allocate_tile_map_hash(MemoryArena *arena, TileMapHash *hash, u32 bucket_count) {
+  // bucket_count has to be a power of two
+  Assert((bucket_count & (bucket_count - 1)) == 0);
+
+  hash->bucket_count = bucket_count;
+  hash->bucket_shift = 64 - find_least_significant_set_bit(bucket_count).index;
+  hash->tile_map_count = 0;
+  hash->buckets = (TileMapBucket *)push_size_(arena, bucket_count * sizeof(TileMapBucket), 64);
+  memset(hash->buckets, 0, bucket_count * sizeof(TileMapBucket));
+}
+
+// Puts tile_map in the first free slot of its probe sequence. The key must not
+// be in the hash already.
+static void tile_map_hash_insert(TileMapHash *hash, TileMap *tile_map) {
+  u64 key = tile_map_hash_key(tile_map->tile_map_x, tile_map->tile_map_y);
+  u32 bucket_mask = hash->bucket_count - 1;
+
+  for (u32 bucket_index = tile_map_hash_bucket_index(hash, key);; bucket_index = (bucket_index + 1) & bucket_mask) {
+    TileMapBucket *bucket = &hash->buckets[bucket_index];
+
+    for (u32 slot_idx = 0; slot_idx < TILE_MAP_BUCKET_SLOT_COUNT; ++slot_idx) {
+      if (!bucket->tile_maps[slot_idx]) {
+        bucket->keys[slot_idx] = key;
+        bucket->tile_maps[slot_idx] = tile_map;
+        ++hash->tile_map_count;
+        return;
+      }
+    }
+  }
+}
+
+static TileMap *tile_map_hash_find(TileMapHash *hash, i32 tile_map_x, i32 tile_map_y) {
+  if (!hash->buckets) {
+    return 0;
+  }
+
+  u64 key = tile_map_hash_key(tile_map_x, tile_map_y);
+  u32 bucket_mask = hash->bucket_count - 1;
+
+  // The hash is never full, so this always ends at a match or an empty slot
+  for (u32 bucket_index = tile_map_hash_bucket_index(hash, key);; bucket_index = (bucket_index + 1) & bucket_mask) {
+    TileMapBucket *bucket = &hash->buckets[bucket_index];
+
+    for (u32 slot_idx = 0; slot_idx < TILE_MAP_BUCKET_SLOT_COUNT; ++slot_idx) {
+      TileMap *slot_tile_map = bucket->tile_maps[slot_idx];
+
+      if (!slot_tile_map) {
+        return 0;
+      }
+
+      if (bucket->keys[slot_idx] == key) {
+        return slot_tile_map;
+      }
+    }
+  }
+}
+
+// Moves every tile map over to a table twice the size. The old buckets are
+// left behind in the arena, which is fine since growing is rare.
+static void grow_tile_map_hash(MemoryArena *arena, TileMapHash *hash) {
+  TileMapHash old_hash = *hash;
+  allocate_tile_map_hash(arena, hash, old_hash.bucket_count ? 2 * old_hash.bucket_count : TILE_MAP_HASH_INITIAL_BUCKET_COUNT);
+
+  for (u32 bucket_index = 0; bucket_index < old_hash.bucket_count; ++bucket_index) {
+    TileMapBucket *bucket = &old_hash.buckets[bucket_index];
+
+    for (u32 slot_idx = 0; slot_idx < TILE_MAP_BUCKET_SLOT_COUNT; ++slot_idx) {
+      if (bucket->tile_maps[slot_idx]) {
+        tile_map_hash_insert(hash, bucket->tile_maps[slot_idx]);
+      }
+    }
+  }
+}
+
+// Returns 0 when there is no tile map at tile_map_x, tile_map_y
+inline TileMap * world_get_tile_map(World *world, i32 tile_map_x, i32 tile_map_y) {
+  TileMap *tile_map = world->last_tile_map;
+
+  if (!tile_map || (tile_map->tile_map_x != tile_map_x) || (tile_map->tile_map_y != tile_map_y)) {
+    tile_map = tile_map_hash_find(&world->tile_map_hash, tile_map_x, tile_map_y);
+
+    if (tile_map) {
+      world->last_tile_map = tile_map;
+    }
+  }
+
+  return tile_map;
+}
+
+// In handmade_path.cpp, which needs the world first
+static void update_flow_fields_for_tile(FlowFieldCache *cache, i32 abs_tile_x, i32 abs_tile_y);
+
+// Creates the tile map with all of its tiles set to 0 if it isn't there yet
+static TileMap *world_get_or_create_tile_map(MemoryArena *arena, World *world, i32 tile_map_x, i32 tile_map_y) {
+  TileMap *tile_map = world_get_tile_map(world, tile_map_x, tile_map_y);
+
+  if (!tile_map) {
+    TileMapHash *hash = &world->tile_map_hash;
+    u32 slot_count = hash->bucket_count * TILE_MAP_BUCKET_SLOT_COUNT;
+
+    if (4 * (hash->tile_map_count + 1) > 3 * slot_count) {
+      grow_tile_map_hash(arena, hash);
+    }
+
+    i32 tile_count = world->count_x * world->count_y;
+    i32 collision_word_count = world->collision_words_per_row * world->count_y;
+    Assert(world->collision_words_per_row == (world->count_x + 63) / 64);
+
+    tile_map = PushStruct(arena, TileMap);
+    tile_map->tile_map_x = tile_map_x;
+    tile_map->tile_map_y = tile_map_y;
+    tile_map->tiles = PushArray(arena, tile_count, u32);
+    memset(tile_map->tiles, 0, tile_count * sizeof(u32));
+    tile_map->solid_bits = (u64 *)push_size_(arena, collision_word_count * sizeof(u64), 16);
+    memset(tile_map->solid_bits, 0, collision_word_count * sizeof(u64));
+
+    tile_map_hash_insert(hash, tile_map);
+    world->last_tile_map = tile_map;
+
+    // Where there was no tile map it was solid
+    if (world->flow_fields) {
+      for (i32 y = 0; y < world->count_y; ++y) {
+        for (i32 x = 0; x < world->count_x; ++x) {
+          update_flow_fields_for_tile(world->flow_fields, tile_map_x * world->count_x + x, tile_map_y * world->count_y + y);
+        }
+      }
+    }
+  }
+
+  return tile_map;
+}
+
+inline void tile_map_set_tile_value(World *world, TileMap *tile_map, i32 x, i32 y, u32 value) {
+  Assert(tile_map);
+  Assert((x >= 0) && (x < world->count_x) && (y >= 0) && (y < world->count_y));
+
+  tile_map->tiles[y * world->count_x + x] = value;
+
+  u64 *word = &tile_map->solid_bits[y * world->collision_words_per_row + (x >> 6)];
+  u64 bit = 1ull << (x & 63);
+  bool was_solid = (*word & bit) != 0;
+  if (value != 0) {
+    *word |= bit;
+  } else {
+    *word &= ~bit;
+  }
+
+  if (world->flow_fields && (was_solid != (value != 0))) {
+    update_flow_fields_for_tile(world->flow_fields,
+      tile_map->tile_map_x * world->count_x + x, tile_map->tile_map_y * world->count_y + y);
+  }
+}
+
+// Sets every tile of tile_map from tiles, count_x * count_y of them row by row
+static void tile_map_set_tiles(World *world, TileMap *tile_map, const u32 *tiles) {
+  for (i32 y = 0; y < world->count_y; ++y) {
+    for (i32 x = 0; x < world->count_x; ++x) {
+      tile_map_set_tile_value(world, tile_map, x, y, tiles[y * world->count_x + x]);
+    }
+  }
+}
+
+
+/*
+  Positions
+*/
+static TileMapDivisor make_tile_map_divisor(i32 count) {
+  // With a 64 bit reciprocal the quotient is exact for every dividend under
+  // 2^64 / count, which covers every biased i32 below (Lemire et al., "Faster
+  // Remainder by Direct Computation"). count > 1 so the reciprocal fits.
+  Assert(count > 1);
+
+  TileMapDivisor divisor;
+  divisor.count = count;
+  divisor.reciprocal = 0xFFFFFFFFFFFFFFFFull / (u64)count + 1;
+  divisor.bias_tile_maps = (i32)((0x80000000ull + (u64)count - 1) / (u64)count);
+  divisor.bias = (u64)divisor.bias_tile_maps * (u64)count;
+
+  return divisor;
+}
+
+// Sets how many tiles a tile map has. Has to be done before any tile maps are
+// created.
+static void set_world_tile_map_size(World *world, i32 count_x, i32 count_y) {
+  Assert(world->tile_map_hash.tile_map_count == 0);
+
+  world->count_x = count_x;
+  world->count_y = count_y;
+  world->collision_words_per_row = (count_x + 63) / 64;
+  world->divisor_x = make_tile_map_divisor(count_x);
+  world->divisor_y = make_tile_map_divisor(count_y);
+}
+
+// Splits abs_tile into a tile map index (rounded towards -infinity) and the
+// tile inside it. A multiply and a subtract, no divide and no branches. Right
+// for every i32: biased is at least 0 and under 2^33, so it's done in 64 bits.
+inline void split_abs_tile(TileMapDivisor *divisor, i32 abs_tile, i32 *tile_map, i32 *tile) {
+  u64 biased = (u64)((i64)abs_tile + (i64)divisor->bias);
+  u64 quotient = (u64)(((unsigned __int128)divisor->reciprocal * biased) >> 64);
+
+  *tile = (i32)(biased - quotient * (u64)divisor->count);
+  *tile_map = (i32)((i64)quotient - divisor->bias_tile_maps);
+}
+
+inline TileMapPosition get_tile_map_position(World *world, WorldPosition pos) {
+  TileMapPosition result;
+  split_abs_tile(&world->divisor_x, pos.abs_tile_x, &result.tile_map_x, &result.tile_x);
+  split_abs_tile(&world->divisor_y, pos.abs_tile_y, &result.tile_map_y, &result.tile_y);
+
+  return result;
+}
+
+// Moves whole tiles out of the offsets and into the tile indexes. The shift is
+// arithmetic, so negative offsets borrow from the tile index.
+inline WorldPosition recanonicalize_position(WorldPosition pos) {
+  pos.abs_tile_x += pos.offset_x >> TILE_OFFSET_SHIFT;
+  pos.abs_tile_y += pos.offset_y >> TILE_OFFSET_SHIFT;
+  pos.offset_x &= TILE_OFFSET_MASK;
+  pos.offset_y &= TILE_OFFSET_MASK;
+
+  return pos;
+}
+
+// offset_x and offset_y are in TILE_OFFSET_ONE units per tile
+inline WorldPosition offset_position(WorldPosition pos, i32 offset_x, i32 offset_y) {
+  pos.offset_x += offset_x;
+  pos.offset_y += offset_y;
+
+  return recanonicalize_position(pos);
+}
+
+inline i32 pixels_to_tile_offset(World *world, f32 pixels) {
+  i32 offset = f32_round_to_i32(pixels * ((f32)TILE_OFFSET_ONE / (f32)world->tile_size_pixels));
+  return offset;
+}
+
+inline f32 tile_offset_to_pixels(World *world, i32 offset) {
+  f32 pixels = (f32)offset * ((f32)world->tile_size_pixels / (f32)TILE_OFFSET_ONE);
+  return pixels;
+}
+
+// Where pos is in pixels, relative to the upper left of its own tile map
+inline void get_tile_map_pixel_position(World *world, WorldPosition pos, f32 *x, f32 *y) {
+  TileMapPosition tile_map_pos = get_tile_map_position(world, pos);
+
+  *x = world->upper_left_x + (f32)(tile_map_pos.tile_x * world->tile_size_pixels) + tile_offset_to_pixels(world, pos.offset_x);
+  *y = world->upper_left_y + (f32)(tile_map_pos.tile_y * world->tile_size_pixels) + tile_offset_to_pixels(world, pos.offset_y);
+}
+
+static WorldPosition get_canonical_position(World *world, RawPosition raw_pos) {
+  WorldPosition world_pos;
+  world_pos.abs_tile_x = raw_pos.tile_map_x * world->count_x;
+  world_pos.abs_tile_y = raw_pos.tile_map_y * world->count_y;
+  world_pos.offset_x = pixels_to_tile_offset(world, raw_pos.x - world->upper_left_x);
+  world_pos.offset_y = pixels_to_tile_offset(world, raw_pos.y - world->upper_left_y);
+
+  return recanonicalize_position(world_pos);
+}
+
+
+/*
+  Collision
+*/
+inline u32 tile_map_get_unchecked_tile_value(World *world, TileMap *tile_map, i32 x, i32 y) {
+  Assert(tile_map);
+  Assert((x >= 0) && (x < world->count_x) && (y >= 0) && (y < world->count_y));
+
+  u32 val = tile_map->tiles[y * world->count_x + x];
+  return val;
+}
+
+inline bool tile_map_is_point_empty(World *world, TileMap *tile_map, i32 x, i32 y) {
+  bool empty = false;
+
+  if (tile_map) {
+    if ((x >= 0) && (x < world->count_x) &&
+        (y >= 0) && (y < world->count_y))
+    {
+      u64 word = tile_map->solid_bits[y * world->collision_words_per_row + (x >> 6)];
+      empty = ((word >> (x & 63)) & 1) == 0;
+    }
+  }
+
+  return empty;
+}
+
+// Bits min_bit..max_bit (inclusive, both 0..63) set
+inline u64 collision_span_mask(i32 min_bit, i32 max_bit) {
+  u64 mask = (~0ull << min_bit) & (~0ull >> (63 - max_bit));
+  return mask;
+}
+
+// True when none of the tiles min_x..max_x (inclusive) of row y are solid. The
+// span has to be inside the tile map.
+static bool tile_map_is_span_empty(World *world, TileMap *tile_map, i32 y, i32 min_x, i32 max_x) {
+  Assert((y >= 0) && (y < world->count_y));
+  Assert((min_x >= 0) && (min_x <= max_x) && (max_x < world->count_x));
+
+  u64 *row = tile_map->solid_bits + y * world->collision_words_per_row;
+  i32 min_word = min_x >> 6;
+  i32 max_word = max_x >> 6;
+
+  if (min_word == max_word) {
+    return (row[min_word] & collision_span_mask(min_x & 63, max_x & 63)) == 0;
+  }
+
+  u64 solid = row[min_word] & collision_span_mask(min_x & 63, 63);
+  solid |= row[max_word] & collision_span_mask(0, max_x & 63);
+
+  // Whole words in between, two at a time
+  i32 word_idx = min_word + 1;
+  __m128i wide_solid = _mm_setzero_si128();
+  for (; word_idx + 1 < max_word; word_idx += 2) {
+    wide_solid = _mm_or_si128(wide_solid, _mm_loadu_si128((__m128i *)(row + word_idx)));
+  }
+  for (; word_idx < max_word; ++word_idx) {
+    solid |= row[word_idx];
+  }
+
+  bool empty = (solid == 0) && (_mm_movemask_epi8(_mm_cmpeq_epi8(wide_solid, _mm_setzero_si128())) == 0xFFFF);
+  return empty;
+}
+
+// Solid bits of the 64 tiles from (x, y) along the row, bit 0 for (x, y).
+// Bits past the end of the row are junk. All solid when there's no tile map or
+// the row isn't in it.
+inline u64 tile_map_get_solid_run(World *world, TileMap *tile_map, i32 x, i32 y) {
+  if (!tile_map || (y < 0) || (y >= world->count_y)) {
+    return ~0ull;
+  }
+
+  Assert((x >= 0) && (x < world->count_x));
+  u64 *row = tile_map->solid_bits + y * world->collision_words_per_row;
+  i32 word_idx = x >> 6;
+  i32 shift = x & 63;
+
+  u64 run = row[word_idx] >> shift;
+  if (shift && (word_idx + 1 < world->collision_words_per_row)) {
+    run |= row[word_idx + 1] << (64 - shift);
+  }
+
+  return run;
+}
+
+// True when none of the tiles in min_x..max_x, min_y..max_y (inclusive) are
+// solid. The rectangle is clipped to the tile map, but anything outside of it
+// counts as solid, same as tile_map_is_point_empty.
+static bool tile_map_is_rect_empty(World *world, TileMap *tile_map, i32 min_x, i32 min_y, i32 max_x, i32 max_y) {
+  if (!tile_map ||
+      (min_x < 0) || (max_x >= world->count_x) ||
+      (min_y < 0) || (max_y >= world->count_y)) {
+    return false;
+  }
+
+  for (i32 y = min_y; y <= max_y; ++y) {
+    if (!tile_map_is_span_empty(world, tile_map, y, min_x, max_x)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+inline bool world_is_point_empty(World *world, WorldPosition test_pos) {
+  TileMapPosition tile_map_pos = get_tile_map_position(world, test_pos);
+  TileMap *tile_map = world_get_tile_map(world, tile_map_pos.tile_map_x, tile_map_pos.tile_map_y);
+  bool empty = tile_map_is_point_empty(world, tile_map, tile_map_pos.tile_x, tile_map_pos.tile_y);
+
+  return empty;
+}
+
+// True when every tile from min_pos to max_pos (inclusive, min_pos is the upper
+// left) is empty. The area can cross tile maps.
+static bool world_is_area_empty(World *world, WorldPosition min_world_pos, WorldPosition max_world_pos) {
+  TileMapPosition min_pos = get_tile_map_position(world, min_world_pos);
+  TileMapPosition max_pos = get_tile_map_position(world, max_world_pos);
+
+  for (i32 tile_map_y = min_pos.tile_map_y; tile_map_y <= max_pos.tile_map_y; ++tile_map_y) {
+    i32 min_y = (tile_map_y == min_pos.tile_map_y) ? min_pos.tile_y : 0;
+    i32 max_y = (tile_map_y == max_pos.tile_map_y) ? max_pos.tile_y : world->count_y - 1;
+
+    for (i32 tile_map_x = min_pos.tile_map_x; tile_map_x <= max_pos.tile_map_x; ++tile_map_x) {
+      i32 min_x = (tile_map_x == min_pos.tile_map_x) ? min_pos.tile_x : 0;
+      i32 max_x = (tile_map_x == max_pos.tile_map_x) ? max_pos.tile_x : world->count_x - 1;
+
+      TileMap *tile_map = world_get_tile_map(world, tile_map_x, tile_map_y);
+      if (!tile_map_is_rect_empty(world, tile_map, min_x, min_y, max_x, max_y)) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+/*
+  Swept boxes
+
+  world_move_box walks the tile grid from the box's starting position along the
+  motion (a DDA over the grid lines the leading edges cross, in order) and only
+  looks at the row or column of tiles the box enters at each crossing. The first
+  solid one stops that axis at the boundary and the rest of the motion slides
+  along it.
+
+  Everything is in tile offset units relative to the box's starting tile. A
+  crossing happens at time distance / |delta|, which is kept as that fraction
+  so crossings are ordered and the box is placed exactly, without rounding it
+  into a wall.
+*/
+// Most a box can move in one call, per axis. Keeps the products below in 64 bits.
+#define MAX_BOX_MOVE_TILES 1024
+
+inline i64 floor_div_i64(i64 a, i64 b) {
+  Assert(b > 0);
+  i64 quotient = a / b;
+  if ((a % b != 0) && (a < 0)) {
+    --quotient;
+  }
+
+  return quotient;
+}
+
+inline i64 ceil_div_i64(i64 a, i64 b) {
+  return -floor_div_i64(-a, b);
+}
+
+// Tiles min..max of one axis, in local tile units, covered by the interval
+// [min_edge, max_edge) moved by delta * numerator / denominator.
+inline void get_swept_tile_span(
+    i64 min_edge, i64 max_edge, i64 delta, i64 numerator, i64 denominator,
+    i64 *min_tile, i64 *max_tile
+  ) {
+  i64 shift = delta * numerator;
+  *min_tile = floor_div_i64(min_edge * denominator + shift, TILE_OFFSET_ONE * denominator);
+  *max_tile = ceil_div_i64(max_edge * denominator + shift, TILE_OFFSET_ONE * denominator) - 1;
+}
+
+// Tiles min..max of column x (or row y when !is_column), all in tiles relative
+// to origin
+static bool world_is_local_span_empty(World *world, WorldPosition origin, bool is_column, i64 line, i64 min, i64 max) {
+  WorldPosition min_pos = {};
+  WorldPosition max_pos = {};
+  if (is_column) {
+    min_pos.abs_tile_x = max_pos.abs_tile_x = origin.abs_tile_x + (i32)line;
+    min_pos.abs_tile_y = origin.abs_tile_y + (i32)min;
+    max_pos.abs_tile_y = origin.abs_tile_y + (i32)max;
+  } else {
+    min_pos.abs_tile_y = max_pos.abs_tile_y = origin.abs_tile_y + (i32)line;
+    min_pos.abs_tile_x = origin.abs_tile_x + (i32)min;
+    max_pos.abs_tile_x = origin.abs_tile_x + (i32)max;
+  }
+
+  return world_is_area_empty(world, min_pos, max_pos);
+}
+
+// Moves pos until the box hits something or uses up the delta. Whatever motion
+// is left to slide with stays in delta_x / delta_y.
+static void sweep_box(
+    World *world, WorldPosition *pos, CollisionBox box, i64 *delta_x, i64 *delta_y,
+    bool *hit_x, bool *hit_y
+  ) {
+  WorldPosition origin = *pos;
+  origin.offset_x = origin.offset_y = 0;
+
+  i64 dx = *delta_x;
+  i64 dy = *delta_y;
+  i64 abs_dx = (dx < 0) ? -dx : dx;
+  i64 abs_dy = (dy < 0) ? -dy : dy;
+
+  i64 min_x = (i64)pos->offset_x + box.min_x;
+  i64 max_x = (i64)pos->offset_x + box.max_x;
+  i64 min_y = (i64)pos->offset_y + box.min_y;
+  i64 max_y = (i64)pos->offset_y + box.max_y;
+
+  // Next column / row the leading edge enters, and how far away its boundary is
+  i64 next_col = (dx > 0) ? ceil_div_i64(max_x, TILE_OFFSET_ONE) : floor_div_i64(min_x, TILE_OFFSET_ONE) - 1;
+  i64 next_row = (dy > 0) ? ceil_div_i64(max_y, TILE_OFFSET_ONE) : floor_div_i64(min_y, TILE_OFFSET_ONE) - 1;
+  i64 dist_x = (dx > 0) ? next_col * TILE_OFFSET_ONE - max_x : min_x - (next_col + 1) * TILE_OFFSET_ONE;
+  i64 dist_y = (dy > 0) ? next_row * TILE_OFFSET_ONE - max_y : min_y - (next_row + 1) * TILE_OFFSET_ONE;
+  i64 step_x = (dx > 0) ? 1 : -1;
+  i64 step_y = (dy > 0) ? 1 : -1;
+
+  for (;;) {
+    // Only crossings strictly inside the motion enter a tile, ending up
+    // exactly on a boundary only touches it
+    bool crosses_x = (dist_x < abs_dx);
+    bool crosses_y = (dist_y < abs_dy);
+    if (!crosses_x && !crosses_y) {
+      break;
+    }
+
+    // dist_x / abs_dx against dist_y / abs_dy
+    bool x_first = crosses_x;
+    bool y_first = crosses_y;
+    if (crosses_x && crosses_y) {
+      i64 x_time = dist_x * abs_dy;
+      i64 y_time = dist_y * abs_dx;
+      x_first = (x_time <= y_time);
+      y_first = (y_time <= x_time);
+    }
+
+    bool blocked_x = false;
+    bool blocked_y = false;
+    i64 min_tile, max_tile;
+
+    if (x_first) {
+      get_swept_tile_span(min_y, max_y, dy, dist_x, abs_dx, &min_tile, &max_tile);
+      blocked_x = !world_is_local_span_empty(world, origin, true, next_col, min_tile, max_tile);
+    }
+    if (y_first) {
+      get_swept_tile_span(min_x, max_x, dx, dist_y, abs_dy, &min_tile, &max_tile);
+      blocked_y = !world_is_local_span_empty(world, origin, false, next_row, min_tile, max_tile);
+    }
+    if (x_first && y_first && !blocked_x && !blocked_y) {
+      // Going exactly through a corner, the diagonal tile is the only new one
+      blocked_x = !world_is_local_span_empty(world, origin, true, next_col, next_row, next_row);
+    }
+
+    if (blocked_x || blocked_y) {
+      // Stop everything at the time of impact. The blocked axis lands on the
+      // boundary, the other one is rounded back towards where it started.
+      i64 numerator = blocked_x ? dist_x : dist_y;
+      i64 denominator = blocked_x ? abs_dx : abs_dy;
+      i64 moved_x = blocked_x ? step_x * dist_x : (dx * numerator) / denominator;
+      i64 moved_y = blocked_y ? step_y * dist_y : (dy * numerator) / denominator;
+
+      *pos = offset_position(*pos, (i32)moved_x, (i32)moved_y);
+      *delta_x = blocked_x ? 0 : dx - moved_x;
+      *delta_y = blocked_y ? 0 : dy - moved_y;
+      *hit_x = *hit_x || blocked_x;
+      *hit_y = *hit_y || blocked_y;
+      return;
+    }
+
+    if (x_first) {
+      next_col += step_x;
+      dist_x += TILE_OFFSET_ONE;
+    }
+    if (y_first) {
+      next_row += step_y;
+      dist_y += TILE_OFFSET_ONE;
+    }
+  }
+
+  *pos = offset_position(*pos, (i32)dx, (i32)dy);
+  *delta_x = 0;
+  *delta_y = 0;
+}
+
+// Moves box (fixed to pos) by delta_x, delta_y tile offset units, sliding
+// along whatever it runs into. The box has to start out in empty tiles.
+static BoxMove world_move_box(World *world, WorldPosition pos, CollisionBox box, i32 delta_x, i32 delta_y) {
+  Assert((delta_x > -MAX_BOX_MOVE_TILES * TILE_OFFSET_ONE) && (delta_x < MAX_BOX_MOVE_TILES * TILE_OFFSET_ONE));
+  Assert((delta_y > -MAX_BOX_MOVE_TILES * TILE_OFFSET_ONE) && (delta_y < MAX_BOX_MOVE_TILES * TILE_OFFSET_ONE));
+
+  BoxMove result = {};
+  result.pos = pos;
+
+  i64 remaining_x = delta_x;
+  i64 remaining_y = delta_y;
+
+  // Each hit takes an axis out of the motion, so after two there's nothing left
+  for (int sweep_idx = 0; sweep_idx < 3; ++sweep_idx) {
+    if ((remaining_x == 0) && (remaining_y == 0)) {
+      break;
+    }
+    sweep_box(world, &result.pos, box, &remaining_x, &remaining_y, &result.hit_x, &result.hit_y);
+  }
+
+  return result;
+}
+
+
+/*
+  Camera
+
+  The camera is a world position that lands on the center of the screen.
+  Positions are turned into pixels relative to it, so the screen can sit
+  anywhere in the world and straddle tile map seams, and scrolls by fractions
+  of a pixel.
+*/
+// Where pos lands on a width x height screen, in pixels
+inline void get_screen_position(
+    World *world, WorldPosition camera_p, i32 width, i32 height,
+    WorldPosition pos, f32 *x, f32 *y
+  ) {
+  i64 delta_x = ((i64)pos.abs_tile_x - camera_p.abs_tile_x) * TILE_OFFSET_ONE + pos.offset_x - camera_p.offset_x;
+  i64 delta_y = ((i64)pos.abs_tile_y - camera_p.abs_tile_y) * TILE_OFFSET_ONE + pos.offset_y - camera_p.offset_y;
+  f32 pixels_per_offset = (f32)world->tile_size_pixels / (f32)TILE_OFFSET_ONE;
+
+  *x = 0.5f * (f32)width + (f32)delta_x * pixels_per_offset;
+  *y = 0.5f * (f32)height + (f32)delta_y * pixels_per_offset;
+}
+
+// Absolute tiles that are at least partly on a width x height screen, max
+// exclusive. Takes an extra pixel around the edge, so rounding the tiles to
+// whole pixels can't leave a gap.
+static Rectangle2i get_visible_tiles(World *world, WorldPosition camera_p, i32 width, i32 height) {
+  i64 half_width = ((i64)(width / 2 + 1) * TILE_OFFSET_ONE + world->tile_size_pixels - 1) / world->tile_size_pixels;
+  i64 half_height = ((i64)(height / 2 + 1) * TILE_OFFSET_ONE + world->tile_size_pixels - 1) / world->tile_size_pixels;
+
+  Rectangle2i tiles;
+  tiles.min_x = camera_p.abs_tile_x + (i32)floor_div_i64(camera_p.offset_x - half_width, TILE_OFFSET_ONE);
+  tiles.min_y = camera_p.abs_tile_y + (i32)floor_div_i64(camera_p.offset_y - half_height, TILE_OFFSET_ONE);
+  tiles.max_x = camera_p.abs_tile_x + (i32)ceil_div_i64(camera_p.offset_x + half_width, TILE_OFFSET_ONE);
+  tiles.max_y = camera_p.abs_tile_y + (i32)ceil_div_i64(camera_p.offset_y + half_height, TILE_OFFSET_ONE);
+
+  return tiles;
+}
+
+// Copies the values of the absolute tiles in tiles (max exclusive) to values,
+// row by row. Works along each row a tile map at a time.
+static void world_get_tile_values(World *world, Rectangle2i tiles, u32 *values) {
+  i32 row_width = tiles.max_x - tiles.min_x;
+
+  for (i32 abs_tile_y = tiles.min_y; abs_tile_y < tiles.max_y; ++abs_tile_y) {
+    i32 tile_map_y, tile_y;
+    split_abs_tile(&world->divisor_y, abs_tile_y, &tile_map_y, &tile_y);
+    u32 *row = values + (abs_tile_y - tiles.min_y) * row_width;
+
+    for (i32 abs_tile_x = tiles.min_x; abs_tile_x < tiles.max_x;) {
+      i32 tile_map_x, tile_x;
+      split_abs_tile(&world->divisor_x, abs_tile_x, &tile_map_x, &tile_x);
+
+      i32 run = world->count_x - tile_x;
+      if (run > tiles.max_x - abs_tile_x) {
+        run = tiles.max_x - abs_tile_x;
+      }
+
+      u32 *dest = row + (abs_tile_x - tiles.min_x);
+      TileMap *tile_map = world_get_tile_map(world, tile_map_x, tile_map_y);
+      if (tile_map) {
+        memcpy(dest, tile_map->tiles + tile_y * world->count_x + tile_x, run * sizeof(u32));
+      } else {
+        for (i32 idx = 0; idx < run; ++idx) {
+          dest[idx] = TILE_VALUE_NO_TILE_MAP;
+        }
+      }
+
+      abs_tile_x += run;
+    }
+  }
+}
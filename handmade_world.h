@@ -0,0 +1,128 @@
+#if !defined(HANDMADE_WORLD_H)
+#define HANDMADE_WORLD_H
+
+// One screen's worth of tiles (count_x * count_y). The world is a sparse grid
+// of these, only the ones that have been created take up memory.
+struct TileMap {
+  i32 tile_map_x;
+  i32 tile_map_y;
+
+  u32 *tiles;
+
+  // One bit per tile, set when the tile can't be walked through. Each row
+  // starts on a new word (World::collision_words_per_row of them). Kept in
+  // sync with tiles by tile_map_set_tile_value, collision only reads this.
+  u64 *solid_bits;
+};
+
+// What world_get_tile_values gives for tiles that have no tile map
+#define TILE_VALUE_NO_TILE_MAP 0xFFFFFFFF
+
+#define TILE_MAP_BUCKET_SLOT_COUNT 4
+
+// One cache line of the tile map hash: the keys are checked together and the
+// pointer next to a match is already loaded. A slot is empty when its tile map
+// is 0, and a lookup stops at the first empty slot it finds.
+struct alignas(64) TileMapBucket {
+  u64 keys[TILE_MAP_BUCKET_SLOT_COUNT];
+  TileMap *tile_maps[TILE_MAP_BUCKET_SLOT_COUNT];
+};
+
+// Open addressing, linear probing from bucket to bucket. Doubles when it gets
+// three quarters full.
+struct TileMapHash {
+  u32 bucket_count; // Power of two
+  u32 bucket_shift; // 64 - log2(bucket_count)
+  u32 tile_map_count;
+  TileMapBucket *buckets;
+};
+
+// Offsets into a tile are fixed point, TILE_OFFSET_ONE units to a tile
+#define TILE_OFFSET_SHIFT 16
+#define TILE_OFFSET_ONE (1 << TILE_OFFSET_SHIFT)
+#define TILE_OFFSET_MASK (TILE_OFFSET_ONE - 1)
+
+// A point in the world as an absolute tile index per axis (counted from tile 0
+// of tile map 0) and a fixed point offset into that tile. Offsets can be moved
+// anywhere and brought back into the tile with recanonicalize_position, which
+// is a shift and a mask. Nothing is lost to floating point on the way.
+struct WorldPosition {
+  i32 abs_tile_x;
+  i32 abs_tile_y;
+
+  // 0 <= offset < TILE_OFFSET_ONE when canonical. Offsets grow to the right
+  // and down, same as pixels.
+  i32 offset_x;
+  i32 offset_y;
+};
+
+// Which tile map an absolute tile is in and where in it
+struct TileMapPosition {
+  i32 tile_map_x;
+  i32 tile_map_y;
+  i32 tile_x;
+  i32 tile_y;
+};
+
+// Divides an absolute tile index by count_x or count_y, rounding down, with a
+// multiply instead of a divide. Set up by set_world_tile_map_size.
+struct TileMapDivisor {
+  u64 reciprocal;     // 2^64 / count, rounded up
+  u64 bias;           // Smallest multiple of count >= 2^31, added so indices are positive
+  i32 bias_tile_maps; // bias / count
+  i32 count;
+};
+
+struct RawPosition {
+  i32 tile_map_x;
+  i32 tile_map_y;
+
+  // tile-map relative x/y
+  f32 x;
+  f32 y;
+};
+
+// An axis aligned box fixed to a WorldPosition, in tile offset units. Covers
+// [pos + min, pos + max) on each axis, so a box whose max edge sits exactly on
+// a tile boundary doesn't touch the tile past it.
+struct CollisionBox {
+  i32 min_x;
+  i32 min_y;
+  i32 max_x;
+  i32 max_y;
+};
+
+// Where world_move_box left a box and which axes it was stopped on. The
+// motion along a stopped axis was thrown away, the rest slid on.
+struct BoxMove {
+  WorldPosition pos;
+  bool hit_x;
+  bool hit_y;
+};
+
+struct FlowFieldCache;
+
+struct World {
+  f32 tile_size_meters;
+  i32 tile_size_pixels;
+
+  i32 count_x;
+  i32 count_y;
+  i32 collision_words_per_row;
+  TileMapDivisor divisor_x;
+  TileMapDivisor divisor_y;
+
+  f32 upper_left_x;
+  f32 upper_left_y;
+
+  TileMapHash tile_map_hash;
+
+  // Most lookups are for the tile map the player is standing in, so the last
+  // one found is checked before going to the hash.
+  TileMap *last_tile_map;
+
+  // Told about every tile that turns solid or open, when there is one
+  FlowFieldCache *flow_fields;
+};
+
+#endif
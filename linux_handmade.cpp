@@ -0,0 +1,712 @@
+/*
+  Platform services shared by every Linux host (file io, live-loading the game
+  code, the work queue, timing, sound output and output files). Each host
+  includes this after handmade.h and linux_handmade.h. What only some hosts use
+  is inline rather than static, so the others don't warn about it going unused.
+*/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// Get path of where this executable is running
+static void linux_get_exe_file_name(LinuxState *state) {
+  ssize_t size_of_file_name = readlink("/proc/self/exe", state->exe_file_name, sizeof(state->exe_file_name) - 1);
+  if (size_of_file_name < 0) {
+    size_of_file_name = 0;
+  }
+  state->exe_file_name[size_of_file_name] = 0;
+  state->exe_file_name_one_past_last_slash = state->exe_file_name;
+
+  for (char *scan = state->exe_file_name; *scan; ++scan) {
+    if (*scan == '/') {
+      state->exe_file_name_one_past_last_slash = scan + 1;
+    }
+  }
+}
+
+static void linux_build_exe_path_file_name(LinuxState *state, const char *file_name, int dest_count, char *dest) {
+  snprintf(dest, dest_count, "%.*s%s",
+    (int)(state->exe_file_name_one_past_last_slash - state->exe_file_name),
+    state->exe_file_name,
+    file_name);
+}
+
+
+DEBUG_PLATFORM_FREE_FILE_MEMORY(dbg_platform_free_file_memory) {
+  if (memory) {
+    free(memory);
+  }
+}
+
+DEBUG_PLATFORM_READ_ENTIRE_FILE(dbg_platform_read_entire_file) {
+  DebugFileReadResult result = {};
+
+  int file_handle = open(file_name, O_RDONLY);
+  if (file_handle == -1) {
+    // TODO - Log error
+    return result;
+  }
+
+  struct stat file_status;
+  if (fstat(file_handle, &file_status) == -1) {
+    // TODO - Log error
+    close(file_handle);
+    return result;
+  }
+
+  u32 file_size_32 = u64_safe_truncate_to_u32((u64)file_status.st_size);
+  result.contents = malloc(file_size_32 ? file_size_32 : 1);
+
+  if (!result.contents) {
+    // TODO - Log error
+    close(file_handle);
+    return result;
+  }
+
+  u32 bytes_to_read = file_size_32;
+  u8 *next_byte = (u8 *)result.contents;
+
+  while (bytes_to_read) {
+    ssize_t bytes_read = read(file_handle, next_byte, bytes_to_read);
+    if (bytes_read <= 0) {
+      break;
+    }
+
+    bytes_to_read -= (u32)bytes_read;
+    next_byte += bytes_read;
+  }
+
+  if (bytes_to_read == 0) {
+    result.contents_size = file_size_32;
+  } else {
+    dbg_platform_free_file_memory(thread_ctx, result.contents);
+    result.contents = 0;
+  }
+
+  close(file_handle);
+
+  return result;
+}
+
+DEBUG_PLATFORM_READ_FILE_CHUNK(dbg_platform_read_file_chunk) {
+  u32 result = 0;
+
+  int file_handle = open(file_name, O_RDONLY);
+  if (file_handle == -1) {
+    // TODO - Log error
+    return result;
+  }
+
+  u8 *next_byte = (u8 *)dest;
+
+  while (result < size) {
+    ssize_t bytes_read = pread(file_handle, next_byte, size - result, (off_t)(offset + result));
+    if (bytes_read <= 0) {
+      break;
+    }
+
+    result += (u32)bytes_read;
+    next_byte += bytes_read;
+  }
+
+  close(file_handle);
+
+  return result;
+}
+
+DEBUG_PLATFORM_WRITE_ENTIRE_FILE(dbg_platform_write_entire_file) {
+  bool result = false;
+
+  int file_handle = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (file_handle != -1) {
+    u32 bytes_to_write = memory_size;
+    u8 *next_byte = (u8 *)memory;
+
+    while (bytes_to_write) {
+      ssize_t bytes_written = write(file_handle, next_byte, bytes_to_write);
+      if (bytes_written <= 0) {
+        break;
+      }
+
+      bytes_to_write -= (u32)bytes_written;
+      next_byte += bytes_written;
+    }
+
+    result = bytes_to_write == 0;
+    close(file_handle);
+  }
+  else {
+    // TODO - log error
+  }
+
+  return result;
+}
+
+
+inline time_t linux_get_last_write_time(const char *file_path) {
+  time_t last_write_time = 0;
+
+  struct stat file_status;
+  if (stat(file_path, &file_status) == 0) {
+    last_write_time = file_status.st_mtime;
+  }
+
+  return last_write_time;
+}
+
+// dlopen hands back the already loaded library for a path it has seen before,
+// so the library is copied to temp_library_name first (like the Win32 layer)
+// which also lets the build overwrite the original while it's loaded.
+static LinuxGameCode linux_load_game_code(const char *source_library_name, const char *temp_library_name) {
+  LinuxGameCode game_code = {};
+  game_code.last_write_time = linux_get_last_write_time(source_library_name);
+
+  DebugFileReadResult library_file = dbg_platform_read_entire_file(0, source_library_name);
+  if (library_file.contents) {
+    dbg_platform_write_entire_file(0, temp_library_name, library_file.contents_size, library_file.contents);
+    dbg_platform_free_file_memory(0, library_file.contents);
+
+    game_code.library = dlopen(temp_library_name, RTLD_NOW | RTLD_LOCAL);
+  }
+
+  if (game_code.library) {
+    game_code.update_and_render =
+      (PtrGameUpdateAndRender *)dlsym(game_code.library, "game_update_and_render");
+    game_code.get_sound_samples =
+      (PtrGameGetSoundSamples *)dlsym(game_code.library, "game_get_sound_samples");
+
+    game_code.is_valid = (
+        game_code.update_and_render &&
+        game_code.get_sound_samples
+    );
+  } else {
+    fprintf(stderr, "Couldn't load game code from %s: %s\n", source_library_name, dlerror());
+  }
+
+  // Default to stub functions on failure
+  if (!game_code.is_valid) {
+    game_code.update_and_render = game_update_and_render_stub;
+    game_code.get_sound_samples = game_get_sound_samples_stub;
+  }
+
+  return game_code;
+}
+
+// Unloads the live-loaded game code library
+static void linux_unload_game_code(LinuxGameCode *game_code) {
+  if (game_code->library) {
+    dlclose(game_code->library);
+    game_code->library = 0;
+  }
+
+  game_code->is_valid = false;
+  game_code->update_and_render = game_update_and_render_stub;
+  game_code->get_sound_samples = game_get_sound_samples_stub;
+}
+
+
+/*
+  Work queue
+*/
+PLATFORM_ADD_ENTRY(linux_add_entry) {
+  u32 new_next_entry_to_write = (queue->next_entry_to_write + 1) % ArrayCount(queue->entries);
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  PlatformWorkQueueEntry *entry = &queue->entries[queue->next_entry_to_write];
+  entry->callback = callback;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  // The entry has to be fully written before a worker can see it
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  queue->next_entry_to_write = new_next_entry_to_write;
+
+  sem_post(&queue->semaphore);
+}
+
+// Runs one entry if there is one. Returns true when the queue was empty.
+static bool linux_do_next_work_queue_entry(PlatformWorkQueue *queue, ThreadContext *thread_ctx) {
+  bool we_should_sleep = false;
+
+  u32 original_next_entry_to_read = queue->next_entry_to_read;
+  u32 new_next_entry_to_read = (original_next_entry_to_read + 1) % ArrayCount(queue->entries);
+
+  if (original_next_entry_to_read != queue->next_entry_to_write) {
+    // Several threads can race for the same entry. Only the one that moves
+    // next_entry_to_read forward gets to run it.
+    u32 expected = original_next_entry_to_read;
+    if (__atomic_compare_exchange_n(&queue->next_entry_to_read, &expected, new_next_entry_to_read,
+                                    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      PlatformWorkQueueEntry entry = queue->entries[original_next_entry_to_read];
+      entry.callback(thread_ctx, entry.data);
+      __atomic_add_fetch(&queue->completion_count, 1, __ATOMIC_RELEASE);
+    }
+  } else {
+    we_should_sleep = true;
+  }
+
+  return we_should_sleep;
+}
+
+PLATFORM_COMPLETE_ALL_WORK(linux_complete_all_work) {
+  ThreadContext thread_ctx = {};
+
+  while (queue->completion_goal != __atomic_load_n(&queue->completion_count, __ATOMIC_ACQUIRE)) {
+    linux_do_next_work_queue_entry(queue, &thread_ctx);
+  }
+
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+}
+
+static void *linux_work_queue_thread_proc(void *parameter) {
+  LinuxThreadStartup *startup = (LinuxThreadStartup *)parameter;
+  PlatformWorkQueue *queue = startup->queue;
+
+  ThreadContext thread_ctx = {};
+  thread_ctx.logical_thread_index = startup->logical_thread_index;
+
+  for (;;) {
+    if (linux_do_next_work_queue_entry(queue, &thread_ctx)) {
+      sem_wait(&queue->semaphore);
+    }
+  }
+
+  return 0;
+}
+
+static void linux_make_work_queue(PlatformWorkQueue *queue, u32 thread_count, LinuxThreadStartup *startups) {
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+  queue->next_entry_to_write = 0;
+  queue->next_entry_to_read = 0;
+
+  sem_init(&queue->semaphore, 0, 0);
+
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx) {
+    LinuxThreadStartup *startup = &startups[thread_idx];
+    startup->logical_thread_index = thread_idx + 1;
+    startup->queue = queue;
+
+    pthread_t thread;
+    pthread_create(&thread, 0, linux_work_queue_thread_proc, startup);
+    pthread_detach(thread);
+  }
+}
+
+// One worker per logical core besides the one the main thread runs on
+static u32 linux_get_default_worker_thread_count(void) {
+  long processor_count = sysconf(_SC_NPROCESSORS_ONLN);
+  u32 thread_count = (processor_count > 1) ? (u32)(processor_count - 1) : 0;
+
+  if (thread_count > LINUX_MAX_WORKER_THREAD_COUNT) {
+    thread_count = LINUX_MAX_WORKER_THREAD_COUNT;
+  }
+
+  return thread_count;
+}
+
+
+/*
+  Memory
+*/
+
+// Game memory is one block so it can be snapshotted in one go, same as Win32
+static bool linux_allocate_game_memory(LinuxState *state, GameMemory *game_memory) {
+  state->game_memory_total_size = game_memory->permanent_storage_size + game_memory->transient_storage_size;
+  state->game_memory = mmap(
+    0,
+    (size_t)state->game_memory_total_size,
+    PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+    -1,
+    0
+  );
+
+  if (state->game_memory == MAP_FAILED) {
+    state->game_memory = 0;
+    return false;
+  }
+
+  game_memory->permanent_storage = state->game_memory;
+  game_memory->transient_storage = ((u8 *)game_memory->permanent_storage + game_memory->permanent_storage_size);
+
+  return true;
+}
+
+// Rows are padded out to whole cache lines and start on a 64 byte boundary
+inline void linux_resize_back_buffer(LinuxOffScreenBuffer *buffer, int width, int height) {
+  if (buffer->memory) {
+    free(buffer->memory);
+  }
+
+  buffer->width = width;
+  buffer->height = height;
+  buffer->bytes_per_pixel = 4;
+  buffer->pitch = Align(width * buffer->bytes_per_pixel, 64);
+  buffer->memory = aligned_alloc(64, (size_t)buffer->pitch * height);
+  memset(buffer->memory, 0, (size_t)buffer->pitch * height);
+
+  buffer->dirty_rects.is_full_frame = true;
+  buffer->dirty_rects.count = 0;
+}
+
+inline GameOffScreenBuffer linux_get_game_buffer(LinuxOffScreenBuffer *back_buffer) {
+  GameOffScreenBuffer game_offscreen_buffer = {};
+  game_offscreen_buffer.memory = back_buffer->memory;
+  game_offscreen_buffer.width = back_buffer->width;
+  game_offscreen_buffer.height = back_buffer->height;
+  game_offscreen_buffer.pitch = back_buffer->pitch;
+  game_offscreen_buffer.bytes_per_pixel = back_buffer->bytes_per_pixel;
+  game_offscreen_buffer.dirty_rects = &back_buffer->dirty_rects;
+
+  return game_offscreen_buffer;
+}
+
+// Copies what the game changed last frame from the back buffer into dest, one
+// span per row of each dirty rect. dest has to be the same size as the buffer.
+inline void linux_copy_dirty_spans(LinuxOffScreenBuffer *buffer, void *dest, int dest_pitch) {
+  DirtyRectList *dirty_rects = &buffer->dirty_rects;
+  Rectangle2i full_frame = {0, 0, buffer->width, buffer->height};
+
+  u32 rect_count = dirty_rects->is_full_frame ? 1 : dirty_rects->count;
+
+  for (u32 rect_idx = 0; rect_idx < rect_count; ++rect_idx) {
+    Rectangle2i rect = dirty_rects->is_full_frame ? full_frame : dirty_rects->rects[rect_idx];
+    size_t span_size = (size_t)(rect.max_x - rect.min_x) * buffer->bytes_per_pixel;
+
+    for (int y = rect.min_y; y < rect.max_y; ++y) {
+      memcpy(
+        (u8 *)dest + y * dest_pitch + rect.min_x * buffer->bytes_per_pixel,
+        (u8 *)buffer->memory + y * buffer->pitch + rect.min_x * buffer->bytes_per_pixel,
+        span_size
+      );
+    }
+  }
+}
+
+
+/*
+  Input
+*/
+static void linux_process_keyboard_message(GameButtonState *new_state, bool is_down) {
+  if (new_state->ended_down != is_down) {
+    new_state->ended_down = is_down;
+    ++new_state->half_transition_count;
+  }
+}
+
+
+/*
+  Timing
+*/
+inline timespec linux_get_wall_clock(void) {
+  timespec counter;
+  clock_gettime(CLOCK_MONOTONIC, &counter);
+  return counter;
+}
+
+inline f32 linux_get_seconds_elapsed(timespec start, timespec end) {
+  f32 elapsed_seconds = (f32)(end.tv_sec - start.tv_sec) + (f32)(end.tv_nsec - start.tv_nsec) / 1.0e9f;
+  return elapsed_seconds;
+}
+
+inline void linux_add_nanoseconds(timespec *time, u64 nanoseconds) {
+  u64 total = (u64)time->tv_nsec + nanoseconds;
+  time->tv_sec += (time_t)(total / 1000000000);
+  time->tv_nsec = (long)(total % 1000000000);
+}
+
+// Sleeps until time on the linux_get_wall_clock clock, however many signals come in
+inline void linux_sleep_until(timespec time) {
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, 0) == EINTR) {}
+}
+
+
+/*
+  Output files
+*/
+
+// Writes a binary PPM. pixels are 0xXXRRGGBB like the back buffer.
+inline bool linux_write_ppm(const char *file_name, void *pixels, int width, int height, int pitch) {
+  FILE *file = fopen(file_name, "wb");
+  if (!file) {
+    return false;
+  }
+
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+  u8 *row_out = (u8 *)malloc((size_t)width * 3);
+  u8 *row = (u8 *)pixels;
+
+  for (int y = 0; y < height; ++y) {
+    u32 *pixel = (u32 *)row;
+    u8 *out = row_out;
+
+    for (int x = 0; x < width; ++x) {
+      u32 color = *pixel++;
+      *out++ = (u8)(color >> 16);
+      *out++ = (u8)(color >> 8);
+      *out++ = (u8)(color >> 0);
+    }
+
+    fwrite(row_out, 3, width, file);
+    row += pitch;
+  }
+
+  free(row_out);
+  fclose(file);
+
+  return true;
+}
+
+#pragma pack(push, 1)
+struct WavHeader {
+  u32 riff_id;
+  u32 riff_size;
+  u32 wave_id;
+
+  u32 fmt_id;
+  u32 fmt_size;
+  u16 format_tag;
+  u16 channels;
+  u32 samples_per_second;
+  u32 avg_bytes_per_second;
+  u16 block_align;
+  u16 bits_per_sample;
+
+  u32 data_id;
+  u32 data_size;
+};
+#pragma pack(pop)
+
+// 16 bit stereo PCM, sample_count stereo pairs of it
+static WavHeader linux_get_wav_header(u32 samples_per_second, u32 sample_count) {
+  u32 data_size = sample_count * 2 * sizeof(i16);
+
+  WavHeader header = {};
+  header.riff_id = 0x46464952; // "RIFF"
+  header.riff_size = sizeof(WavHeader) - 8 + data_size;
+  header.wave_id = 0x45564157; // "WAVE"
+  header.fmt_id = 0x20746d66; // "fmt "
+  header.fmt_size = 16;
+  header.format_tag = 1; // PCM
+  header.channels = 2;
+  header.samples_per_second = samples_per_second;
+  header.block_align = 2 * sizeof(i16);
+  header.avg_bytes_per_second = header.samples_per_second * header.block_align;
+  header.bits_per_sample = 16;
+  header.data_id = 0x61746164; // "data"
+  header.data_size = data_size;
+
+  return header;
+}
+
+static void linux_write_wav_header(LinuxWavWriter *writer) {
+  WavHeader header = linux_get_wav_header(writer->samples_per_second, writer->sample_count);
+
+  fseek(writer->file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, writer->file);
+  fseek(writer->file, 0, SEEK_END);
+}
+
+inline bool linux_open_wav(LinuxWavWriter *writer, const char *file_name, u32 samples_per_second) {
+  writer->file = fopen(file_name, "wb");
+  writer->samples_per_second = samples_per_second;
+  writer->sample_count = 0;
+
+  if (writer->file) {
+    linux_write_wav_header(writer);
+  }
+
+  return writer->file != 0;
+}
+
+// samples are interleaved LRLR..., sample_count counts stereo pairs
+inline void linux_append_wav(LinuxWavWriter *writer, i16 *samples, u32 sample_count) {
+  if (writer->file) {
+    fwrite(samples, 2 * sizeof(i16), sample_count, writer->file);
+    writer->sample_count += sample_count;
+  }
+}
+
+inline void linux_close_wav(LinuxWavWriter *writer) {
+  if (writer->file) {
+    linux_write_wav_header(writer);
+    fclose(writer->file);
+    writer->file = 0;
+  }
+}
+
+
+/*
+  Sound output
+*/
+// Mixes blocks until target_block_count are queued. Game thread only. Returns
+// how many it mixed.
+static u32 linux_fill_audio_ring(LinuxAudioOutput *output, LinuxGameCode *game_code,
+                                 ThreadContext *thread_ctx, GameMemory *game_memory) {
+  LinuxAudioRing *ring = &output->ring;
+  u32 block_count = 0;
+
+  u32 write_index = ring->write_index;
+  while (write_index - __atomic_load_n(&ring->read_index, __ATOMIC_ACQUIRE) < output->target_block_count) {
+    GameSoundOutputBuffer sound_buffer = {};
+    sound_buffer.samples_per_second = output->samples_per_second;
+    sound_buffer.sample_count = LINUX_AUDIO_BLOCK_SAMPLE_COUNT;
+    sound_buffer.samples = ring->blocks[write_index % LINUX_AUDIO_BLOCK_COUNT];
+    game_code->get_sound_samples(thread_ctx, game_memory, &sound_buffer);
+
+    // The block has to be fully written before the audio thread can see it
+    ++write_index;
+    __atomic_store_n(&ring->write_index, write_index, __ATOMIC_RELEASE);
+    ++block_count;
+  }
+
+  return block_count;
+}
+
+static void *linux_audio_thread_proc(void *parameter) {
+  LinuxAudioOutput *output = (LinuxAudioOutput *)parameter;
+  LinuxAudioRing *ring = &output->ring;
+
+  // The device starts when there's something to play, so the first frame
+  // loading doesn't count as an underrun
+  while (__atomic_load_n(&output->is_running, __ATOMIC_ACQUIRE) &&
+         __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE) == 0) {
+    timespec poll_time = {0, 1000000};
+    nanosleep(&poll_time, 0);
+  }
+
+  // Deadlines are worked out from the start rather than the last wake up, so
+  // late wake ups don't add up to drift
+  timespec start_time = linux_get_wall_clock();
+
+  u64 block_idx = 0;
+  while (__atomic_load_n(&output->is_running, __ATOMIC_ACQUIRE)) {
+    i16 *samples = output->silence;
+
+    u32 read_index = ring->read_index;
+    if (read_index != __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE)) {
+      samples = ring->blocks[read_index % LINUX_AUDIO_BLOCK_COUNT];
+    } else {
+      __atomic_store_n(&output->underrun_count, output->underrun_count + 1, __ATOMIC_RELAXED);
+    }
+
+    ssize_t bytes_written = write(output->file, samples, sizeof(output->silence));
+    (void)bytes_written;
+
+    // Hands the block back only once it's been written out
+    if (samples != output->silence) {
+      __atomic_store_n(&ring->read_index, read_index + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&output->played_sample_count,
+                     output->played_sample_count + LINUX_AUDIO_BLOCK_SAMPLE_COUNT, __ATOMIC_RELAXED);
+
+    ++block_idx;
+    timespec deadline = start_time;
+    linux_add_nanoseconds(&deadline,
+        block_idx * LINUX_AUDIO_BLOCK_SAMPLE_COUNT * 1000000000 / output->samples_per_second);
+    linux_sleep_until(deadline);
+  }
+
+  return 0;
+}
+
+// Starts the null device writing to file_name, with the ring kept a frame of
+// target_seconds_per_frame ahead plus LINUX_AUDIO_SAFETY_BLOCK_COUNT. Returns
+// false if it can't be opened.
+static bool linux_start_audio_output(LinuxAudioOutput *output, const char *file_name, u32 samples_per_second,
+                                     f32 target_seconds_per_frame) {
+  output->file = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (output->file == -1) {
+    return false;
+  }
+
+  u32 frame_sample_count = (u32)(target_seconds_per_frame * (f32)samples_per_second + 0.5f);
+  u32 frame_block_count = (frame_sample_count + LINUX_AUDIO_BLOCK_SAMPLE_COUNT - 1) / LINUX_AUDIO_BLOCK_SAMPLE_COUNT;
+  output->target_block_count = frame_block_count + LINUX_AUDIO_SAFETY_BLOCK_COUNT;
+  if (output->target_block_count > LINUX_AUDIO_BLOCK_COUNT) {
+    output->target_block_count = LINUX_AUDIO_BLOCK_COUNT;
+  }
+
+  output->samples_per_second = samples_per_second;
+  output->ring.write_index = 0;
+  output->ring.read_index = 0;
+  output->played_sample_count = 0;
+  output->underrun_count = 0;
+  memset(output->silence, 0, sizeof(output->silence));
+
+  // Sizes are patched in when it stops
+  WavHeader header = linux_get_wav_header(samples_per_second, 0);
+  ssize_t bytes_written = write(output->file, &header, sizeof(header));
+  (void)bytes_written;
+
+  __atomic_store_n(&output->is_running, true, __ATOMIC_RELEASE);
+  if (pthread_create(&output->thread, 0, linux_audio_thread_proc, output) != 0) {
+    output->is_running = false;
+    close(output->file);
+    output->file = -1;
+    return false;
+  }
+
+  return true;
+}
+
+static void linux_stop_audio_output(LinuxAudioOutput *output) {
+  if (output->is_running) {
+    __atomic_store_n(&output->is_running, false, __ATOMIC_RELEASE);
+    pthread_join(output->thread, 0);
+
+    WavHeader header = linux_get_wav_header(output->samples_per_second, (u32)output->played_sample_count);
+    ssize_t bytes_written = pwrite(output->file, &header, sizeof(header), 0);
+    (void)bytes_written;
+
+    close(output->file);
+    output->file = -1;
+  }
+}
+
+
+#if HANDMADE_INTERNAL
+// Adds the game's timed blocks for the last frame to totals and resets them.
+static void linux_handle_debug_cycle_counters(GameMemory *memory, LinuxDebugCycleTotal *totals) {
+  for (u32 counter_idx = 0; counter_idx < ArrayCount(memory->counters); ++counter_idx) {
+    DebugCycleCounter *counter = &memory->counters[counter_idx];
+
+    totals[counter_idx].cycle_count += counter->cycle_count;
+    totals[counter_idx].hit_count += counter->hit_count;
+
+    counter->cycle_count = 0;
+    counter->hit_count = 0;
+  }
+}
+
+// Prints what linux_handle_debug_cycle_counters added up over frame_count frames
+static void linux_print_debug_cycle_totals(LinuxDebugCycleTotal *totals, int counter_count, u64 frame_count) {
+  printf("DEBUG CYCLE COUNTS (%llu frames):\n", (unsigned long long)frame_count);
+
+  for (int counter_idx = 0; counter_idx < counter_count; ++counter_idx) {
+    LinuxDebugCycleTotal *counter = &totals[counter_idx];
+
+    if (counter->hit_count && frame_count) {
+      printf("  %d: %llucy/frame %.02fh/frame %.02fcy/h\n",
+        counter_idx,
+        (unsigned long long)(counter->cycle_count / frame_count),
+        (f64)counter->hit_count / (f64)frame_count,
+        (f64)counter->cycle_count / (f64)counter->hit_count);
+    }
+  }
+}
+#endif
@@ -0,0 +1,149 @@
+#if !defined(LINUX_HANDMADE_H)
+#define LINUX_HANDMADE_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+  Data Structures
+*/
+
+// Holds function pointers imported for live-loading game code.
+struct LinuxGameCode {
+  // The shared library where these function pointers are defined and implemented
+  void *library;
+
+  // The last time this file was written to.
+  time_t last_write_time;
+
+  // function pointer
+  PtrGameUpdateAndRender *update_and_render;
+
+  // function pointer
+  PtrGameGetSoundSamples *get_sound_samples;
+
+  // Indicates if the function pointers were loaded
+  bool is_valid;
+};
+
+struct LinuxOffScreenBuffer {
+	void *memory;
+	int width;
+	int height;
+	int pitch;
+	int bytes_per_pixel;
+
+	// What the game changed in the last frame
+	DirtyRectList dirty_rects;
+};
+
+#define LINUX_STATE_FILE_NAME_COUNT 4096
+
+struct LinuxState {
+  // indicates the size of the game memory chunk
+  u64 game_memory_total_size;
+
+  // pointer to the game memory address
+  void *game_memory;
+
+  char exe_file_name[LINUX_STATE_FILE_NAME_COUNT];
+  char *exe_file_name_one_past_last_slash;
+};
+
+struct PlatformWorkQueueEntry {
+  platform_work_queue_callback *callback;
+  void *data;
+};
+
+// Single writer (the game's thread), many readers (every worker plus the game's
+// thread while it waits in complete_all_work).
+struct PlatformWorkQueue {
+  u32 volatile completion_goal;
+  u32 volatile completion_count;
+
+  u32 volatile next_entry_to_write;
+  u32 volatile next_entry_to_read;
+
+  // Counts entries that haven't been picked up yet. Idle workers sleep on it.
+  sem_t semaphore;
+
+  PlatformWorkQueueEntry entries[256];
+};
+
+#define LINUX_MAX_WORKER_THREAD_COUNT 64
+
+struct LinuxThreadStartup {
+  u32 logical_thread_index;
+  PlatformWorkQueue *queue;
+};
+
+#if HANDMADE_INTERNAL
+// A DebugCycleCounter added up over a whole run. The game's hit counts are
+// per frame and fit in 32 bits, a run's worth of pixels doesn't.
+struct LinuxDebugCycleTotal {
+  u64 cycle_count;
+  u64 hit_count;
+};
+#endif
+
+// 16 bit stereo PCM written out as it is produced. The RIFF sizes get patched
+// in when the file is closed.
+struct LinuxWavWriter {
+  FILE *file;
+  u32 samples_per_second;
+  u32 sample_count;
+};
+
+/*
+  Sound output
+
+  The game mixes fixed size blocks into a ring ahead of time, on its own
+  thread, and the audio thread hands them to the device as it asks for them.
+  It's only topped up to a frame's worth plus LINUX_AUDIO_SAFETY_BLOCK_COUNT,
+  since a sound started this frame is heard after everything queued. A frame
+  that runs late eats into the safety blocks, so sound keeps playing through
+  any hitch shorter than them.
+*/
+#define LINUX_AUDIO_BLOCK_SAMPLE_COUNT 480 // 10ms at 48kHz
+#define LINUX_AUDIO_BLOCK_COUNT 10
+#define LINUX_AUDIO_SAFETY_BLOCK_COUNT 2
+
+// Single writer (the game's thread), single reader (the audio thread). Both
+// indices only ever count up, block n lives at n % LINUX_AUDIO_BLOCK_COUNT,
+// and the ring is full when they're LINUX_AUDIO_BLOCK_COUNT apart.
+struct LinuxAudioRing {
+  u32 volatile write_index;
+  u32 volatile read_index;
+
+  // Interleaved LRLR...
+  i16 blocks[LINUX_AUDIO_BLOCK_COUNT][2 * LINUX_AUDIO_BLOCK_SAMPLE_COUNT];
+};
+
+/*
+  Stands in for a sound card: takes a block every block period of wall clock
+  time, writing it to a WAV file (/dev/null to just throw it away). Everything
+  the audio thread touches is in here, so once it's started it never locks or
+  allocates, only sleeps and writes.
+*/
+struct LinuxAudioOutput {
+  LinuxAudioRing ring;
+
+  int file;
+  u32 samples_per_second;
+
+  // Blocks linux_fill_audio_ring keeps queued
+  u32 target_block_count;
+
+  pthread_t thread;
+  bool volatile is_running;
+
+  // Only written by the audio thread
+  u64 volatile played_sample_count;
+  u32 volatile underrun_count; // Blocks played as silence because the ring was empty
+
+  i16 silence[2 * LINUX_AUDIO_BLOCK_SAMPLE_COUNT];
+};
+
+#endif
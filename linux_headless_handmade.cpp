@@ -0,0 +1,529 @@
+/*
+  Headless Linux host. Runs the game as fast as it can without a window or an
+  audio device, optionally writing every frame to a PPM and the sound to a WAV.
+  Useful for profiling the game code on its own and for checking its output.
+
+  With --audio-device it runs in real time instead, frames paced to --hz, and
+  the sound goes through the audio thread to a null device that plays it into
+  a WAV file. --hitch makes some frames run long to check the sound survives.
+
+  linux_headless_handmade [options]
+    --game <path>      game library (default: handmade.so next to the executable)
+    --width <n>        back buffer width (default 960)
+    --height <n>       back buffer height (default 540)
+    --frames <n>       frames to run (default 600)
+    --hz <n>           simulated refresh rate (default 30)
+    --threads <n>      worker threads (default: one per extra logical core)
+    --ppm <prefix>     write frame N to <prefix>NNNNN.ppm
+    --wav <file>       write the game's sound to a WAV file
+    --audio-device <file>
+                       run in real time, playing the sound into a WAV file
+    --hitch <ms>       with --audio-device, stall every 30th frame this long
+    --wander           steer the player around instead of standing still
+
+  Options that load the game with extra work every frame (GameDebugLoad), for
+  timing systems the game doesn't use hard yet with the cycle counters. Only in
+  a HANDMADE_INTERNAL build, like the counters:
+    --simulate-everything
+                       simulate every entity, not just the ones near the camera
+    --entity-churn <n> n random entities removed and added back somewhere else
+    --spatial-queries <n>
+                       n box and n radius queries in a broadphase of every entity
+    --path-queries <n> n find_path queries between random open tiles
+    --flow-field-changes <n>
+                       n tiles turned solid and back, passed on to a flow field
+    --check-flow-fields
+                       trap if a flow field update differs from a rebuild
+    --voices <n>       n looping voices of voice.wav, or of a sine without one
+    --tones <n>        n looping oscillators, their frequency changed every frame
+    --rate-sweep       play a test tone through the resampler at 0.25 to 4 times
+                       its rate over the run and print how far the sound is off
+                       the sine it should be (not with --audio-device)
+*/
+
+#include "handmade.h"
+#include "linux_handmade.h"
+#include "linux_handmade.cpp"
+
+#include <math.h>
+
+
+struct LinuxHeadlessOptions {
+  const char *game_library_name;
+  int width;
+  int height;
+  int frame_count;
+  int game_update_hz;
+  int thread_count;
+  const char *ppm_prefix;
+  const char *wav_file_name;
+  const char *audio_device_file_name;
+  int hitch_milliseconds;
+  bool wander;
+
+#if HANDMADE_INTERNAL
+  bool simulate_everything;
+  int entity_churn_count;
+  int spatial_query_count;
+  int path_query_count;
+  int flow_field_change_count;
+  bool check_flow_field_changes;
+  int voice_count;
+  int tone_count;
+  bool rate_sweep;
+#endif
+};
+
+static void linux_print_usage(const char *exe_name) {
+  fprintf(stderr,
+    "usage: %s [--game <path>] [--width <n>] [--height <n>] [--frames <n>] [--hz <n>]\n"
+    "          [--threads <n>] [--ppm <prefix>] [--wav <file>] [--audio-device <file>]\n"
+    "          [--hitch <ms>] [--wander]\n",
+    exe_name);
+#if HANDMADE_INTERNAL
+  fprintf(stderr,
+    "          [--simulate-everything] [--entity-churn <n>] [--spatial-queries <n>]\n"
+    "          [--path-queries <n>] [--flow-field-changes <n>] [--check-flow-fields]\n"
+    "          [--voices <n>] [--tones <n>] [--rate-sweep]\n");
+#endif
+}
+
+static bool linux_parse_options(int argc, char **argv, LinuxHeadlessOptions *options) {
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const char *arg = argv[arg_idx];
+    const char *value = (arg_idx + 1 < argc) ? argv[arg_idx + 1] : 0;
+
+    if (strcmp(arg, "--wander") == 0) {
+      options->wander = true;
+      continue;
+    }
+#if HANDMADE_INTERNAL
+    if (strcmp(arg, "--simulate-everything") == 0) {
+      options->simulate_everything = true;
+      continue;
+    }
+    if (strcmp(arg, "--check-flow-fields") == 0) {
+      options->check_flow_field_changes = true;
+      continue;
+    }
+    if (strcmp(arg, "--rate-sweep") == 0) {
+      options->rate_sweep = true;
+      continue;
+    }
+#endif
+
+    if (!value) {
+      return false;
+    }
+
+    if (strcmp(arg, "--game") == 0) {
+      options->game_library_name = value;
+    } else if (strcmp(arg, "--width") == 0) {
+      options->width = atoi(value);
+    } else if (strcmp(arg, "--height") == 0) {
+      options->height = atoi(value);
+    } else if (strcmp(arg, "--frames") == 0) {
+      options->frame_count = atoi(value);
+    } else if (strcmp(arg, "--hz") == 0) {
+      options->game_update_hz = atoi(value);
+    } else if (strcmp(arg, "--threads") == 0) {
+      options->thread_count = atoi(value);
+    } else if (strcmp(arg, "--ppm") == 0) {
+      options->ppm_prefix = value;
+    } else if (strcmp(arg, "--wav") == 0) {
+      options->wav_file_name = value;
+    } else if (strcmp(arg, "--audio-device") == 0) {
+      options->audio_device_file_name = value;
+    } else if (strcmp(arg, "--hitch") == 0) {
+      options->hitch_milliseconds = atoi(value);
+#if HANDMADE_INTERNAL
+    } else if (strcmp(arg, "--entity-churn") == 0) {
+      options->entity_churn_count = atoi(value);
+    } else if (strcmp(arg, "--spatial-queries") == 0) {
+      options->spatial_query_count = atoi(value);
+    } else if (strcmp(arg, "--path-queries") == 0) {
+      options->path_query_count = atoi(value);
+    } else if (strcmp(arg, "--flow-field-changes") == 0) {
+      options->flow_field_change_count = atoi(value);
+    } else if (strcmp(arg, "--voices") == 0) {
+      options->voice_count = atoi(value);
+    } else if (strcmp(arg, "--tones") == 0) {
+      options->tone_count = atoi(value);
+#endif
+    } else {
+      return false;
+    }
+
+    ++arg_idx;
+  }
+
+#if HANDMADE_INTERNAL
+  bool debug_load_is_valid = (
+    options->entity_churn_count >= 0 &&
+    options->spatial_query_count >= 0 &&
+    options->path_query_count >= 0 &&
+    options->flow_field_change_count >= 0 &&
+    options->voice_count >= 0 &&
+    options->tone_count >= 0 &&
+    // Both would pull sound from the same mixer
+    !(options->rate_sweep && options->audio_device_file_name)
+  );
+#else
+  bool debug_load_is_valid = true;
+#endif
+
+  return (
+    options->width > 0 &&
+    options->height > 0 &&
+    options->frame_count >= 0 &&
+    options->game_update_hz > 0 &&
+    options->thread_count <= LINUX_MAX_WORKER_THREAD_COUNT &&
+    options->hitch_milliseconds >= 0 &&
+    // Both would pull sound from the same mixer
+    !(options->wav_file_name && options->audio_device_file_name) &&
+    debug_load_is_valid
+  );
+}
+
+// Holds one direction for a while then picks another. Deterministic so runs
+// can be compared against each other.
+static void linux_wander(GameControllerInput *controller, int frame_idx) {
+  local_persist u32 random_state = 0x2545F491;
+  local_persist u32 direction = 0;
+
+  if ((frame_idx % 45) == 0) {
+    random_state = random_state * 1664525 + 1013904223;
+    direction = (random_state >> 16) % 5;
+  }
+
+  linux_process_keyboard_message(&controller->move_up, direction == 1);
+  linux_process_keyboard_message(&controller->move_down, direction == 2);
+  linux_process_keyboard_message(&controller->move_left, direction == 3);
+  linux_process_keyboard_message(&controller->move_right, direction == 4);
+}
+
+#if HANDMADE_INTERNAL
+// The test tone's frequency at rate 1, see GameDebugLoad::test_tone_rate
+#define LINUX_SWEEP_TONE_FREQUENCY 8000.0
+// Every resample bank passes the tone whole below this. Above the output's
+// Nyquist it should be gone, not aliased back down.
+#define LINUX_SWEEP_PASSBAND_FREQUENCY 12000.0
+
+struct LinuxRateSweep {
+  // Of the tone in the last passband frame, what the rest is measured against
+  f64 tone_rms;
+
+  int passband_frame_count;
+  f64 worst_passband_noise_db;
+  int stopband_frame_count;
+  f64 worst_stopband_leakage_db;
+};
+
+// Geometric from 0.25 on the first frame to 4 on the last
+static f32 linux_get_sweep_rate(int frame_idx, int frame_count) {
+  f64 t = (frame_count > 1) ? (f64)frame_idx / (f64)(frame_count - 1) : 0.0;
+  f32 result = (f32)(0.25 * pow(16.0, t));
+  return result;
+}
+
+// Fits a sine at the frequency the tone should be at to a frame of the left
+// channel, by least squares. In the passband what the fit leaves is noise,
+// above Nyquist all of it is.
+static void linux_check_rate_sweep(LinuxRateSweep *sweep, i16 *samples, int sample_count,
+    u32 samples_per_second, f32 rate) {
+  f64 frequency = LINUX_SWEEP_TONE_FREQUENCY * (f64)rate;
+  f64 omega = 2.0 * M_PI * frequency / (f64)samples_per_second;
+
+  f64 cc = 0.0, cs = 0.0, ss = 0.0;
+  f64 xc = 0.0, xs = 0.0, xx = 0.0;
+  for (int sample_idx = 0; sample_idx < sample_count; ++sample_idx) {
+    f64 x = (f64)samples[2 * sample_idx];
+    f64 c = cos(omega * sample_idx);
+    f64 s = sin(omega * sample_idx);
+    cc += c * c;
+    cs += c * s;
+    ss += s * s;
+    xc += x * c;
+    xs += x * s;
+    xx += x * x;
+  }
+
+  f64 det = cc * ss - cs * cs;
+  f64 a = (xc * ss - xs * cs) / det;
+  f64 b = (xs * cc - xc * cs) / det;
+  f64 residual = xx - (a * xc + b * xs);
+  f64 residual_rms = sqrt(((residual > 0.0) ? residual : 0.0) / sample_count);
+  f64 total_rms = sqrt(xx / sample_count);
+
+  if (frequency < LINUX_SWEEP_PASSBAND_FREQUENCY) {
+    sweep->tone_rms = sqrt(0.5 * (a * a + b * b));
+    f64 noise_db = 20.0 * log10(((residual_rms > 1e-9) ? residual_rms : 1e-9) / sweep->tone_rms);
+    if (!sweep->passband_frame_count++ || noise_db > sweep->worst_passband_noise_db) {
+      sweep->worst_passband_noise_db = noise_db;
+    }
+  } else if ((frequency > 0.5 * samples_per_second) && (sweep->tone_rms > 0.0)) {
+    f64 leakage_db = 20.0 * log10(((total_rms > 1e-9) ? total_rms : 1e-9) / sweep->tone_rms);
+    if (!sweep->stopband_frame_count++ || leakage_db > sweep->worst_stopband_leakage_db) {
+      sweep->worst_stopband_leakage_db = leakage_db;
+    }
+  }
+}
+#endif
+
+
+int main(int argc, char **argv) {
+  LinuxState linux_state = {};
+  linux_get_exe_file_name(&linux_state);
+
+  char source_game_library_full_path[LINUX_STATE_FILE_NAME_COUNT];
+  linux_build_exe_path_file_name(&linux_state, "handmade.so",
+      sizeof(source_game_library_full_path), source_game_library_full_path);
+
+  char temp_game_library_full_path[LINUX_STATE_FILE_NAME_COUNT];
+  snprintf(temp_game_library_full_path, sizeof(temp_game_library_full_path),
+      "/tmp/handmade_temp_%d.so", (int)getpid());
+
+  LinuxHeadlessOptions options = {};
+  options.game_library_name = source_game_library_full_path;
+  options.width = 960;
+  options.height = 540;
+  options.frame_count = 600;
+  options.game_update_hz = 30;
+  options.thread_count = -1;
+
+  if (!linux_parse_options(argc, argv, &options)) {
+    linux_print_usage(argv[0]);
+    return 1;
+  }
+
+  f32 target_seconds_per_frame = 1.0f / (f32)options.game_update_hz;
+
+  u32 worker_thread_count = (options.thread_count >= 0) ?
+    (u32)options.thread_count : linux_get_default_worker_thread_count();
+
+  local_persist PlatformWorkQueue high_priority_queue;
+  local_persist LinuxThreadStartup high_priority_startups[LINUX_MAX_WORKER_THREAD_COUNT];
+  linux_make_work_queue(&high_priority_queue, worker_thread_count, high_priority_startups);
+
+  // Always one worker, even when there are none above: streaming sound needs
+  // its reads done while the game thread gets on with frames
+  local_persist PlatformWorkQueue low_priority_queue;
+  local_persist LinuxThreadStartup low_priority_startups[1];
+  linux_make_work_queue(&low_priority_queue, 1, low_priority_startups);
+
+  GameMemory game_memory = {};
+  game_memory.permanent_storage_size = Megabytes(64);
+  game_memory.transient_storage_size = Gigabytes((u64)1);
+  game_memory.dbg_platform_free_file_memory = dbg_platform_free_file_memory;
+  game_memory.dbg_platform_read_entire_file = dbg_platform_read_entire_file;
+  game_memory.dbg_platform_write_entire_file = dbg_platform_write_entire_file;
+  game_memory.dbg_platform_read_file_chunk = dbg_platform_read_file_chunk;
+  game_memory.high_priority_queue = &high_priority_queue;
+  game_memory.low_priority_queue = &low_priority_queue;
+  game_memory.worker_thread_count = worker_thread_count;
+  game_memory.add_entry = linux_add_entry;
+  game_memory.complete_all_work = linux_complete_all_work;
+#if HANDMADE_INTERNAL
+  game_memory.debug_load.simulate_everything = options.simulate_everything;
+  game_memory.debug_load.entity_churn_count = (u32)options.entity_churn_count;
+  game_memory.debug_load.spatial_query_count = (u32)options.spatial_query_count;
+  game_memory.debug_load.path_query_count = (u32)options.path_query_count;
+  game_memory.debug_load.flow_field_change_count = (u32)options.flow_field_change_count;
+  game_memory.debug_load.check_flow_field_changes = options.check_flow_field_changes;
+  game_memory.debug_load.voice_count = (u32)options.voice_count;
+  game_memory.debug_load.tone_count = (u32)options.tone_count;
+
+  LinuxRateSweep rate_sweep = {};
+#endif
+
+  if (!linux_allocate_game_memory(&linux_state, &game_memory)) {
+    fprintf(stderr, "Couldn't allocate game memory\n");
+    return 1;
+  }
+
+  LinuxOffScreenBuffer back_buffer = {};
+  linux_resize_back_buffer(&back_buffer, options.width, options.height);
+
+  // What a display would be showing, only updated where the game said it drew
+  void *front_buffer = 0;
+  if (options.ppm_prefix) {
+    front_buffer = calloc((size_t)back_buffer.pitch, back_buffer.height);
+  }
+
+  // Same rate the Win32 layer asks DirectSound for. A frame's worth of samples
+  // is handed out at a time, carrying the fraction over to the next frame.
+  u32 samples_per_second = 48000;
+  u32 max_samples_per_frame = samples_per_second / options.game_update_hz + 1;
+  i16 *samples = (i16 *)calloc(max_samples_per_frame, 2 * sizeof(i16));
+  u64 running_sample_index = 0;
+
+  LinuxWavWriter wav_writer = {};
+  if (options.wav_file_name && !linux_open_wav(&wav_writer, options.wav_file_name, samples_per_second)) {
+    fprintf(stderr, "Couldn't open %s\n", options.wav_file_name);
+  }
+
+  LinuxGameCode game_code = linux_load_game_code(options.game_library_name, temp_game_library_full_path);
+  if (!game_code.is_valid) {
+    return 1;
+  }
+
+  bool is_real_time = options.audio_device_file_name != 0;
+  local_persist LinuxAudioOutput audio_output;
+  if (is_real_time && !linux_start_audio_output(&audio_output, options.audio_device_file_name, samples_per_second,
+      target_seconds_per_frame)) {
+    fprintf(stderr, "Couldn't open %s\n", options.audio_device_file_name);
+    return 1;
+  }
+
+#if HANDMADE_INTERNAL
+  LinuxDebugCycleTotal debug_cycle_totals[ArrayCount(game_memory.counters)] = {};
+#endif
+
+  GameInput game_input[2] = {};
+  GameInput *new_input = &game_input[0];
+  GameInput *old_input = &game_input[1];
+
+  ThreadContext thread_ctx = {};
+
+  f32 update_seconds = 0.0f;
+  f32 sound_seconds = 0.0f;
+  f32 present_seconds = 0.0f;
+
+  timespec start_counter = linux_get_wall_clock();
+
+  for (int frame_idx = 0; frame_idx < options.frame_count; ++frame_idx) {
+    time_t new_library_write_time = linux_get_last_write_time(options.game_library_name);
+    if (new_library_write_time != game_code.last_write_time) {
+      // Reads still in flight would call back into the old library
+      linux_complete_all_work(&low_priority_queue);
+      linux_unload_game_code(&game_code);
+      game_code = linux_load_game_code(options.game_library_name, temp_game_library_full_path);
+    }
+
+    new_input->target_seconds_per_frame = target_seconds_per_frame;
+#if HANDMADE_INTERNAL
+    if (options.rate_sweep) {
+      game_memory.debug_load.test_tone_rate = linux_get_sweep_rate(frame_idx, options.frame_count);
+    }
+#endif
+
+    // Carry the keyboard's buttons over so half transitions are counted per frame
+    GameControllerInput *old_keyboard_controller = &old_input->controllers[0];
+    GameControllerInput *new_keyboard_controller = &new_input->controllers[0];
+    *new_keyboard_controller = {};
+    new_keyboard_controller->is_connected = true;
+    for (u32 button_idx = 0; button_idx < ArrayCount(new_keyboard_controller->buttons); ++button_idx) {
+      new_keyboard_controller->buttons[button_idx].ended_down =
+        old_keyboard_controller->buttons[button_idx].ended_down;
+    }
+
+    if (options.wander) {
+      linux_wander(new_keyboard_controller, frame_idx);
+    }
+
+    timespec update_start_counter = linux_get_wall_clock();
+
+    GameOffScreenBuffer game_offscreen_buffer = linux_get_game_buffer(&back_buffer);
+    game_code.update_and_render(&thread_ctx, &game_memory, new_input, &game_offscreen_buffer);
+#if HANDMADE_INTERNAL
+    linux_handle_debug_cycle_counters(&game_memory, debug_cycle_totals);
+#endif
+
+    timespec sound_start_counter = linux_get_wall_clock();
+
+    if (is_real_time) {
+      linux_fill_audio_ring(&audio_output, &game_code, &thread_ctx, &game_memory);
+    } else {
+      u64 next_running_sample_index = (u64)(frame_idx + 1) * samples_per_second / options.game_update_hz;
+
+      GameSoundOutputBuffer sound_buffer = {};
+      sound_buffer.samples_per_second = samples_per_second;
+      sound_buffer.sample_count = (int)(next_running_sample_index - running_sample_index);
+      sound_buffer.samples = samples;
+      game_code.get_sound_samples(&thread_ctx, &game_memory, &sound_buffer);
+      running_sample_index = next_running_sample_index;
+
+      linux_append_wav(&wav_writer, samples, sound_buffer.sample_count);
+#if HANDMADE_INTERNAL
+      if (options.rate_sweep) {
+        linux_check_rate_sweep(&rate_sweep, samples, sound_buffer.sample_count, samples_per_second,
+          game_memory.debug_load.test_tone_rate);
+      }
+#endif
+    }
+
+    timespec present_start_counter = linux_get_wall_clock();
+
+    if (front_buffer) {
+      linux_copy_dirty_spans(&back_buffer, front_buffer, back_buffer.pitch);
+
+      char ppm_file_name[LINUX_STATE_FILE_NAME_COUNT];
+      snprintf(ppm_file_name, sizeof(ppm_file_name), "%s%05d.ppm", options.ppm_prefix, frame_idx);
+      if (!linux_write_ppm(ppm_file_name, front_buffer, back_buffer.width, back_buffer.height, back_buffer.pitch)) {
+        fprintf(stderr, "Couldn't write %s\n", ppm_file_name);
+      }
+    }
+
+    timespec end_counter = linux_get_wall_clock();
+
+    if (is_real_time) {
+      // A frame that took too long, the sound should play straight through it
+      if (options.hitch_milliseconds && (frame_idx % 30) == 29) {
+        timespec hitch_end = end_counter;
+        linux_add_nanoseconds(&hitch_end, (u64)options.hitch_milliseconds * 1000000);
+        linux_sleep_until(hitch_end);
+      }
+
+      // Frames that run late catch up, so the game keeps pace with the sound
+      timespec frame_end = start_counter;
+      linux_add_nanoseconds(&frame_end, (u64)(frame_idx + 1) * 1000000000 / options.game_update_hz);
+      linux_sleep_until(frame_end);
+    }
+
+    update_seconds += linux_get_seconds_elapsed(update_start_counter, sound_start_counter);
+    sound_seconds += linux_get_seconds_elapsed(sound_start_counter, present_start_counter);
+    present_seconds += linux_get_seconds_elapsed(present_start_counter, end_counter);
+
+    GameInput *temp = new_input;
+    new_input = old_input;
+    old_input = temp;
+  }
+
+  f32 total_seconds = linux_get_seconds_elapsed(start_counter, linux_get_wall_clock());
+
+  linux_stop_audio_output(&audio_output);
+  linux_close_wav(&wav_writer);
+  linux_unload_game_code(&game_code);
+  unlink(temp_game_library_full_path);
+
+  int frame_count = options.frame_count ? options.frame_count : 1;
+
+  printf("%d frames at %dx%d with %u worker threads\n",
+    options.frame_count, options.width, options.height, worker_thread_count);
+  printf("  %.02f frames/s, %.03f ms/frame (update %.03f ms, sound %.03f ms, present %.03f ms)\n",
+    (f64)options.frame_count / (f64)total_seconds,
+    1000.0 * (f64)total_seconds / frame_count,
+    1000.0 * (f64)update_seconds / frame_count,
+    1000.0 * (f64)sound_seconds / frame_count,
+    1000.0 * (f64)present_seconds / frame_count);
+
+  if (is_real_time) {
+    printf("  played %.03f s of sound, %u underruns (%d ms blocks)\n",
+      (f64)audio_output.played_sample_count / samples_per_second, audio_output.underrun_count,
+      LINUX_AUDIO_BLOCK_SAMPLE_COUNT * 1000 / (int)samples_per_second);
+  }
+
+#if HANDMADE_INTERNAL
+  if (options.rate_sweep) {
+    printf("  rate sweep: worst noise %.01f dB in %d frames below %.0f Hz, worst leakage %.01f dB in %d frames above Nyquist\n",
+      rate_sweep.worst_passband_noise_db, rate_sweep.passband_frame_count, LINUX_SWEEP_PASSBAND_FREQUENCY,
+      rate_sweep.worst_stopband_leakage_db, rate_sweep.stopband_frame_count);
+  }
+#endif
+
+#if HANDMADE_INTERNAL
+  linux_print_debug_cycle_totals(debug_cycle_totals, ArrayCount(debug_cycle_totals), options.frame_count);
+#endif
+
+  return 0;
+}
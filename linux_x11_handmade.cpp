@@ -0,0 +1,466 @@
+/*
+  Interactive Linux host on X11. The back buffer the game draws into is a
+  MIT-SHM segment shared with the X server, so presenting is an XShmPutImage
+  per dirty rect with no copy through the socket. Falls back to XPutImage when
+  the server can't share memory with us (eg: a remote display).
+
+  Works under Xvfb:  Xvfb :99 -screen 0 1280x720x24 &  DISPLAY=:99 ./linux_x11_handmade
+*/
+
+#include "handmade.h"
+#include "linux_handmade.h"
+#include "linux_handmade.cpp"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XShm.h>
+
+
+struct LinuxX11OffScreenBuffer {
+  LinuxOffScreenBuffer buffer;
+
+  XImage *image;
+  XShmSegmentInfo segment_info;
+  bool is_shared;
+
+  // Set when an XShmPutImage is in flight. The server reads the segment after
+  // we return, so the game can't draw into it again until ShmCompletion.
+  bool is_present_pending;
+
+  // Set on Expose. The buffer still has the whole frame in it, it just has to
+  // be sent again.
+  bool is_window_damaged;
+};
+
+global_variable bool Running;
+global_variable LinuxX11OffScreenBuffer GlobalBackBuffer;
+global_variable int GlobalShmCompletionEvent;
+global_variable bool GlobalX11Error;
+
+
+static int linux_x11_error_handler(Display *display, XErrorEvent *error) {
+  GlobalX11Error = true;
+  return 0;
+}
+
+// Tries to put the back buffer in a segment the X server maps too. Leaves
+// is_shared false (and the caller falls back to plain memory) on failure.
+static bool linux_x11_create_shared_image(
+    Display *display,
+    Visual *visual,
+    int depth,
+    LinuxX11OffScreenBuffer *back_buffer,
+    int width,
+    int height
+  ) {
+  if (!XShmQueryExtension(display)) {
+    return false;
+  }
+
+  XShmSegmentInfo *segment_info = &back_buffer->segment_info;
+  back_buffer->image = XShmCreateImage(display, visual, depth, ZPixmap, 0, segment_info, width, height);
+  if (!back_buffer->image) {
+    return false;
+  }
+
+  segment_info->shmid = shmget(IPC_PRIVATE, (size_t)back_buffer->image->bytes_per_line * height, IPC_CREAT | 0600);
+  if (segment_info->shmid == -1) {
+    XDestroyImage(back_buffer->image);
+    back_buffer->image = 0;
+    return false;
+  }
+
+  segment_info->shmaddr = back_buffer->image->data = (char *)shmat(segment_info->shmid, 0, 0);
+  segment_info->readOnly = False;
+
+  // XShmAttach reports failure through the error handler, not its return value
+  GlobalX11Error = false;
+  XErrorHandler old_error_handler = XSetErrorHandler(linux_x11_error_handler);
+  XShmAttach(display, segment_info);
+  XSync(display, False);
+  XSetErrorHandler(old_error_handler);
+
+  // Either way the segment goes away once both sides detach, even if we crash
+  shmctl(segment_info->shmid, IPC_RMID, 0);
+
+  if (GlobalX11Error) {
+    shmdt(segment_info->shmaddr);
+    back_buffer->image->data = 0;
+    XDestroyImage(back_buffer->image);
+    back_buffer->image = 0;
+    return false;
+  }
+
+  GlobalShmCompletionEvent = XShmGetEventBase(display) + ShmCompletion;
+  return true;
+}
+
+static void linux_x11_create_back_buffer(
+    Display *display,
+    Visual *visual,
+    int depth,
+    LinuxX11OffScreenBuffer *back_buffer,
+    int width,
+    int height
+  ) {
+  back_buffer->is_shared = linux_x11_create_shared_image(display, visual, depth, back_buffer, width, height);
+
+  if (!back_buffer->is_shared) {
+    fprintf(stderr, "MIT-SHM isn't available, presenting with XPutImage\n");
+
+    int pitch = Align(width * 4, 64);
+    char *memory = (char *)aligned_alloc(64, (size_t)pitch * height);
+    memset(memory, 0, (size_t)pitch * height);
+
+    back_buffer->image = XCreateImage(display, visual, depth, ZPixmap, 0, memory, width, height, 32, pitch);
+  }
+
+  LinuxOffScreenBuffer *buffer = &back_buffer->buffer;
+  buffer->memory = back_buffer->image->data;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->pitch = back_buffer->image->bytes_per_line;
+  buffer->bytes_per_pixel = 4;
+  buffer->dirty_rects.is_full_frame = true;
+  buffer->dirty_rects.count = 0;
+}
+
+static void linux_x11_destroy_back_buffer(Display *display, LinuxX11OffScreenBuffer *back_buffer) {
+  if (back_buffer->is_shared) {
+    XShmDetach(display, &back_buffer->segment_info);
+    XSync(display, False);
+    shmdt(back_buffer->segment_info.shmaddr);
+    back_buffer->image->data = 0;
+  }
+
+  // Frees data too when it isn't shared
+  XDestroyImage(back_buffer->image);
+  back_buffer->image = 0;
+}
+
+// Only sends what the game reported drawing. With MIT-SHM the server reads
+// straight out of the back buffer, so nothing is copied on our side.
+static void linux_x11_display_buffer_in_window(
+    Display *display,
+    Window window,
+    GC gc,
+    LinuxX11OffScreenBuffer *back_buffer
+  ) {
+  LinuxOffScreenBuffer *buffer = &back_buffer->buffer;
+  DirtyRectList *dirty_rects = &buffer->dirty_rects;
+  Rectangle2i full_frame = {0, 0, buffer->width, buffer->height};
+
+  bool is_full_frame = dirty_rects->is_full_frame || back_buffer->is_window_damaged;
+  back_buffer->is_window_damaged = false;
+
+  u32 rect_count = is_full_frame ? 1 : dirty_rects->count;
+
+  for (u32 rect_idx = 0; rect_idx < rect_count; ++rect_idx) {
+    Rectangle2i rect = is_full_frame ? full_frame : dirty_rects->rects[rect_idx];
+    int width = rect.max_x - rect.min_x;
+    int height = rect.max_y - rect.min_y;
+
+    if (back_buffer->is_shared) {
+      // Requests are handled in order, so one completion event for the last
+      // rect means the server is done with all of them.
+      bool send_event = (rect_idx == rect_count - 1);
+      XShmPutImage(display, window, gc, back_buffer->image,
+          rect.min_x, rect.min_y, rect.min_x, rect.min_y, width, height, send_event);
+      back_buffer->is_present_pending |= send_event;
+    } else {
+      XPutImage(display, window, gc, back_buffer->image,
+          rect.min_x, rect.min_y, rect.min_x, rect.min_y, width, height);
+    }
+  }
+
+  XFlush(display);
+}
+
+static void linux_x11_process_key_event(XKeyEvent *event, bool is_down, GameControllerInput *keyboard_controller) {
+  KeySym keycode = XLookupKeysym(event, 0);
+
+  if (keycode == XK_w) {
+    linux_process_keyboard_message(&keyboard_controller->move_up, is_down);
+  } else if (keycode == XK_a) {
+    linux_process_keyboard_message(&keyboard_controller->move_left, is_down);
+  } else if (keycode == XK_s) {
+    linux_process_keyboard_message(&keyboard_controller->move_down, is_down);
+  } else if (keycode == XK_d) {
+    linux_process_keyboard_message(&keyboard_controller->move_right, is_down);
+  } else if (keycode == XK_q) {
+    linux_process_keyboard_message(&keyboard_controller->left_shoulder, is_down);
+  } else if (keycode == XK_e) {
+    linux_process_keyboard_message(&keyboard_controller->right_shoulder, is_down);
+  } else if (keycode == XK_Up) {
+    linux_process_keyboard_message(&keyboard_controller->action_up, is_down);
+  } else if (keycode == XK_Left) {
+    linux_process_keyboard_message(&keyboard_controller->action_left, is_down);
+  } else if (keycode == XK_Down) {
+    linux_process_keyboard_message(&keyboard_controller->action_down, is_down);
+  } else if (keycode == XK_Right) {
+    linux_process_keyboard_message(&keyboard_controller->action_right, is_down);
+  } else if (keycode == XK_Escape) {
+    Running = false;
+  } else if ((keycode == XK_F4) && (event->state & Mod1Mask)) {
+    // Alt + F4
+    Running = false;
+  }
+}
+
+static void linux_x11_process_pending_messages(
+    Display *display,
+    Atom wm_delete_window,
+    LinuxX11OffScreenBuffer *back_buffer,
+    GameControllerInput *keyboard_controller
+  ) {
+  while (XPending(display)) {
+    XEvent event;
+    XNextEvent(display, &event);
+
+    switch (event.type) {
+      case KeyPress:
+      case KeyRelease: {
+        // Auto-repeat only sends presses (see XkbSetDetectableAutoRepeat), and
+        // linux_process_keyboard_message ignores presses of a key that's down.
+        linux_x11_process_key_event(&event.xkey, event.type == KeyPress, keyboard_controller);
+      } break;
+
+      case Expose: {
+        // The window lost what was on it, send everything next frame
+        back_buffer->is_window_damaged = true;
+      } break;
+
+      case ClientMessage: {
+        if ((Atom)event.xclient.data.l[0] == wm_delete_window) {
+          Running = false;
+        }
+      } break;
+
+      default: {
+        if (event.type == GlobalShmCompletionEvent) {
+          back_buffer->is_present_pending = false;
+        }
+      } break;
+    }
+  }
+}
+
+// Blocks until the server is done reading the last frame out of the segment
+static void linux_x11_wait_for_present(
+    Display *display,
+    Atom wm_delete_window,
+    LinuxX11OffScreenBuffer *back_buffer,
+    GameControllerInput *keyboard_controller
+  ) {
+  while (back_buffer->is_present_pending) {
+    XEvent event;
+    XPeekEvent(display, &event);
+    linux_x11_process_pending_messages(display, wm_delete_window, back_buffer, keyboard_controller);
+  }
+}
+
+
+int main(int argc, char **argv) {
+  LinuxState linux_state = {};
+  linux_get_exe_file_name(&linux_state);
+
+  char source_game_library_full_path[LINUX_STATE_FILE_NAME_COUNT];
+  linux_build_exe_path_file_name(&linux_state, "handmade.so",
+      sizeof(source_game_library_full_path), source_game_library_full_path);
+
+  char temp_game_library_full_path[LINUX_STATE_FILE_NAME_COUNT];
+  snprintf(temp_game_library_full_path, sizeof(temp_game_library_full_path),
+      "/tmp/handmade_temp_%d.so", (int)getpid());
+
+  Display *display = XOpenDisplay(0);
+  if (!display) {
+    fprintf(stderr, "Couldn't open the X display\n");
+    return 1;
+  }
+
+  int screen = DefaultScreen(display);
+  Window root = RootWindow(display, screen);
+
+  XVisualInfo visual_info = {};
+  if (!XMatchVisualInfo(display, screen, 24, TrueColor, &visual_info)) {
+    fprintf(stderr, "No 24 bit TrueColor visual\n");
+    return 1;
+  }
+
+  int buffer_width = 960;
+  int buffer_height = 540;
+
+  XSetWindowAttributes window_attributes = {};
+  window_attributes.colormap = XCreateColormap(display, root, visual_info.visual, AllocNone);
+  window_attributes.background_pixel = 0;
+  window_attributes.event_mask = KeyPressMask | KeyReleaseMask | ExposureMask | StructureNotifyMask;
+
+  Window window = XCreateWindow(
+    display,
+    root,
+    0, 0,
+    buffer_width, buffer_height,
+    0,
+    visual_info.depth,
+    InputOutput,
+    visual_info.visual,
+    CWColormap | CWBackPixel | CWEventMask,
+    &window_attributes
+  );
+
+  XStoreName(display, window, "Handmade Hero");
+
+  Atom wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
+  XSetWMProtocols(display, window, &wm_delete_window, 1);
+
+  Bool detectable_auto_repeat_supported;
+  XkbSetDetectableAutoRepeat(display, True, &detectable_auto_repeat_supported);
+
+  XMapWindow(display, window);
+  GC gc = XCreateGC(display, window, 0, 0);
+
+  linux_x11_create_back_buffer(display, visual_info.visual, visual_info.depth,
+      &GlobalBackBuffer, buffer_width, buffer_height);
+
+  // TODO - Ask for the monitor's refresh rate with XRandR
+  int monitor_refresh_hz = 60;
+  f32 game_update_hz = (f32)(monitor_refresh_hz / 2.0f);
+  f32 target_seconds_per_frame = 1.0f / (f32)game_update_hz;
+
+  u32 worker_thread_count = linux_get_default_worker_thread_count();
+
+  local_persist PlatformWorkQueue high_priority_queue;
+  local_persist LinuxThreadStartup high_priority_startups[LINUX_MAX_WORKER_THREAD_COUNT];
+  linux_make_work_queue(&high_priority_queue, worker_thread_count, high_priority_startups);
+
+  // Always one worker, even when there are none above: streaming sound needs
+  // its reads done while the game thread gets on with frames
+  local_persist PlatformWorkQueue low_priority_queue;
+  local_persist LinuxThreadStartup low_priority_startups[1];
+  linux_make_work_queue(&low_priority_queue, 1, low_priority_startups);
+
+  GameMemory game_memory = {};
+  game_memory.permanent_storage_size = Megabytes(64);
+  game_memory.transient_storage_size = Gigabytes((u64)1);
+  game_memory.dbg_platform_free_file_memory = dbg_platform_free_file_memory;
+  game_memory.dbg_platform_read_entire_file = dbg_platform_read_entire_file;
+  game_memory.dbg_platform_write_entire_file = dbg_platform_write_entire_file;
+  game_memory.dbg_platform_read_file_chunk = dbg_platform_read_file_chunk;
+  game_memory.high_priority_queue = &high_priority_queue;
+  game_memory.low_priority_queue = &low_priority_queue;
+  game_memory.worker_thread_count = worker_thread_count;
+  game_memory.add_entry = linux_add_entry;
+  game_memory.complete_all_work = linux_complete_all_work;
+
+  if (!linux_allocate_game_memory(&linux_state, &game_memory)) {
+    fprintf(stderr, "Couldn't allocate game memory\n");
+    return 1;
+  }
+
+  u64 frame_index = 0;
+
+  LinuxGameCode game_code = linux_load_game_code(source_game_library_full_path, temp_game_library_full_path);
+
+  // TODO - Sound output through ALSA. Until then the audio thread plays into
+  // the null device, so the game's sound runs the way it will with a real one.
+  u32 samples_per_second = 48000;
+  local_persist LinuxAudioOutput audio_output;
+  if (!linux_start_audio_output(&audio_output, "/dev/null", samples_per_second, target_seconds_per_frame)) {
+    fprintf(stderr, "Couldn't start sound output\n");
+  }
+
+#if HANDMADE_INTERNAL
+  LinuxDebugCycleTotal debug_cycle_totals[ArrayCount(game_memory.counters)] = {};
+#endif
+
+  GameInput game_input[2] = {};
+  GameInput *new_input = &game_input[0];
+  GameInput *old_input = &game_input[1];
+
+  ThreadContext thread_ctx = {};
+
+  Running = true;
+  timespec last_counter = linux_get_wall_clock();
+
+  while (Running) {
+    new_input->target_seconds_per_frame = target_seconds_per_frame;
+
+    time_t new_library_write_time = linux_get_last_write_time(source_game_library_full_path);
+    if (new_library_write_time != game_code.last_write_time) {
+      // TODO - Add Debug Logging
+      // Reads still in flight would call back into the old library
+      linux_complete_all_work(&low_priority_queue);
+      linux_unload_game_code(&game_code);
+      game_code = linux_load_game_code(source_game_library_full_path, temp_game_library_full_path);
+    }
+
+    GameControllerInput *old_keyboard_controller = get_controller(old_input, 0);
+    GameControllerInput *new_keyboard_controller = get_controller(new_input, 0);
+    GameControllerInput zeroed_controller = {};
+    *new_keyboard_controller = zeroed_controller;
+    new_keyboard_controller->is_connected = true;
+
+    for (u32 button_idx = 0;
+        button_idx < ArrayCount(new_keyboard_controller->buttons);
+        ++button_idx)
+    {
+      new_keyboard_controller->buttons[button_idx].ended_down =
+        old_keyboard_controller->buttons[button_idx].ended_down;
+    }
+
+    linux_x11_process_pending_messages(display, wm_delete_window, &GlobalBackBuffer, new_keyboard_controller);
+
+    // TODO - Joysticks through evdev, controllers 1..4
+
+    // The game draws into the segment, so it has to wait for the server to
+    // finish with the last frame first.
+    linux_x11_wait_for_present(display, wm_delete_window, &GlobalBackBuffer, new_keyboard_controller);
+
+    GameOffScreenBuffer game_offscreen_buffer = linux_get_game_buffer(&GlobalBackBuffer.buffer);
+    game_code.update_and_render(&thread_ctx, &game_memory, new_input, &game_offscreen_buffer);
+#if HANDMADE_INTERNAL
+    linux_handle_debug_cycle_counters(&game_memory, debug_cycle_totals);
+#endif
+
+    ++frame_index;
+    linux_fill_audio_ring(&audio_output, &game_code, &thread_ctx, &game_memory);
+
+    // Sleep off the rest of the frame
+    f32 seconds_elapsed_for_frame = linux_get_seconds_elapsed(last_counter, linux_get_wall_clock());
+    if (seconds_elapsed_for_frame < target_seconds_per_frame) {
+      f32 sleep_seconds = target_seconds_per_frame - seconds_elapsed_for_frame;
+      timespec sleep_time = {};
+      sleep_time.tv_nsec = (long)(sleep_seconds * 1.0e9f);
+      nanosleep(&sleep_time, 0);
+    }
+
+    timespec end_counter = linux_get_wall_clock();
+    last_counter = end_counter;
+
+    linux_x11_display_buffer_in_window(display, window, gc, &GlobalBackBuffer);
+
+    GameInput *temp = new_input;
+    new_input = old_input;
+    old_input = temp;
+  }
+
+  linux_x11_wait_for_present(display, wm_delete_window, &GlobalBackBuffer, get_controller(new_input, 0));
+  linux_x11_destroy_back_buffer(display, &GlobalBackBuffer);
+  XFreeGC(display, gc);
+  XDestroyWindow(display, window);
+  XCloseDisplay(display);
+
+  linux_stop_audio_output(&audio_output);
+  linux_unload_game_code(&game_code);
+  unlink(temp_game_library_full_path);
+
+#if HANDMADE_INTERNAL
+  linux_print_debug_cycle_totals(debug_cycle_totals, ArrayCount(debug_cycle_totals), frame_index);
+#endif
+
+  return 0;
+}
@@ -33,6 +33,57 @@ struct Win32DebugSoundCursor {
   DWORD expected_flip_play_cursor;
 };
 
+#if defined(HANDMADE_WIN32_AUDIO_THREAD)
+/*
+  Sound output
+
+  Define HANDMADE_WIN32_AUDIO_THREAD to use the same scheme as the Linux
+  layer. It hasn't been run on Windows yet, so the default is still the
+  per-frame write in WinMain.
+
+  The game mixes fixed size blocks into a ring on its own thread, topped up
+  each frame to a frame's worth plus WIN32_AUDIO_SAFETY_BLOCK_COUNT, and the
+  audio thread copies them into the DirectSound buffer
+  WIN32_AUDIO_LEAD_BLOCK_COUNT ahead of its write cursor.
+  Nothing is worked out from when the next flip is expected, so a frame that
+  runs late only eats into what's queued.
+*/
+#define WIN32_AUDIO_BLOCK_SAMPLE_COUNT 480 // 10ms at 48kHz
+#define WIN32_AUDIO_BLOCK_COUNT 10
+#define WIN32_AUDIO_SAFETY_BLOCK_COUNT 2
+#define WIN32_AUDIO_LEAD_BLOCK_COUNT 2
+
+// Single writer (the game's thread), single reader (the audio thread). Both
+// indices only ever count up, block n lives at n % WIN32_AUDIO_BLOCK_COUNT,
+// and the ring is full when they're WIN32_AUDIO_BLOCK_COUNT apart.
+struct Win32AudioRing {
+  u32 volatile write_index;
+  u32 volatile read_index;
+
+  // Interleaved LRLR...
+  i16 blocks[WIN32_AUDIO_BLOCK_COUNT][2 * WIN32_AUDIO_BLOCK_SAMPLE_COUNT];
+};
+
+struct Win32SoundOutput {
+  Win32AudioRing ring;
+
+  DWORD secondary_buffer_size;
+  int samples_per_second;
+  int bytes_per_sample;
+
+  // Blocks win32_fill_audio_ring keeps queued
+  u32 target_block_count;
+
+  HANDLE thread;
+  bool volatile is_running;
+
+  // Only written by the audio thread
+  DWORD write_byte; // Where its next block goes in the DirectSound buffer
+  u32 volatile underrun_count; // Blocks written as silence because the ring was empty
+
+  i16 silence[2 * WIN32_AUDIO_BLOCK_SAMPLE_COUNT];
+};
+#else
 struct Win32SoundOutput {
 	DWORD secondary_buffer_size;
   DWORD safety_bytes;
@@ -41,6 +92,7 @@ struct Win32SoundOutput {
   int latency_sample_count;
 	u32 running_sample_index;
 };
+#endif
 
 
 struct Win32OffScreenBuffer {
@@ -50,6 +102,9 @@ struct Win32OffScreenBuffer {
 	int height;
 	int pitch;
 	int bytes_per_pixel;
+
+	// What the game changed in the last frame
+	DirtyRectList dirty_rects;
 };
 
 struct Win32WindowDimension {
@@ -88,8 +143,43 @@ struct Win32State {
   // Indicates position into the playback state
   int input_playback_index;
 
+  // Set when game memory was just copied back from a replay buffer, passed on
+  // to the game in GameMemory::was_restored
+  bool game_memory_was_restored;
+
+  // Reads still in flight on it write into game memory, so it's finished
+  // before game memory is snapshotted or restored
+  PlatformWorkQueue *low_priority_queue;
+
   char exe_file_name[WIN32_STATE_FILE_NAME_COUNT];
   char *exe_file_name_one_past_last_slash;
 };
 
+struct PlatformWorkQueueEntry {
+  platform_work_queue_callback *callback;
+  void *data;
+};
+
+// Single writer (the game's thread), many readers (every worker plus the game's
+// thread while it waits in complete_all_work).
+struct PlatformWorkQueue {
+  u32 volatile completion_goal;
+  u32 volatile completion_count;
+
+  u32 volatile next_entry_to_write;
+  u32 volatile next_entry_to_read;
+
+  // Counts entries that haven't been picked up yet. Idle workers sleep on it.
+  HANDLE semaphore_handle;
+
+  PlatformWorkQueueEntry entries[256];
+};
+
+#define WIN32_MAX_WORKER_THREAD_COUNT 64
+
+struct Win32ThreadStartup {
+  u32 logical_thread_index;
+  PlatformWorkQueue *queue;
+};
+
 #endif
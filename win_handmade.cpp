@@ -98,6 +98,8 @@ static Win32ReplayBuffer * win32_get_replay_buffer(Win32State *state, int unsign
   return replay_buffer;
 }
 
+PLATFORM_COMPLETE_ALL_WORK(win32_complete_all_work);
+
 static void win32_begin_recording_input(Win32State *win32_state, int recording_index) {
   Win32ReplayBuffer *replay_buffer = win32_get_replay_buffer(win32_state, recording_index);
   
@@ -109,6 +111,7 @@ static void win32_begin_recording_input(Win32State *win32_state, int recording_i
     win32_get_input_file_location(win32_state, true, recording_index, sizeof(file_name), file_name);
     win32_state->recording_handle = CreateFileA(file_name, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0, 0);
 
+    win32_complete_all_work(win32_state->low_priority_queue);
     CopyMemory(replay_buffer->memory_block, win32_state->game_memory, win32_state->game_memory_total_size);
   }
 }
@@ -129,7 +132,9 @@ static void win32_begin_playback_input(Win32State *win32_state, int playback_ind
     win32_get_input_file_location(win32_state, true, playback_index, sizeof(file_name), file_name);
     win32_state->playback_handle = CreateFileA(file_name, GENERIC_READ, 0, 0, OPEN_EXISTING, 0, 0);
   
+    win32_complete_all_work(win32_state->low_priority_queue);
     CopyMemory(win32_state->game_memory, replay_buffer->memory_block, win32_state->game_memory_total_size);
+    win32_state->game_memory_was_restored = true;
   }
 }
 
@@ -231,6 +236,43 @@ DEBUG_PLATFORM_READ_ENTIRE_FILE(dbg_platform_read_entire_file) {
 }
 
 
+DEBUG_PLATFORM_READ_FILE_CHUNK(dbg_platform_read_file_chunk) {
+  u32 result = 0;
+
+  HANDLE file_handle = CreateFileA(
+    file_name,
+    GENERIC_READ,
+    FILE_SHARE_READ,
+    0,
+    OPEN_EXISTING,
+    0,
+    0
+  );
+
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    // TODO - Log error
+    return result;
+  }
+
+  // The offset goes in through an OVERLAPPED so the read doesn't depend on a
+  // file pointer. A synchronous handle still blocks until it's done.
+  OVERLAPPED overlapped = {};
+  overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+  overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+  DWORD bytes_read;
+  if (ReadFile(file_handle, dest, size, &bytes_read, &overlapped)) {
+    result = bytes_read;
+  } else {
+    // TODO - Log error. Reading at or past the end fails with ERROR_HANDLE_EOF.
+  }
+
+  CloseHandle(file_handle);
+
+  return(result);
+}
+
+
 DEBUG_PLATFORM_WRITE_ENTIRE_FILE(dbg_platform_write_entire_file) {
   bool result = false;
 
@@ -389,6 +431,7 @@ static void Win32ClearSoundBuffer(Win32SoundOutput *sound_output) {
 
 
 
+#if !defined(HANDMADE_WIN32_AUDIO_THREAD)
 static void Win32FillSoundBuffer(
     Win32SoundOutput *sound_output, 
     DWORD byte_to_lock, // This is essentially the write pointer
@@ -443,6 +486,7 @@ static void Win32FillSoundBuffer(
 		);
 	}
 }
+#endif
 
 
 // DIRECTSOUND pointer is written into as an OUT param as the second parameter of
@@ -508,6 +552,179 @@ static void Win32InitDirectSound(HWND window, i32 samples_per_second, i32 buffer
 }
 
 
+#if defined(HANDMADE_WIN32_AUDIO_THREAD)
+// Copies a block into the DirectSound buffer at write_byte and moves it on.
+// Audio thread only.
+static void win32_write_audio_block(Win32SoundOutput *sound_output, i16 *samples) {
+	VOID *region1;
+	DWORD region1_size;
+	VOID *region2;
+	DWORD region2_size;
+
+  // When you lock the circiular secondary sound buffer, Windows returns either one
+  // or two chunks of memory. If the locked region hits the "end" of the circular buffer
+  // and wraps around to the "beginning", you'll get two regions. Otherwise you're locking
+  // a region without wrapping.
+  DWORD block_size = WIN32_AUDIO_BLOCK_SAMPLE_COUNT * sound_output->bytes_per_sample;
+	HRESULT buffer_lock_result = GlobalSecondarySoundBuffer->Lock(
+			sound_output->write_byte,
+			block_size,
+			&region1, &region1_size,
+			&region2, &region2_size,
+			0
+	);
+
+	if(SUCCEEDED(buffer_lock_result)) {
+    CopyMemory(region1, samples, region1_size);
+    CopyMemory(region2, (u8 *)samples + region1_size, region2_size);
+
+		GlobalSecondarySoundBuffer->Unlock(
+			region1, region1_size,
+			region2, region2_size
+		);
+	}
+
+  sound_output->write_byte = (sound_output->write_byte + block_size) % sound_output->secondary_buffer_size;
+}
+
+// Mixes blocks until target_block_count are queued. Game thread only.
+// Returns how many it mixed.
+static u32 win32_fill_audio_ring(Win32SoundOutput *sound_output, Win32GameCode *game_code,
+                                 ThreadContext *thread_ctx, GameMemory *game_memory) {
+  Win32AudioRing *ring = &sound_output->ring;
+  u32 block_count = 0;
+
+  u32 write_index = ring->write_index;
+  while (write_index - __atomic_load_n(&ring->read_index, __ATOMIC_ACQUIRE) < sound_output->target_block_count) {
+    GameSoundOutputBuffer sound_buffer = {};
+    sound_buffer.samples_per_second = sound_output->samples_per_second;
+    sound_buffer.sample_count = WIN32_AUDIO_BLOCK_SAMPLE_COUNT;
+    sound_buffer.samples = ring->blocks[write_index % WIN32_AUDIO_BLOCK_COUNT];
+    game_code->get_sound_samples(thread_ctx, game_memory, &sound_buffer);
+
+    // The block has to be fully written before the audio thread can see it
+    ++write_index;
+    __atomic_store_n(&ring->write_index, write_index, __ATOMIC_RELEASE);
+    ++block_count;
+  }
+
+  return block_count;
+}
+
+// Keeps the DirectSound buffer written WIN32_AUDIO_LEAD_BLOCK_COUNT blocks
+// past its write cursor, from the ring or with silence when it's empty.
+DWORD WINAPI win32_audio_thread_proc(LPVOID lpParameter) {
+  Win32SoundOutput *sound_output = (Win32SoundOutput *)lpParameter;
+  Win32AudioRing *ring = &sound_output->ring;
+
+  DWORD buffer_size = sound_output->secondary_buffer_size;
+  DWORD block_size = WIN32_AUDIO_BLOCK_SAMPLE_COUNT * sound_output->bytes_per_sample;
+  DWORD lead_size = WIN32_AUDIO_LEAD_BLOCK_COUNT * block_size;
+
+  // Writing starts when there's something to play, so the first frame
+  // loading doesn't count as an underrun
+  while (__atomic_load_n(&sound_output->is_running, __ATOMIC_ACQUIRE) &&
+         __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE) == 0) {
+    Sleep(1);
+  }
+
+  bool is_synced = false;
+  while (__atomic_load_n(&sound_output->is_running, __ATOMIC_ACQUIRE)) {
+    DWORD play_cursor;
+    DWORD write_cursor;
+
+    if (SUCCEEDED(GlobalSecondarySoundBuffer->GetCurrentPosition(&play_cursor, &write_cursor))) {
+      // Both measured forward from the play cursor, around the end of the buffer
+      DWORD write_cursor_distance = (write_cursor + buffer_size - play_cursor) % buffer_size;
+      DWORD write_byte_distance = (sound_output->write_byte + buffer_size - play_cursor) % buffer_size;
+
+      // Anywhere from the play cursor up to the write cursor is already on its
+      // way to the card. Behind the play cursor comes out as nearly a whole
+      // buffer ahead.
+      bool is_late = (write_byte_distance < write_cursor_distance) || (write_byte_distance > buffer_size / 2);
+      if (!is_synced || is_late) {
+        if (is_synced) {
+          __atomic_store_n(&sound_output->underrun_count, sound_output->underrun_count + 1, __ATOMIC_RELAXED);
+        }
+        sound_output->write_byte = write_cursor;
+        write_byte_distance = write_cursor_distance;
+        is_synced = true;
+      }
+
+      while (write_byte_distance < write_cursor_distance + lead_size) {
+        i16 *samples = sound_output->silence;
+
+        u32 read_index = ring->read_index;
+        if (read_index != __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE)) {
+          samples = ring->blocks[read_index % WIN32_AUDIO_BLOCK_COUNT];
+        } else {
+          __atomic_store_n(&sound_output->underrun_count, sound_output->underrun_count + 1, __ATOMIC_RELAXED);
+        }
+
+        win32_write_audio_block(sound_output, samples);
+        write_byte_distance += block_size;
+
+        // Hands the block back only once it's been copied out
+        if (samples != sound_output->silence) {
+          __atomic_store_n(&ring->read_index, read_index + 1, __ATOMIC_RELEASE);
+        }
+      }
+    } else {
+      is_synced = false;
+    }
+
+    Sleep(1);
+  }
+
+  return 0;
+}
+
+// Starts the secondary buffer playing and the audio thread feeding it. The
+// ring is kept a frame of target_seconds_per_frame ahead, plus
+// WIN32_AUDIO_SAFETY_BLOCK_COUNT. Returns false when there's no DirectSound.
+static bool win32_start_audio_output(Win32SoundOutput *sound_output, f32 target_seconds_per_frame) {
+  if (!GlobalSecondarySoundBuffer) {
+    return false;
+  }
+
+  u32 frame_sample_count = (u32)(target_seconds_per_frame * (f32)sound_output->samples_per_second + 0.5f);
+  u32 frame_block_count = (frame_sample_count + WIN32_AUDIO_BLOCK_SAMPLE_COUNT - 1) / WIN32_AUDIO_BLOCK_SAMPLE_COUNT;
+  sound_output->target_block_count = frame_block_count + WIN32_AUDIO_SAFETY_BLOCK_COUNT;
+  if (sound_output->target_block_count > WIN32_AUDIO_BLOCK_COUNT) {
+    sound_output->target_block_count = WIN32_AUDIO_BLOCK_COUNT;
+  }
+
+  sound_output->ring.write_index = 0;
+  sound_output->ring.read_index = 0;
+  sound_output->write_byte = 0;
+  sound_output->underrun_count = 0;
+  ZeroMemory(sound_output->silence, sizeof(sound_output->silence));
+
+  Win32ClearSoundBuffer(sound_output);
+  GlobalSecondarySoundBuffer->Play(0, 0, DSBPLAY_LOOPING);
+
+  __atomic_store_n(&sound_output->is_running, true, __ATOMIC_RELEASE);
+  sound_output->thread = CreateThread(0, 0, win32_audio_thread_proc, sound_output, 0, 0);
+  if (!sound_output->thread) {
+    sound_output->is_running = false;
+    GlobalSecondarySoundBuffer->Stop();
+    return false;
+  }
+
+  return true;
+}
+
+static void win32_stop_audio_output(Win32SoundOutput *sound_output) {
+  if (sound_output->is_running) {
+    __atomic_store_n(&sound_output->is_running, false, __ATOMIC_RELEASE);
+    WaitForSingleObject(sound_output->thread, INFINITE);
+    CloseHandle(sound_output->thread);
+    GlobalSecondarySoundBuffer->Stop();
+  }
+}
+#endif
+
+
 Win32WindowDimension GetWindowDimension(HWND window) {
 	Win32WindowDimension result;
 
@@ -531,27 +748,56 @@ static void Win32ResizeDIBSection(Win32OffScreenBuffer *buffer, int width, int h
 	buffer->height = height;
 	buffer->bytes_per_pixel = 4;
 	
+	// Pad each row out to a whole number of cache lines. VirtualAlloc hands back
+	// page aligned memory so every row then starts on a 64 byte boundary.
+	buffer->pitch = Align(width * buffer->bytes_per_pixel, 64);
+
 	buffer->info.bmiHeader.biSize = sizeof(buffer->info.bmiHeader);
-	buffer->info.bmiHeader.biWidth = buffer->width;
+	buffer->info.bmiHeader.biWidth = buffer->pitch / buffer->bytes_per_pixel; // DIB stride has to match the padded pitch
 	buffer->info.bmiHeader.biHeight = -buffer->height; // Make this negative so the bitmap origin is top left
 	buffer->info.bmiHeader.biPlanes = 1;
 	buffer->info.bmiHeader.biBitCount = 32; // Adding for 32 bits even though we only need 24 for RGB
 	buffer->info.bmiHeader.biCompression = BI_RGB;
 
-	int bitmap_memory_size = (buffer->width * buffer->height) * buffer->bytes_per_pixel;
+	int bitmap_memory_size = buffer->pitch * buffer->height;
 	buffer->memory = VirtualAlloc(0, bitmap_memory_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
-	buffer->pitch = width * buffer->bytes_per_pixel;
 }
 
+// Copies the back buffer to the window. With dirty_rects only the parts of the
+// buffer that changed get sent, otherwise everything (including the black
+// border around the buffer) is redrawn.
 static void Win32DisplayBufferInWindow(
 		Win32OffScreenBuffer *buffer,
 		HDC device_context, 
 		int window_width,
-		int window_height
+		int window_height,
+		DirtyRectList *dirty_rects
 ) {
   int offset_x = 10;
   int offset_y = 10;
 
+  if (dirty_rects && !dirty_rects->is_full_frame) {
+    for (u32 rect_idx = 0; rect_idx < dirty_rects->count; ++rect_idx) {
+      Rectangle2i *rect = &dirty_rects->rects[rect_idx];
+      int width = rect->max_x - rect->min_x;
+      int height = rect->max_y - rect->min_y;
+
+      // StretchDIBits measures the source rectangle from the bottom left of
+      // the DIB even when it's top-down, so the source y is flipped
+      StretchDIBits(
+        device_context,
+        offset_x + rect->min_x, offset_y + rect->min_y, width, height,
+        rect->min_x, buffer->height - rect->max_y, width, height,
+        buffer->memory,
+        &buffer->info,
+        DIB_RGB_COLORS,
+        SRCCOPY
+      );
+    }
+
+    return;
+  }
+
   PatBlt(device_context, 0, 0, window_width, offset_y, BLACKNESS);
   PatBlt(device_context, 0, offset_y + buffer->height, window_width, window_height, BLACKNESS);
   PatBlt(device_context, 0, 0, offset_x, window_height, BLACKNESS);
@@ -609,7 +855,8 @@ LRESULT CALLBACK  Win32MainWindowCallback(
 				&GlobalBackBuffer,
 				device_context, 
 				dimension.width,
-				dimension.height
+				dimension.height,
+				0
 			);
 			
 			EndPaint(Window, &Paint);
@@ -916,6 +1163,140 @@ static f32 win32_process_input_stick_value(SHORT thumbstick, f32 deadzone_thresh
 }
 
 
+PLATFORM_ADD_ENTRY(win32_add_entry) {
+  u32 new_next_entry_to_write = (queue->next_entry_to_write + 1) % ArrayCount(queue->entries);
+  Assert(new_next_entry_to_write != queue->next_entry_to_read);
+
+  PlatformWorkQueueEntry *entry = &queue->entries[queue->next_entry_to_write];
+  entry->callback = callback;
+  entry->data = data;
+  ++queue->completion_goal;
+
+  // The entry has to be fully written before a worker can see it
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  queue->next_entry_to_write = new_next_entry_to_write;
+
+  ReleaseSemaphore(queue->semaphore_handle, 1, 0);
+}
+
+// Runs one entry if there is one. Returns true when the queue was empty.
+static bool win32_do_next_work_queue_entry(PlatformWorkQueue *queue, ThreadContext *thread_ctx) {
+  bool we_should_sleep = false;
+
+  u32 original_next_entry_to_read = queue->next_entry_to_read;
+  u32 new_next_entry_to_read = (original_next_entry_to_read + 1) % ArrayCount(queue->entries);
+
+  if (original_next_entry_to_read != queue->next_entry_to_write) {
+    // Several threads can race for the same entry. Only the one that moves
+    // next_entry_to_read forward gets to run it.
+    u32 index = InterlockedCompareExchange(
+      (LONG volatile *)&queue->next_entry_to_read,
+      new_next_entry_to_read,
+      original_next_entry_to_read
+    );
+
+    if (index == original_next_entry_to_read) {
+      PlatformWorkQueueEntry entry = queue->entries[index];
+      entry.callback(thread_ctx, entry.data);
+      InterlockedIncrement((LONG volatile *)&queue->completion_count);
+    }
+  } else {
+    we_should_sleep = true;
+  }
+
+  return we_should_sleep;
+}
+
+PLATFORM_COMPLETE_ALL_WORK(win32_complete_all_work) {
+  ThreadContext thread_ctx = {};
+
+  while (queue->completion_goal != queue->completion_count) {
+    win32_do_next_work_queue_entry(queue, &thread_ctx);
+  }
+
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+}
+
+DWORD WINAPI win32_work_queue_thread_proc(LPVOID lpParameter) {
+  Win32ThreadStartup *startup = (Win32ThreadStartup *)lpParameter;
+  PlatformWorkQueue *queue = startup->queue;
+
+  ThreadContext thread_ctx = {};
+  thread_ctx.logical_thread_index = startup->logical_thread_index;
+
+  for (;;) {
+    if (win32_do_next_work_queue_entry(queue, &thread_ctx)) {
+      WaitForSingleObjectEx(queue->semaphore_handle, INFINITE, FALSE);
+    }
+  }
+}
+
+static void win32_make_work_queue(PlatformWorkQueue *queue, u32 thread_count, Win32ThreadStartup *startups) {
+  queue->completion_goal = 0;
+  queue->completion_count = 0;
+  queue->next_entry_to_write = 0;
+  queue->next_entry_to_read = 0;
+
+  queue->semaphore_handle = CreateSemaphoreEx(0, 0, thread_count, 0, 0, SEMAPHORE_ALL_ACCESS);
+
+  for (u32 thread_idx = 0; thread_idx < thread_count; ++thread_idx) {
+    Win32ThreadStartup *startup = &startups[thread_idx];
+    startup->logical_thread_index = thread_idx + 1;
+    startup->queue = queue;
+
+    HANDLE thread_handle = CreateThread(0, 0, win32_work_queue_thread_proc, startup, 0, 0);
+    CloseHandle(thread_handle);
+  }
+}
+
+// Define HANDMADE_WORKER_THREAD_COUNT to pin the number of workers, eg: to see
+// how rendering scales from 1 to N cores. By default there is one worker per
+// logical core besides the one the main thread runs on.
+static u32 win32_get_worker_thread_count(void) {
+#if defined(HANDMADE_WORKER_THREAD_COUNT)
+  u32 thread_count = HANDMADE_WORKER_THREAD_COUNT;
+#else
+  SYSTEM_INFO system_info;
+  GetSystemInfo(&system_info);
+  u32 thread_count = system_info.dwNumberOfProcessors - 1;
+#endif
+
+  if (thread_count > WIN32_MAX_WORKER_THREAD_COUNT) {
+    thread_count = WIN32_MAX_WORKER_THREAD_COUNT;
+  }
+
+  return thread_count;
+}
+
+#if HANDMADE_INTERNAL
+// Prints the game's timed blocks for the last frame and resets them.
+static void win32_handle_debug_cycle_counters(GameMemory *memory) {
+  OutputDebugStringA("DEBUG CYCLE COUNTS:\n");
+
+  for (int counter_idx = 0; counter_idx < ArrayCount(memory->counters); ++counter_idx) {
+    DebugCycleCounter *counter = &memory->counters[counter_idx];
+
+    if (counter->hit_count) {
+      char string_buffer[256];
+      _snprintf_s(
+        string_buffer,
+        sizeof(string_buffer),
+        "  %d: %llucy %uh %.02fcy/h\n",
+        counter_idx,
+        counter->cycle_count,
+        counter->hit_count,
+        (f64)counter->cycle_count / (f64)counter->hit_count
+      );
+      OutputDebugStringA(string_buffer);
+
+      counter->cycle_count = 0;
+      counter->hit_count = 0;
+    }
+  }
+}
+#endif
+
 static float win32_get_seconds_elapsed(LARGE_INTEGER start, LARGE_INTEGER end) {
   f32 delta = (f32)(end.QuadPart - start.QuadPart);
   f32 elapsed_seconds = delta / (f32)GlobalPerfCounterFrequency;
@@ -1017,6 +1398,17 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
 
 		  HDC device_context = GetDC(window);
 
+#if defined(HANDMADE_WIN32_AUDIO_THREAD)
+      local_persist Win32SoundOutput sound_output;
+			sound_output.samples_per_second = 48000;
+			sound_output.bytes_per_sample = sizeof(i16) * 2; // Two channel audio
+      // A second, far more than the audio thread ever writes past the cursors
+			sound_output.secondary_buffer_size = sound_output.samples_per_second * sound_output.bytes_per_sample;
+
+			Win32InitDirectSound(window, sound_output.samples_per_second, sound_output.secondary_buffer_size);
+      win32_start_audio_output(&sound_output, target_seconds_per_frame);
+
+#else
 			Win32SoundOutput sound_output = {};
 			sound_output.samples_per_second = 48000;
 			sound_output.running_sample_index = 0;
@@ -1036,6 +1428,7 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
         PAGE_READWRITE
       );
 				
+#endif
 			Running = true;
 
       // Initialize game memory
@@ -1048,6 +1441,29 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
       game_memory.dbg_platform_free_file_memory = dbg_platform_free_file_memory;
       game_memory.dbg_platform_read_entire_file = dbg_platform_read_entire_file;
       game_memory.dbg_platform_write_entire_file = dbg_platform_write_entire_file;
+      game_memory.dbg_platform_read_file_chunk = dbg_platform_read_file_chunk;
+
+      // Worker threads for the game
+      Win32ThreadStartup high_priority_startups[WIN32_MAX_WORKER_THREAD_COUNT] = {};
+      PlatformWorkQueue high_priority_queue = {};
+      u32 worker_thread_count = win32_get_worker_thread_count();
+
+      if (worker_thread_count > 0) {
+        win32_make_work_queue(&high_priority_queue, worker_thread_count, high_priority_startups);
+        game_memory.high_priority_queue = &high_priority_queue;
+      }
+
+      // Always one worker, even when there are none above: streaming sound
+      // needs its reads done while the game thread gets on with frames
+      Win32ThreadStartup low_priority_startups[1] = {};
+      PlatformWorkQueue low_priority_queue = {};
+      win32_make_work_queue(&low_priority_queue, 1, low_priority_startups);
+      game_memory.low_priority_queue = &low_priority_queue;
+      win32_state.low_priority_queue = &low_priority_queue;
+
+      game_memory.worker_thread_count = worker_thread_count;
+      game_memory.add_entry = win32_add_entry;
+      game_memory.complete_all_work = win32_complete_all_work;
       
       win32_state.game_memory_total_size = game_memory.permanent_storage_size + game_memory.transient_storage_size;
       win32_state.game_memory = VirtualAlloc(
@@ -1080,12 +1496,14 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
       }
 
 
+#if !defined(HANDMADE_WIN32_AUDIO_THREAD)
       // Initialize sound cursor tracking
       int debug_sound_cursor_idx = 0;
       Win32DebugSoundCursor debug_sound_cursors[30] = {0};
       DWORD audio_latency_bytes = 0;
       float audio_latency_seconds = 0.0f;
       bool sound_is_valid = false;
+#endif
 
       // Initialize Controllers
       GameInput game_input[2] = {};
@@ -1102,7 +1520,9 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
       // Performance counting
       LARGE_INTEGER last_counter = win32_get_wall_clock();
 			u64 last_cycle_count = __rdtsc();
+#if !defined(HANDMADE_WIN32_AUDIO_THREAD)
       LARGE_INTEGER frame_wall_clock = win32_get_wall_clock();
+#endif
 
 			while(Running) {
 			  new_input->target_seconds_per_frame = target_seconds_per_frame;
@@ -1124,6 +1544,8 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
 
         if (CompareFileTime(&new_dll_write_time, &game_code.last_write_time) != 0) {
           // TODO - Add Debug Logging
+          // Reads still in flight would call back into the old dll
+          win32_complete_all_work(&low_priority_queue);
           win32_unload_game_code(&game_code);
           game_code = win32_load_game_code(
               source_game_code_dll_full_path,
@@ -1310,6 +1732,7 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
 				game_offscreen_buffer.height = GlobalBackBuffer.height;
 				game_offscreen_buffer.pitch = GlobalBackBuffer.pitch;
 				game_offscreen_buffer.bytes_per_pixel = GlobalBackBuffer.bytes_per_pixel;
+				game_offscreen_buffer.dirty_rects = &GlobalBackBuffer.dirty_rects;
 
         if (win32_state.input_recording_index) {
           win32_record_input(&win32_state, new_input);
@@ -1320,9 +1743,21 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
           win32_playback_input(&win32_state, new_input);
         }
 
-				game_code.update_and_render(&thread_ctx, &game_memory, new_input, &game_offscreen_buffer);
+        if (win32_state.game_memory_was_restored) {
+          game_memory.was_restored = true;
+          win32_state.game_memory_was_restored = false;
+        }
 
-       
+				game_code.update_and_render(&thread_ctx, &game_memory, new_input, &game_offscreen_buffer);
+#if HANDMADE_INTERNAL
+        win32_handle_debug_cycle_counters(&game_memory);
+#endif
+
+#if defined(HANDMADE_WIN32_AUDIO_THREAD)
+        // Mixed ahead into the ring, the audio thread hands it to DirectSound
+        // as the card gets through it
+        win32_fill_audio_ring(&sound_output, &game_code, &thread_ctx, &game_memory);
+#else
         /*
             Audio latency
             ---------------
@@ -1478,6 +1913,7 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
         } else {
           sound_is_valid = false;
         }
+#endif
 
 
         /*
@@ -1533,9 +1969,11 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
 					&GlobalBackBuffer,
 					device_context, 
 					dimension.width,
-					dimension.height
+					dimension.height,
+					&GlobalBackBuffer.dirty_rects
 				);
         
+#if !defined(HANDMADE_WIN32_AUDIO_THREAD)
         // This marks the end of the frame
         frame_wall_clock = win32_get_wall_clock();
 
@@ -1558,6 +1996,7 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
         debug_sound_cursor->flip_play_cursor = play_cursor;
         debug_sound_cursor->flip_write_cursor = write_cursor;
         // End debugging sound cursors
+#endif
 
         // Swap game inputs
         GameInput *temp = new_input;
@@ -1584,14 +2023,20 @@ int CALLBACK WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR lpCmdLine
 				);
 				OutputDebugStringA(string_buffer);
 
+#if !defined(HANDMADE_WIN32_AUDIO_THREAD)
         // debug sound cursors
         ++debug_sound_cursor_idx;
         if (debug_sound_cursor_idx >= ArrayCount(debug_sound_cursors)) {
           debug_sound_cursor_idx = 0;
         }
         // end debug sound cursors
+#endif
 			}
 
+#if defined(HANDMADE_WIN32_AUDIO_THREAD)
+      win32_stop_audio_output(&sound_output);
+#endif
+
 		} else {
 			// TODO: Handle Create Window Failure
 		}